@@ -0,0 +1,166 @@
+#include "Advisor.h"
+#include "Hand.h"
+
+#include <limits>
+
+/*
+ * Get the expected value of a play.
+ *
+ * Parameters:
+ *	action: Play to get the value of.
+ *
+ * Return:
+ *	Expected value of the play, or minus infinity if it wasn't worked out.
+ */
+double Advice::value(PlayerAction action) const {
+	switch (action) {
+	case PlayerAction::Stand:
+		return this->values.stand;
+	case PlayerAction::Hit:
+		return this->values.hit;
+	case PlayerAction::Double:
+		return this->values.double_down;
+	case PlayerAction::Surrender:
+		return this->values.surrender;
+	case PlayerAction::Split:
+		return this->split_value;
+	default:
+		return -std::numeric_limits<double>::infinity();
+	}
+}
+
+/*
+ * Constructor for the Advisor class.
+ *
+ * Parameters:
+ *	rules: House rules to play by.
+ *	budget: Most time to spend on a hand before falling back to basic strategy.
+ */
+Advisor::Advisor(const RuleSet &rules, std::chrono::microseconds budget) :
+	rules(rules), dealer(rules, ADVISOR_CACHE_ENTRIES), budget(budget)
+{}
+
+/*
+ * Work out the best play on a starting hand.
+ *
+ * Parameters:
+ *	first, second: The player's cards.
+ *	upcard: The dealer's upcard.
+ *	remaining: Every card that is still to be dealt. The player's cards and
+ *			   the upcard must not be among them.
+ *
+ * Return:
+ *	The recommended play along with the basic strategy play and, if there
+ *	was time to work them out, the value of every play.
+ */
+Advice Advisor::advise(Card first, Card second, Card upcard, std::span<const Card> remaining) {
+	auto start = std::chrono::steady_clock::now();
+	const double not_allowed = -std::numeric_limits<double>::infinity();
+
+	Hand hand;
+	hand.add(first);
+	hand.add(second);
+	int upcard_value = upcard.get_numeric_value();
+	bool can_split = hand.is_pair() && this->rules.max_hands >= 2;
+
+	Advice advice;
+	advice.basic_action = basic_strategy(hand, upcard_value, this->rules, true, can_split, true);
+	advice.action = advice.basic_action;
+	advice.exact = false;
+	advice.split_timed_out = false;
+	advice.values.stand = not_allowed;
+	advice.values.hit = not_allowed;
+	advice.values.double_down = not_allowed;
+	advice.values.surrender = not_allowed;
+	advice.split_value = not_allowed;
+
+	/* A blackjack has nothing to decide. */
+	if (hand.is_blackjack()) {
+		advice.action = PlayerAction::Stand;
+		advice.exact = true;
+		advice.microseconds = 0.0;
+		return advice;
+	}
+
+	Composition shoe(remaining);
+	HandAnalyzer analyzer(this->rules, this->dealer, upcard_value);
+	analyzer.set_deadline(start + this->budget);
+
+	ActionValues values = analyzer.hand_values(shoe, first.get_numeric_value(), second.get_numeric_value());
+	if (analyzer.timed_out()) {
+		advice.microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+		return advice;
+	}
+
+	/* Splits take the longest so they are done last and can fall back on their own. */
+	double split_value = not_allowed;
+	bool split_exact = true;
+	if (can_split) {
+		split_value = analyzer.split_value(shoe, first.get_numeric_value());
+		split_exact = !analyzer.timed_out();
+	}
+
+	/* Turn the values into expected values given the dealer doesn't have blackjack. */
+	double no_blackjack = 1.0;
+	if (upcard_value == 11) {
+		no_blackjack -= shoe.probability(10);
+	}
+	else if (upcard_value == 10) {
+		no_blackjack -= shoe.probability(11);
+	}
+
+	advice.values.stand = values.stand / no_blackjack;
+	advice.values.hit = values.hit / no_blackjack;
+	advice.values.double_down = values.double_down / no_blackjack;
+	advice.values.surrender = this->rules.late_surrender ? values.surrender / no_blackjack : not_allowed;
+	advice.split_value = split_exact ? split_value / no_blackjack : not_allowed;
+
+	double best = advice.values.stand;
+	advice.action = PlayerAction::Stand;
+	if (advice.values.hit > best) {
+		best = advice.values.hit;
+		advice.action = PlayerAction::Hit;
+	}
+	if (advice.values.double_down > best) {
+		best = advice.values.double_down;
+		advice.action = PlayerAction::Double;
+	}
+	if (advice.values.surrender > best) {
+		best = advice.values.surrender;
+		advice.action = PlayerAction::Surrender;
+	}
+
+	if (split_exact) {
+		if (advice.split_value > best) {
+			advice.action = PlayerAction::Split;
+		}
+		advice.exact = true;
+	}
+	else if (advice.basic_action == PlayerAction::Split) {
+		advice.action = PlayerAction::Split;
+		advice.split_timed_out = true;
+	}
+	else {
+		/*
+		 * The best of the plays that were worked out, which isn't exact
+		 * since for these cards the split could still have been better.
+		 */
+		advice.split_timed_out = true;
+	}
+
+	advice.microseconds = std::chrono::duration<double, std::micro>(std::chrono::steady_clock::now() - start).count();
+	return advice;
+}
+
+/*
+ * Get the counters of the dealer outcome cache shared by every hand.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Lookups, hits and evictions since the advisor was made.
+ */
+const DealerCacheCounters &Advisor::counters() const {
+	return this->dealer.counters();
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Deck.h"
+#include "RuleSet.h"
+#include "BasicStrategy.h"
+#include "DealerEngine.h"
+#include "HandAnalyzer.h"
+
+#include <chrono>
+#include <span>
+
+/* Default time the advisor is given to work out a play. */
+#define ADVISOR_DEFAULT_BUDGET_US 1000
+/*
+ * Size of the dealer outcome cache. Every hand is dealt from a different
+ * shoe so little carries over from one hand to the next, and a cache that
+ * stays in the CPU caches is faster than a bigger one.
+ */
+#define ADVISOR_CACHE_ENTRIES (1 << 15)
+
+/*
+ * The advisor's recommendation for a hand.
+ */
+struct Advice {
+	/* Best play for the exact cards left, or the basic strategy play if there wasn't time. */
+	PlayerAction action;
+	/* Play the basic strategy chart calls for. */
+	PlayerAction basic_action;
+	/*
+	 * True if every legal play was worked out for the cards left. If there
+	 * wasn't time the play falls back to basic strategy.
+	 */
+	bool exact;
+	/*
+	 * True if every play but the split was worked out and the split ran out
+	 * of time. The play is then a split if basic strategy splits and the best
+	 * of the other plays if it doesn't, and isn't exact either way.
+	 */
+	bool split_timed_out;
+	/*
+	 * Expected value of each play in units bet, given the dealer doesn't have
+	 * blackjack. Plays that aren't allowed or weren't finished are minus
+	 * infinity.
+	 */
+	ActionValues values;
+	double split_value;
+	/* Time taken to work out the play. */
+	double microseconds;
+
+	double value(PlayerAction action) const;
+};
+
+/*
+ * Works out the composition dependent best play on a starting hand for the
+ * exact cards left in the shoe, fast enough to keep up with a live deal.
+ * Dealer outcomes are cached across hands, the analysis skips plays that
+ * can't be best and it gives up at a deadline, falling back to the basic
+ * strategy chart.
+ */
+class Advisor
+{
+private:
+	RuleSet rules;
+	DealerEngine dealer;
+	std::chrono::microseconds budget;
+
+public:
+	Advisor(const RuleSet &rules, std::chrono::microseconds budget = std::chrono::microseconds(ADVISOR_DEFAULT_BUDGET_US));
+
+	Advice advise(Card first, Card second, Card upcard, std::span<const Card> remaining);
+	const DealerCacheCounters &counters() const;
+};
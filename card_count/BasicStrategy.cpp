@@ -0,0 +1,271 @@
+#include "BasicStrategy.h"
+
+/*
+ * Basic strategy tables for a multi-deck shoe with the dealer standing on
+ * soft 17. Columns are the dealer upcard from 2 through 10 and then ace.
+ * Entries are:
+ *	H: Hit
+ *	S: Stand
+ *	D: Double if allowed, otherwise hit
+ *	d: Double if allowed, otherwise stand
+ *	P: Split
+ *	p: Split if doubling after splitting is allowed, otherwise continue as
+ *	   a normal hand
+ *	R: Surrender if allowed, otherwise hit
+ *	r: Surrender if allowed, otherwise stand
+ */
+
+/* Hard totals from 4 through 21. */
+static const char hard_table[18][11] = {
+	"HHHHHHHHHH",	/* 4 */
+	"HHHHHHHHHH",	/* 5 */
+	"HHHHHHHHHH",	/* 6 */
+	"HHHHHHHHHH",	/* 7 */
+	"HHHHHHHHHH",	/* 8 */
+	"HDDDDHHHHH",	/* 9 */
+	"DDDDDDDDHH",	/* 10 */
+	"DDDDDDDDDH",	/* 11 */
+	"HHSSSHHHHH",	/* 12 */
+	"SSSSSHHHHH",	/* 13 */
+	"SSSSSHHHHH",	/* 14 */
+	"SSSSSHHHRH",	/* 15 */
+	"SSSSSHHRRR",	/* 16 */
+	"SSSSSSSSSS",	/* 17 */
+	"SSSSSSSSSS",	/* 18 */
+	"SSSSSSSSSS",	/* 19 */
+	"SSSSSSSSSS",	/* 20 */
+	"SSSSSSSSSS"	/* 21 */
+};
+
+/* Soft totals from 13 (A2) through 21. */
+static const char soft_table[9][11] = {
+	"HHHDDHHHHH",	/* 13 */
+	"HHHDDHHHHH",	/* 14 */
+	"HHDDDHHHHH",	/* 15 */
+	"HHDDDHHHHH",	/* 16 */
+	"HDDDDHHHHH",	/* 17 */
+	"SddddSSHHH",	/* 18 */
+	"SSSSSSSSSS",	/* 19 */
+	"SSSSSSSSSS",	/* 20 */
+	"SSSSSSSSSS"	/* 21 */
+};
+
+/* Pairs by card value from 2 through ace (11). Anything other than a split is played by total. */
+static const char pair_table[10][11] = {
+	"ppPPPPHHHH",	/* 2,2 */
+	"ppPPPPHHHH",	/* 3,3 */
+	"HHHppHHHHH",	/* 4,4 */
+	"HHHHHHHHHH",	/* 5,5 */
+	"pPPPPHHHHH",	/* 6,6 */
+	"PPPPPPHHHH",	/* 7,7 */
+	"PPPPPPPPPP",	/* 8,8 */
+	"PPPPPSPPSS",	/* 9,9 */
+	"SSSSSSSSSS",	/* 10,10 */
+	"PPPPPPPPPP"	/* A,A */
+};
+
+/*
+ * Turn a chart entry into an action.
+ *
+ * Parameters:
+ *	Rules: Rule policy for the rules in effect.
+ *	entry: Letter from a strategy chart.
+ *	rules: House rules in effect.
+ *	can_double: True if the player is allowed to double on this hand.
+ *	can_surrender: True if the player is allowed to surrender this hand.
+ *
+ * Return:
+ *	The action the entry calls for.
+ */
+template <typename Rules>
+static PlayerAction entry_action(char entry, const RuleSet &rules, bool can_double, bool can_surrender) {
+	switch (entry) {
+	case 'D':
+		return can_double ? PlayerAction::Double : PlayerAction::Hit;
+	case 'd':
+		return can_double ? PlayerAction::Double : PlayerAction::Stand;
+	case 'R':
+		return (can_surrender && Rules::late_surrender(rules)) ? PlayerAction::Surrender : PlayerAction::Hit;
+	case 'r':
+		return (can_surrender && Rules::late_surrender(rules)) ? PlayerAction::Surrender : PlayerAction::Stand;
+	case 'S':
+		return PlayerAction::Stand;
+	default:
+		return PlayerAction::Hit;
+	}
+}
+
+/*
+ * Get the display name of a player action.
+ *
+ * Parameters:
+ *	action: The action to name.
+ *
+ * Return:
+ *	Name of the action as a constant string.
+ */
+const char *player_action_name(PlayerAction action) {
+	switch (action) {
+	case PlayerAction::Hit:
+		return "Hit";
+	case PlayerAction::Stand:
+		return "Stand";
+	case PlayerAction::Double:
+		return "Double";
+	case PlayerAction::Split:
+		return "Split";
+	case PlayerAction::Surrender:
+		return "Surrender";
+	default:
+		return "ERROR";
+	}
+}
+
+/*
+ * Look up a player action by its display name.
+ *
+ * Parameters:
+ *	name: Name of the action as returned by player_action_name.
+ *	action: Set to the action if the name matched.
+ *
+ * Return:
+ *	True if the name matched an action and false otherwise.
+ */
+bool player_action_from_name(std::string_view name, PlayerAction &action) {
+	for (int i = 0; i < (int)PlayerAction::PlayerAction_END; i++) {
+		if (name == player_action_name((PlayerAction)i)) {
+			action = (PlayerAction)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Look up the basic strategy decision for a hand.
+ *
+ * Parameters:
+ *	Rules: Rule policy for the rules in effect.
+ *	hand: The player's hand.
+ *	dealer_upcard: Numeric value of the dealer's upcard, 2 through 11 for an ace.
+ *	rules: House rules in effect.
+ *	can_double: True if the player is allowed to double on this hand.
+ *	can_split: True if the player is allowed to split this hand.
+ *	can_surrender: True if the player is allowed to surrender this hand.
+ *
+ * Return:
+ *	The action the player should take.
+ */
+template <typename Rules>
+PlayerAction basic_strategy(const Hand &hand, int dealer_upcard, const RuleSet &rules,
+	bool can_double, bool can_split, bool can_surrender) {
+	int column = dealer_upcard - 2;
+	int total = hand.total();
+	char entry;
+
+	/* Pairs are checked first since a split overrides the play by total. */
+	if (can_split && hand.is_pair()) {
+		entry = pair_table[hand.pair_value() - 2][column];
+		if (entry == 'P' || (entry == 'p' && Rules::double_after_split(rules))) {
+			return PlayerAction::Split;
+		}
+	}
+
+	if (hand.is_soft() && total >= 13) {
+		entry = soft_table[total - 13][column];
+
+		/* When the dealer hits soft 17 doubling soft 18 vs 2 and soft 19 vs 6 become correct. */
+		if (Rules::dealer_hits_soft_17(rules) && ((total == 18 && dealer_upcard == 2) ||
+			(total == 19 && dealer_upcard == 6))) {
+			entry = 'd';
+		}
+	}
+	else {
+		entry = hard_table[(total < 4 ? 4 : total) - 4][column];
+
+		/* When the dealer hits soft 17 the ace becomes stronger for the dealer. */
+		if (Rules::dealer_hits_soft_17(rules) && dealer_upcard == 11) {
+			if (total == 11) {
+				entry = 'D';
+			}
+			else if (total == 15) {
+				entry = 'R';
+			}
+			else if (total == 17) {
+				entry = 'r';
+			}
+		}
+	}
+
+	return entry_action<Rules>(entry, rules, can_double, can_surrender);
+}
+
+/*
+ * Look up the decision for a hand in a strategy table.
+ *
+ * Parameters:
+ *	Rules: Rule policy for the rules in effect.
+ *	table: Strategy to play.
+ *	hand: The player's hand.
+ *	dealer_upcard: Numeric value of the dealer's upcard, 2 through 11 for an ace.
+ *	rules: House rules in effect.
+ *	can_double: True if the player is allowed to double on this hand.
+ *	can_split: True if the player is allowed to split this hand.
+ *	can_surrender: True if the player is allowed to surrender this hand.
+ *
+ * Return:
+ *	The action the player should take.
+ */
+template <typename Rules>
+PlayerAction table_strategy(const StrategyTable &table, const Hand &hand, int dealer_upcard,
+	const RuleSet &rules, bool can_double, bool can_split, bool can_surrender) {
+	int column = dealer_upcard - 2;
+	int total = hand.total();
+	char entry;
+
+	if (can_split && hand.is_pair()) {
+		entry = table.pair[hand.pair_value() - 2][column];
+		if (entry == 'P' || (entry == 'p' && Rules::double_after_split(rules))) {
+			return PlayerAction::Split;
+		}
+	}
+
+	if (hand.is_soft() && total >= 13) {
+		entry = table.soft[total - 13][column];
+	}
+	else {
+		entry = table.hard[(total < 4 ? 4 : total) - 4][column];
+	}
+
+	return entry_action<Rules>(entry, rules, can_double, can_surrender);
+}
+
+/* Every policy with_rule_policy can pick gets its strategy lookups compiled here. */
+#define INSTANTIATE_STRATEGY(h17, das, rsa, ls) \
+	template PlayerAction basic_strategy<FixedRules<h17, das, rsa, ls>>(const Hand &, int, const RuleSet &, \
+		bool, bool, bool); \
+	template PlayerAction table_strategy<FixedRules<h17, das, rsa, ls>>(const StrategyTable &, const Hand &, \
+		int, const RuleSet &, bool, bool, bool);
+template PlayerAction basic_strategy<RuntimeRules>(const Hand &, int, const RuleSet &, bool, bool, bool);
+template PlayerAction table_strategy<RuntimeRules>(const StrategyTable &, const Hand &, int, const RuleSet &,
+	bool, bool, bool);
+FIXED_RULE_SETS(INSTANTIATE_STRATEGY)
+#undef INSTANTIATE_STRATEGY
+
+/*
+ * Look up the basic strategy decision for a hand with the rules read at
+ * runtime. See the templated basic_strategy.
+ */
+PlayerAction basic_strategy(const Hand &hand, int dealer_upcard, const RuleSet &rules,
+	bool can_double, bool can_split, bool can_surrender) {
+	return basic_strategy<RuntimeRules>(hand, dealer_upcard, rules, can_double, can_split, can_surrender);
+}
+
+/*
+ * Look up the decision for a hand in a strategy table with the rules read
+ * at runtime. See the templated table_strategy.
+ */
+PlayerAction table_strategy(const StrategyTable &table, const Hand &hand, int dealer_upcard,
+	const RuleSet &rules, bool can_double, bool can_split, bool can_surrender) {
+	return table_strategy<RuntimeRules>(table, hand, dealer_upcard, rules, can_double, can_split, can_surrender);
+}
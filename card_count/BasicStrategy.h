@@ -0,0 +1,48 @@
+#pragma once
+
+#include "Hand.h"
+#include "RuleSet.h"
+
+#include <string_view>
+
+/*
+ * Decisions a player can make on a hand.
+ */
+enum class PlayerAction {
+	Hit,
+	Stand,
+	Double,
+	Split,
+	Surrender,
+
+	PlayerAction_END
+};
+
+/*
+ * A basic strategy chart in the same layout as the built in charts: hard
+ * totals 4 through 21, soft totals 13 through 21 and pairs 2,2 through A,A,
+ * each with a column for every dealer upcard from 2 through ace. Entries use
+ * the same letters as the built in charts. Unlike the built in charts a
+ * table is made for one rule set so no rule adjustments are applied to it.
+ */
+struct StrategyTable {
+	char hard[18][11];
+	char soft[9][11];
+	char pair[10][11];
+};
+
+const char *player_action_name(PlayerAction action);
+bool player_action_from_name(std::string_view name, PlayerAction &action);
+
+PlayerAction basic_strategy(const Hand &hand, int dealer_upcard, const RuleSet &rules,
+	bool can_double, bool can_split, bool can_surrender);
+PlayerAction table_strategy(const StrategyTable &table, const Hand &hand, int dealer_upcard,
+	const RuleSet &rules, bool can_double, bool can_split, bool can_surrender);
+
+/* Versions specialized for a rule policy, instantiated for RuntimeRules and every FIXED_RULE_SETS policy. */
+template <typename Rules>
+PlayerAction basic_strategy(const Hand &hand, int dealer_upcard, const RuleSet &rules,
+	bool can_double, bool can_split, bool can_surrender);
+template <typename Rules>
+PlayerAction table_strategy(const StrategyTable &table, const Hand &hand, int dealer_upcard,
+	const RuleSet &rules, bool can_double, bool can_split, bool can_surrender);
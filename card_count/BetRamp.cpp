@@ -0,0 +1,198 @@
+#include "BetRamp.h"
+
+#include <cmath>
+#include <limits>
+
+/* Scales tried when searching for the best ramp within a spread, as powers of ten. */
+#define RAMP_SCALE_MIN_POWER 0.0
+#define RAMP_SCALE_MAX_POWER 7.0
+#define RAMP_SCALE_STEPS 700
+
+/*
+ * Work out how a bet ramp would have done over the rounds of a simulation.
+ * Every round's bet only depends on the true count it starts at, so the win
+ * on a round scales with the bet and the totals of each true count give the
+ * exact result of betting the ramp on the very same rounds. Comparing ramps
+ * on one simulation therefore uses common random numbers for free.
+ *
+ * Parameters:
+ *	result: Results of a flat betting simulation.
+ *	ramp: Bet at each true count.
+ *	bankroll: Bankroll in units of the minimum bet, for the risk of ruin.
+ *
+ * Return:
+ *	Statistics of the ramp. Everything is zero if no rounds were played.
+ */
+RampStatistics evaluate_ramp(const SimulationResult &result, const BetRamp &ramp, double bankroll) {
+	RampStatistics stats;
+	if (result.totals.rounds == 0) {
+		return stats;
+	}
+
+	double rounds = (double)result.totals.rounds;
+	double sum = 0.0, sum_squares = 0.0, bet_sum = 0.0;
+	for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+		const RoundTotals &bucket = result.true_counts[i];
+		double bet = ramp.bets[i];
+
+		sum += bet * (double)bucket.units / SIM_UNIT_SCALE;
+		sum_squares += bet * bet * (double)bucket.squared_units / (SIM_UNIT_SCALE * SIM_UNIT_SCALE);
+		bet_sum += bet * (double)bucket.rounds;
+	}
+
+	stats.ev = sum / rounds;
+	stats.variance = sum_squares / rounds - stats.ev * stats.ev;
+	stats.average_bet = bet_sum / rounds;
+
+	if (stats.ev > 0.0 && stats.variance > 0.0) {
+		stats.score = 1e6 * stats.ev * stats.ev / stats.variance;
+		stats.n0 = stats.variance / (stats.ev * stats.ev);
+		stats.risk_of_ruin = std::exp(-2.0 * stats.ev * bankroll / stats.variance);
+	}
+	else {
+		stats.n0 = std::numeric_limits<double>::infinity();
+		stats.risk_of_ruin = 1.0;
+	}
+
+	return stats;
+}
+
+/*
+ * Get the edge over the variance of a set of rounds, which is the fraction
+ * of the bankroll the Kelly criterion bets. Zero if there are too few rounds
+ * to tell.
+ */
+static double kelly_fraction(const RoundTotals &totals) {
+	double variance = totals.variance();
+	if (totals.rounds < 2 || variance <= 0.0) {
+		return 0.0;
+	}
+	return totals.mean() / variance;
+}
+
+/*
+ * Get the Kelly fraction at every true count, made non-decreasing in the
+ * true count. Each count's own fraction is noisy and a higher count can come
+ * out below a lower one, which no player would bet. Neighbouring counts that
+ * are out of order have their rounds pooled until none are, weighting each
+ * count by its rounds.
+ *
+ * Parameters:
+ *	result: Results of a flat betting simulation.
+ *	fractions: Filled in with the fraction at each true count.
+ *
+ * Return:
+ *	Nothing
+ */
+static void monotone_kelly_fractions(const SimulationResult &result, double fractions[TRUE_COUNT_BUCKETS]) {
+	/* Blocks of pooled neighbouring counts, each starting at first[block]. */
+	RoundTotals pooled[TRUE_COUNT_BUCKETS];
+	int first[TRUE_COUNT_BUCKETS];
+	int blocks = 0;
+
+	for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+		pooled[blocks] = result.true_counts[i];
+		first[blocks] = i;
+		blocks++;
+		while (blocks > 1 && kelly_fraction(pooled[blocks - 2]) > kelly_fraction(pooled[blocks - 1])) {
+			pooled[blocks - 2].merge(pooled[blocks - 1]);
+			blocks--;
+		}
+	}
+
+	for (int block = 0; block < blocks; block++) {
+		int end = block + 1 < blocks ? first[block + 1] : TRUE_COUNT_BUCKETS;
+		double fraction = kelly_fraction(pooled[block]);
+		for (int i = first[block]; i < end; i++) {
+			fractions[i] = fraction;
+		}
+	}
+}
+
+/*
+ * Get the bet at a true count that maximizes the growth of the bankroll for
+ * a multiple of the bankroll, clamped to the spread. Counts where the player
+ * is at a disadvantage get the minimum bet.
+ */
+static double clamped_kelly_bet(double fraction, double scale, double max_spread) {
+	double bet = scale * fraction;
+	if (bet < 1.0) {
+		return 1.0;
+	}
+	if (bet > max_spread) {
+		return max_spread;
+	}
+	return bet;
+}
+
+/*
+ * Find the ramp with the best SCORE for a bet spread. The best ramp bets in
+ * proportion to the edge over the variance at each count, clamped to the
+ * spread, so only the proportion has to be searched for. The edges are made
+ * non-decreasing in the true count first, so the ramp never bets less at a
+ * higher count.
+ *
+ * Parameters:
+ *	result: Results of a flat betting simulation.
+ *	max_spread: Largest bet in units of the minimum bet.
+ *
+ * Return:
+ *	The ramp with the best SCORE, or a flat ramp if no ramp within the
+ *	spread wins.
+ */
+BetRamp optimal_ramp(const SimulationResult &result, double max_spread) {
+	BetRamp best;
+	double best_ratio = -std::numeric_limits<double>::infinity();
+	double fractions[TRUE_COUNT_BUCKETS];
+	monotone_kelly_fractions(result, fractions);
+
+	for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+		best.bets[i] = 1.0;
+	}
+
+	for (int step = 0; step <= RAMP_SCALE_STEPS; step++) {
+		double power = RAMP_SCALE_MIN_POWER + (RAMP_SCALE_MAX_POWER - RAMP_SCALE_MIN_POWER) * step / RAMP_SCALE_STEPS;
+		double scale = std::pow(10.0, power);
+
+		BetRamp ramp;
+		for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+			ramp.bets[i] = clamped_kelly_bet(fractions[i], scale, max_spread);
+		}
+
+		/* Win over standard deviation orders ramps the same as SCORE and also works when no ramp wins. */
+		RampStatistics stats = evaluate_ramp(result, ramp, 0.0);
+		if (stats.variance <= 0.0) {
+			continue;
+		}
+		double ratio = stats.ev / std::sqrt(stats.variance);
+		if (ratio > best_ratio) {
+			best_ratio = ratio;
+			best = ramp;
+		}
+	}
+
+	return best;
+}
+
+/*
+ * Get the full Kelly ramp for a bankroll: at every count the bet that
+ * maximizes the growth of the bankroll, clamped to the spread. Like
+ * optimal_ramp it never bets less at a higher count.
+ *
+ * Parameters:
+ *	result: Results of a flat betting simulation.
+ *	bankroll: Bankroll in units of the minimum bet.
+ *	max_spread: Largest bet in units of the minimum bet.
+ *
+ * Return:
+ *	The Kelly ramp.
+ */
+BetRamp kelly_ramp(const SimulationResult &result, double bankroll, double max_spread) {
+	BetRamp ramp;
+	double fractions[TRUE_COUNT_BUCKETS];
+	monotone_kelly_fractions(result, fractions);
+	for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+		ramp.bets[i] = clamped_kelly_bet(fractions[i], bankroll, max_spread);
+	}
+	return ramp;
+}
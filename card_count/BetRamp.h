@@ -0,0 +1,32 @@
+#pragma once
+
+#include "Simulator.h"
+
+/*
+ * A bet ramp: the bet to make at each true count, in units of the minimum
+ * bet. Entries are indexed like SimulationResult::true_counts.
+ */
+struct BetRamp {
+	double bets[TRUE_COUNT_BUCKETS];
+};
+
+/*
+ * How a bet ramp performs over the rounds of a simulation. Amounts are in
+ * units of the minimum bet.
+ */
+struct RampStatistics {
+	/* Expected win and variance per round. */
+	double ev = 0.0;
+	double variance = 0.0;
+	double average_bet = 0.0;
+	/* Win rate per 100 rounds with a 10,000 unit bankroll bet at the Kelly optimal scale. */
+	double score = 0.0;
+	/* Rounds needed before the expected win equals one standard deviation. */
+	double n0 = 0.0;
+	/* Chance of losing the whole bankroll playing forever. */
+	double risk_of_ruin = 0.0;
+};
+
+RampStatistics evaluate_ramp(const SimulationResult &result, const BetRamp &ramp, double bankroll);
+BetRamp optimal_ramp(const SimulationResult &result, double max_spread);
+BetRamp kelly_ramp(const SimulationResult &result, double bankroll, double max_spread);
@@ -0,0 +1,497 @@
+#include "Checkpoint.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <vector>
+
+#ifdef _WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+/*
+ * Mix a value into a running hash.
+ */
+static void hash_value(uint64_t &hash, uint64_t value) {
+	uint64_t state = hash ^ value;
+	hash = splitmix64(state);
+}
+
+/*
+ * Mix the bits of a floating point value into a running hash.
+ */
+static void hash_double(uint64_t &hash, double value) {
+	uint64_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	hash_value(hash, bits);
+}
+
+/*
+ * Hash every setting that changes the results of a run apart from its range
+ * of shoes, which is kept in the checkpoint as it is, so the shards of a run
+ * all have the same hash. The thread count and the checkpoint settings are
+ * left out since they don't change the results.
+ *
+ * Parameters:
+ *	config: Settings of the run.
+ *
+ * Return:
+ *	Hash of the settings.
+ */
+uint64_t checkpoint_config_hash(const SimulationConfig &config) {
+	uint64_t hash = CHECKPOINT_MAGIC;
+
+	hash_value(hash, config.seed);
+	hash_value(hash, (uint64_t)config.shuffle_mode);
+	hash_double(hash, config.target_standard_error);
+	hash_value(hash, (uint64_t)config.counting_system);
+
+	const RuleSet &rules = config.rules;
+	hash_value(hash, (uint64_t)rules.deck_count);
+	hash_double(hash, rules.penetration);
+	hash_value(hash, rules.dealer_hits_soft_17);
+	hash_value(hash, rules.double_after_split);
+	hash_value(hash, rules.resplit_aces);
+	hash_value(hash, rules.late_surrender);
+	hash_value(hash, (uint64_t)rules.max_hands);
+	hash_double(hash, rules.blackjack_payout);
+
+	hash_value(hash, config.strategy != nullptr);
+	if (config.strategy != nullptr) {
+		const unsigned char *bytes = (const unsigned char *)config.strategy;
+		for (size_t i = 0; i < sizeof(StrategyTable); i++) {
+			hash_value(hash, bytes[i]);
+		}
+	}
+
+	return hash;
+}
+
+/*
+ * Get the range of shoes of the whole run a shard is part of. A run that
+ * isn't split is the whole run.
+ *
+ * Parameters:
+ *	config: Settings of the shard.
+ *	first_shoe: Filled in with the first shoe of the whole run.
+ *	shoe_count: Filled in with the number of shoes of the whole run.
+ *
+ * Return:
+ *	Nothing
+ */
+void checkpoint_run_range(const SimulationConfig &config, uint64_t &first_shoe, uint64_t &shoe_count) {
+	if (config.shard_count > 1) {
+		first_shoe = config.run_first_shoe;
+		shoe_count = config.run_shoe_count;
+	}
+	else {
+		first_shoe = config.first_shoe;
+		shoe_count = config.shoe_count;
+	}
+}
+
+/*
+ * Check if a checkpoint was saved by a run with the given settings.
+ *
+ * Parameters:
+ *	checkpoint: Checkpoint to check.
+ *	config: Settings of the run to resume.
+ *
+ * Return:
+ *	True if the run can carry on from the checkpoint.
+ */
+bool checkpoint_matches(const SimulationCheckpoint &checkpoint, const SimulationConfig &config) {
+	uint64_t run_first_shoe, run_shoe_count;
+	checkpoint_run_range(config, run_first_shoe, run_shoe_count);
+	return checkpoint.config_hash == checkpoint_config_hash(config) &&
+		checkpoint.first_shoe == config.first_shoe && checkpoint.shoe_count == config.shoe_count &&
+		checkpoint.shard == config.shard && checkpoint.shard_count == config.shard_count &&
+		checkpoint.run_first_shoe == run_first_shoe && checkpoint.run_shoe_count == run_shoe_count;
+}
+
+/*
+ * Check if the run a checkpoint was taken from has finished.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if every planned shoe was played.
+ */
+bool SimulationCheckpoint::finished() const {
+	return this->done_tasks == this->planned_tasks;
+}
+
+/*
+ * Combine the results of the shards of a run. The results are summed
+ * exactly, so they are the same as if a single process had played all of
+ * the shards' shoes. Since the shards run at the same time, the time of the
+ * combined results is that of the slowest shard.
+ *
+ * Parameters:
+ *	checkpoints: Checkpoints of the finished shards.
+ *	merged: Filled in with the combined results.
+ *	error: Filled in with why the shards can't be combined.
+ *
+ * Return:
+ *	True if the shards were combined. False if any of them hasn't finished,
+ *	they come from runs with different settings or ranges of shoes, they
+ *	aren't every shard of the run exactly once or their shoes don't cover
+ *	the shoes of the run exactly.
+ */
+bool merge_checkpoints(const std::vector<SimulationCheckpoint> &checkpoints, SimulationResult &merged,
+	std::string &error) {
+	merged = SimulationResult();
+	if (checkpoints.empty()) {
+		error = "no shards to merge";
+		return false;
+	}
+
+	/* The whole run is only there if every one of its shards is, once. */
+	int shard_count = checkpoints[0].shard_count;
+	std::vector<size_t> given(shard_count > 0 ? shard_count : 0, 0);
+
+	for (size_t i = 0; i < checkpoints.size(); i++) {
+		const SimulationCheckpoint &checkpoint = checkpoints[i];
+		if (checkpoint.shard_count != shard_count || checkpoint.shard < 0 || checkpoint.shard >= shard_count) {
+			error = "shard " + std::to_string(i + 1) + " is from a run split a different number of ways";
+			return false;
+		}
+		if (given[checkpoint.shard] != 0) {
+			error = "shards " + std::to_string(given[checkpoint.shard]) + " and " + std::to_string(i + 1) +
+				" are both shard " + std::to_string(checkpoint.shard + 1) + "/" + std::to_string(shard_count);
+			return false;
+		}
+		given[checkpoint.shard] = i + 1;
+
+		if (!checkpoint.finished()) {
+			error = "shard " + std::to_string(i + 1) + " hasn't finished";
+			return false;
+		}
+		if (checkpoint.config_hash != checkpoints[0].config_hash) {
+			error = "shard " + std::to_string(i + 1) + " was run with different options";
+			return false;
+		}
+		if (checkpoint.run_first_shoe != checkpoints[0].run_first_shoe ||
+			checkpoint.run_shoe_count != checkpoints[0].run_shoe_count) {
+			error = "shard " + std::to_string(i + 1) + " is from a run with a different range of shoes";
+			return false;
+		}
+
+		merged.merge(checkpoint.result);
+		merged.seconds = std::max(merged.seconds, checkpoint.result.seconds);
+	}
+
+	for (int shard = 0; shard < shard_count; shard++) {
+		if (given[shard] == 0) {
+			error = "shard " + std::to_string(shard + 1) + "/" + std::to_string(shard_count) + " is missing";
+			return false;
+		}
+	}
+
+	/* Laid end to end in order, the shards have to play exactly the shoes of the run. */
+	std::vector<const SimulationCheckpoint *> ordered;
+	for (const SimulationCheckpoint &checkpoint : checkpoints) {
+		ordered.push_back(&checkpoint);
+	}
+	std::sort(ordered.begin(), ordered.end(), [](const SimulationCheckpoint *a, const SimulationCheckpoint *b) {
+		return a->first_shoe < b->first_shoe;
+	});
+	uint64_t next_shoe = checkpoints[0].run_first_shoe;
+	uint64_t run_end = next_shoe + checkpoints[0].run_shoe_count;
+	bool tiled = true;
+	for (const SimulationCheckpoint *checkpoint : ordered) {
+		tiled = tiled && checkpoint->first_shoe == next_shoe && checkpoint->shoe_count <= run_end - next_shoe;
+		next_shoe += checkpoint->shoe_count;
+	}
+	if (!tiled || next_shoe != run_end) {
+		error = "the shards don't play exactly shoes " + std::to_string(checkpoints[0].run_first_shoe) +
+			" to " + std::to_string(run_end - 1) + " of the run";
+		return false;
+	}
+
+	return true;
+}
+
+/*
+ * Append the bytes of a value to a buffer.
+ */
+template <typename T>
+static void put(std::vector<unsigned char> &buffer, const T &value) {
+	const unsigned char *bytes = (const unsigned char *)&value;
+	buffer.insert(buffer.end(), bytes, bytes + sizeof(T));
+}
+
+/*
+ * Read a value out of a buffer, moving the offset past it.
+ *
+ * Return:
+ *	False if the buffer ends before the value does.
+ */
+template <typename T>
+static bool get(const std::vector<unsigned char> &buffer, size_t &offset, T &value) {
+	if (buffer.size() - offset < sizeof(T)) {
+		return false;
+	}
+	memcpy(&value, buffer.data() + offset, sizeof(T));
+	offset += sizeof(T);
+	return true;
+}
+
+/*
+ * Append a set of totals to a buffer.
+ */
+static void put_totals(std::vector<unsigned char> &buffer, const RoundTotals &totals) {
+	put(buffer, totals.rounds);
+	put(buffer, totals.units);
+	put(buffer, totals.squared_units);
+}
+
+/*
+ * Read a set of totals out of a buffer.
+ */
+static bool get_totals(const std::vector<unsigned char> &buffer, size_t &offset, RoundTotals &totals) {
+	return get(buffer, offset, totals.rounds) && get(buffer, offset, totals.units) &&
+		get(buffer, offset, totals.squared_units);
+}
+
+/*
+ * Hash the bytes of a checkpoint to catch files that were cut short or
+ * damaged.
+ */
+static uint64_t checksum(const unsigned char *bytes, size_t size) {
+	uint64_t hash = CHECKPOINT_VERSION;
+	for (size_t i = 0; i < size; i++) {
+		hash_value(hash, bytes[i]);
+	}
+	return hash;
+}
+
+/*
+ * Wait until the data written to a file is on the disk, not just in the
+ * operating system's cache.
+ */
+static bool sync_file(FILE *file) {
+#ifdef _WIN32
+	return _commit(_fileno(file)) == 0;
+#else
+	return fsync(fileno(file)) == 0;
+#endif
+}
+
+/*
+ * Write a checkpoint to a file. The checkpoint is written to a temporary
+ * file that is flushed to the disk and then replaces the old checkpoint, so
+ * a crash or power loss part way through never leaves a damaged or empty
+ * checkpoint behind. The temporary file is removed if anything fails. The
+ * layout is the fields of the checkpoint in order followed by a checksum.
+ *
+ * Parameters:
+ *	path: Path of the checkpoint file.
+ *	checkpoint: Checkpoint to write.
+ *
+ * Return:
+ *	True if the checkpoint was written and false otherwise.
+ */
+bool save_checkpoint(const std::string &path, const SimulationCheckpoint &checkpoint) {
+	const SimulationResult &result = checkpoint.result;
+	std::vector<unsigned char> buffer;
+
+	put(buffer, (uint32_t)CHECKPOINT_MAGIC);
+	put(buffer, (uint32_t)CHECKPOINT_VERSION);
+	put(buffer, checkpoint.config_hash);
+	put(buffer, checkpoint.seed);
+	put(buffer, checkpoint.first_shoe);
+	put(buffer, checkpoint.shoe_count);
+	put(buffer, (int32_t)checkpoint.shard);
+	put(buffer, (int32_t)checkpoint.shard_count);
+	put(buffer, checkpoint.run_first_shoe);
+	put(buffer, checkpoint.run_shoe_count);
+	put(buffer, checkpoint.done_tasks);
+	put(buffer, checkpoint.planned_tasks);
+	put(buffer, result.seconds);
+	put(buffer, result.shoes);
+	put(buffer, result.hands);
+	put_totals(buffer, result.totals);
+	for (const RoundTotals &bucket : result.true_counts) {
+		put_totals(buffer, bucket);
+	}
+	put_totals(buffer, result.shoe_totals);
+	put_totals(buffer, result.pair_totals);
+	put(buffer, checksum(buffer.data(), buffer.size()));
+
+	std::string temporary_path = path + ".tmp";
+	FILE *file = fopen(temporary_path.c_str(), "wb");
+	if (file == NULL) {
+		return false;
+	}
+	bool ok = fwrite(buffer.data(), 1, buffer.size(), file) == buffer.size() && fflush(file) == 0 &&
+		sync_file(file);
+	ok = fclose(file) == 0 && ok;
+
+	std::error_code error;
+	if (ok) {
+		std::filesystem::rename(temporary_path, path, error);
+	}
+	if (!ok || error) {
+		remove(temporary_path.c_str());
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Read a checkpoint written by save_checkpoint.
+ *
+ * Parameters:
+ *	path: Path of the checkpoint file.
+ *	checkpoint: Filled in with the checkpoint.
+ *
+ * Return:
+ *	True if the file held a whole checkpoint of this version and false if
+ *	it couldn't be read or was damaged.
+ */
+bool load_checkpoint(const std::string &path, SimulationCheckpoint &checkpoint) {
+	FILE *file = fopen(path.c_str(), "rb");
+	if (file == NULL) {
+		return false;
+	}
+	std::vector<unsigned char> buffer;
+	unsigned char chunk[4096];
+	size_t count;
+	while ((count = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+		buffer.insert(buffer.end(), chunk, chunk + count);
+	}
+	fclose(file);
+
+	if (buffer.size() < sizeof(uint64_t)) {
+		return false;
+	}
+	size_t body_size = buffer.size() - sizeof(uint64_t);
+	uint64_t stored_checksum;
+	memcpy(&stored_checksum, buffer.data() + body_size, sizeof(stored_checksum));
+	if (stored_checksum != checksum(buffer.data(), body_size)) {
+		return false;
+	}
+
+	SimulationResult &result = checkpoint.result;
+	size_t offset = 0;
+	uint32_t magic, version;
+	int32_t shard = 0, shard_count = 1;
+	bool ok = get(buffer, offset, magic) && get(buffer, offset, version) &&
+		magic == CHECKPOINT_MAGIC && version == CHECKPOINT_VERSION &&
+		get(buffer, offset, checkpoint.config_hash) &&
+		get(buffer, offset, checkpoint.seed) &&
+		get(buffer, offset, checkpoint.first_shoe) &&
+		get(buffer, offset, checkpoint.shoe_count) &&
+		get(buffer, offset, shard) &&
+		get(buffer, offset, shard_count) &&
+		get(buffer, offset, checkpoint.run_first_shoe) &&
+		get(buffer, offset, checkpoint.run_shoe_count) &&
+		get(buffer, offset, checkpoint.done_tasks) &&
+		get(buffer, offset, checkpoint.planned_tasks) &&
+		get(buffer, offset, result.seconds) &&
+		get(buffer, offset, result.shoes) &&
+		get(buffer, offset, result.hands) &&
+		get_totals(buffer, offset, result.totals);
+	for (RoundTotals &bucket : result.true_counts) {
+		ok = ok && get_totals(buffer, offset, bucket);
+	}
+	ok = ok && get_totals(buffer, offset, result.shoe_totals) && get_totals(buffer, offset, result.pair_totals);
+	checkpoint.shard = shard;
+	checkpoint.shard_count = shard_count;
+
+	return ok && offset == body_size;
+}
+
+/*
+ * Constructor for the CheckpointWriter class. Starts the writer thread.
+ *
+ * Parameters:
+ *	path: Path of the checkpoint file to write.
+ */
+CheckpointWriter::CheckpointWriter(const std::string &path) :
+	path(path), has_pending(false), is_writing(false), stopping(false), write_failed(false)
+{
+	this->thread = std::thread(&CheckpointWriter::run, this);
+}
+
+/*
+ * Destructor for the CheckpointWriter class. Writes the last checkpoint
+ * handed in, if it hasn't been written yet, and stops the writer thread.
+ */
+CheckpointWriter::~CheckpointWriter() {
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->stopping = true;
+	}
+	this->wake.notify_one();
+	this->thread.join();
+}
+
+/*
+ * Body of the writer thread. Waits for checkpoints and writes them until
+ * the writer is destroyed.
+ */
+void CheckpointWriter::run() {
+	std::unique_lock<std::mutex> guard(this->lock);
+
+	while (true) {
+		this->wake.wait(guard, [this] { return this->has_pending || this->stopping; });
+		if (!this->has_pending) {
+			return;
+		}
+
+		/* Take the pending checkpoint and write it without holding the lock. */
+		std::swap(this->pending, this->writing);
+		this->has_pending = false;
+		this->is_writing = true;
+		guard.unlock();
+		bool ok = save_checkpoint(this->path, this->writing);
+		guard.lock();
+
+		if (!ok) {
+			this->write_failed = true;
+		}
+		this->is_writing = false;
+		this->written.notify_all();
+	}
+}
+
+/*
+ * Hand a checkpoint to the writer thread. This only copies the checkpoint
+ * so it returns right away.
+ *
+ * Parameters:
+ *	checkpoint: Checkpoint to write.
+ *
+ * Return:
+ *	Nothing
+ */
+void CheckpointWriter::submit(const SimulationCheckpoint &checkpoint) {
+	{
+		std::lock_guard<std::mutex> guard(this->lock);
+		this->pending = checkpoint;
+		this->has_pending = true;
+	}
+	this->wake.notify_one();
+}
+
+/*
+ * Wait until every checkpoint handed in so far has been written.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if every checkpoint was written and false if any couldn't be.
+ */
+bool CheckpointWriter::flush() {
+	std::unique_lock<std::mutex> guard(this->lock);
+	this->written.wait(guard, [this] { return !this->has_pending && !this->is_writing; });
+	return !this->write_failed;
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+#include "Simulator.h"
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/* First bytes of a checkpoint file ("CKPT") and the version of its layout. */
+#define CHECKPOINT_MAGIC 0x54504B43u
+#define CHECKPOINT_VERSION 4u
+
+/*
+ * Everything needed to pick a simulation back up where it left off.
+ * Checkpoints are only taken between blocks of shoes, when every shoe before
+ * done_tasks has been played and no shoe is part way through. Every shoe is
+ * shuffled from the random stream of its index, so the index of the next
+ * shoe is the position of every random stream and no shoe state needs to be
+ * kept.
+ * The checkpoint of a finished run holds its results, which is how the
+ * shards of a run split over several processes hand their results to
+ * merge_checkpoints.
+ */
+struct SimulationCheckpoint {
+	/*
+	 * Hash of the settings of the run apart from its range of shoes, so a
+	 * checkpoint is never resumed into or merged with a different run.
+	 */
+	uint64_t config_hash = 0;
+	/* Seed of the run, so a run started without a seed can be resumed. */
+	uint64_t seed = 0;
+	/* Range of shoes the run plays. */
+	uint64_t first_shoe = 0;
+	uint64_t shoe_count = 0;
+	/* Which shard of how many the run is, so a merge can tell if every shard is there. */
+	int shard = 0;
+	int shard_count = 1;
+	/*
+	 * Range of shoes of the whole run the shard is part of, so a merge can
+	 * tell the shards together play exactly the shoes of one run.
+	 */
+	uint64_t run_first_shoe = 0;
+	uint64_t run_shoe_count = 0;
+	/* Tasks played so far and tasks planned, as counted by run_simulation. */
+	uint64_t done_tasks = 0;
+	uint64_t planned_tasks = 0;
+	/* Results of every shoe played so far, with the time spent on them. */
+	SimulationResult result;
+
+	bool finished() const;
+};
+
+/*
+ * Writes checkpoints on a thread of its own so the simulation never waits on
+ * the disk. There are two buffers: the simulation copies a checkpoint into
+ * the pending buffer and carries on while the writer thread writes the other
+ * one. If a checkpoint comes in before the last one was written the newer
+ * one replaces it, since only the latest checkpoint matters.
+ */
+class CheckpointWriter
+{
+private:
+	std::string path;
+	std::mutex lock;
+	std::condition_variable wake;
+	std::condition_variable written;
+	SimulationCheckpoint pending;
+	SimulationCheckpoint writing;
+	bool has_pending;
+	bool is_writing;
+	bool stopping;
+	bool write_failed;
+	std::thread thread;
+
+	void run();
+
+public:
+	CheckpointWriter(const std::string &path);
+	~CheckpointWriter();
+
+	void submit(const SimulationCheckpoint &checkpoint);
+	bool flush();
+};
+
+uint64_t checkpoint_config_hash(const SimulationConfig &config);
+void checkpoint_run_range(const SimulationConfig &config, uint64_t &first_shoe, uint64_t &shoe_count);
+bool checkpoint_matches(const SimulationCheckpoint &checkpoint, const SimulationConfig &config);
+bool merge_checkpoints(const std::vector<SimulationCheckpoint> &checkpoints, SimulationResult &merged,
+	std::string &error);
+bool save_checkpoint(const std::string &path, const SimulationCheckpoint &checkpoint);
+bool load_checkpoint(const std::string &path, SimulationCheckpoint &checkpoint);
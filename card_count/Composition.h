@@ -0,0 +1,422 @@
+#pragma once
+
+#include "Deck.h"
+#include "Random.h"
+
+#include <cstdint>
+#include <span>
+
+/* SSE2 is part of x64 so it is used whenever the target has it. */
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define COMPOSITION_SSE2 1
+#include <emmintrin.h>
+#endif
+
+/* Number of distinct card values in blackjack, 2 through 10 and the ace. */
+#define COMPOSITION_VALUES 10
+/* Counts are stored in this many bytes, so a whole composition fits in one 128 bit register. */
+#define COMPOSITION_LANES 16
+/* Largest shoe a composition key can describe without overflowing a count. */
+#define COMPOSITION_MAX_DECKS 15
+/* Most cards of a single value a composition can hold, all of the tens in the largest shoe. */
+#define COMPOSITION_MAX_COUNT (COMPOSITION_MAX_DECKS * 16)
+
+/*
+ * Random numbers for Zobrist hashing compositions, one for every count of
+ * every value. The hash of a composition is the xor of the numbers for the
+ * count of each value so taking out or putting back a card only swaps one
+ * number for another.
+ */
+struct CompositionZobristTable {
+	uint64_t numbers[COMPOSITION_VALUES][COMPOSITION_MAX_COUNT + 1];
+
+	constexpr CompositionZobristTable() : numbers() {
+		uint64_t state = 0x436F6D706F736974ULL;
+		for (int value = 0; value < COMPOSITION_VALUES; value++) {
+			for (int count = 0; count <= COMPOSITION_MAX_COUNT; count++) {
+				this->numbers[value][count] = splitmix64(state);
+			}
+		}
+	}
+};
+
+constexpr CompositionZobristTable composition_zobrist_table;
+
+/*
+ * Position of each value's count in the packed composition key, indexed by
+ * value - 2. Tens get the top 10 bits and every other value gets 6 bits.
+ */
+constexpr int composition_key_shift[COMPOSITION_VALUES] = {
+	48, 42, 36, 30, 24, 18, 12, 6, 54, 0
+};
+
+/*
+ * Composition of a shoe by blackjack card value. Suits and the difference
+ * between tens and face cards don't matter to the play of a hand, so a shoe
+ * is described by ten counts. Values are the card numeric values used
+ * everywhere else, 2 through 10 and 11 for an ace.
+ *
+ * This is the shoe type for analytic engines: taking out or putting back a
+ * card is constant time, the key and hash are kept up to date for caching,
+ * and whole compositions are added, taken away and compared with single
+ * vector instructions. It can be built from the cards left in a Deck and
+ * kept in sync with one card at a time or with sync.
+ */
+class Composition
+{
+private:
+	/* Number of cards of each value left, indexed by value - 2. Lanes past the last value are always zero. */
+	alignas(COMPOSITION_LANES) unsigned char counts[COMPOSITION_LANES];
+	int total;
+	uint64_t packed_key;
+	uint64_t zobrist_hash;
+
+	void rehash();
+	void count_cards(std::span<const Card> cards);
+
+public:
+	Composition();
+	Composition(int deck_count);
+	Composition(std::span<const Card> cards);
+	Composition(Deck &deck);
+
+	void sync(Deck &deck);
+	void add(int value);
+	void remove(int value);
+	void add(Card card);
+	void remove(Card card);
+	void add(const Composition &other);
+	void remove(const Composition &other);
+	bool contains(const Composition &other) const;
+	bool operator==(const Composition &other) const;
+	int count(int value) const;
+	int size() const;
+	double probability(int value) const;
+	uint64_t key() const;
+	uint64_t hash() const;
+};
+
+/*
+ * Constructor for an empty composition.
+ */
+inline Composition::Composition() :
+	counts(), total(0)
+{
+	this->rehash();
+}
+
+/*
+ * Constructor for the composition of a full shoe.
+ *
+ * Parameters:
+ *	deck_count: Number of decks in the shoe.
+ */
+inline Composition::Composition(int deck_count) :
+	counts(), total(deck_count * 52)
+{
+	for (int value = 2; value <= 11; value++) {
+		this->counts[value - 2] = (unsigned char)(deck_count * (value == 10 ? 16 : 4));
+	}
+	this->rehash();
+}
+
+/*
+ * Constructor for the composition of a set of cards, such as the cards left
+ * in a deck.
+ *
+ * Parameters:
+ *	cards: Cards to count. There must be no more than a
+ *		   COMPOSITION_MAX_DECKS deck shoe's worth of any value.
+ */
+inline Composition::Composition(std::span<const Card> cards) :
+	counts(), total(0)
+{
+	this->count_cards(cards);
+}
+
+/*
+ * Constructor for the composition of the cards left in a deck.
+ *
+ * Parameters:
+ *	deck: Deck to count. Like any set of cards it must hold no more than
+ *		  COMPOSITION_MAX_DECKS decks.
+ */
+inline Composition::Composition(Deck &deck) :
+	counts(), total(0)
+{
+	this->count_cards(deck.remaining_cards());
+}
+
+/*
+ * Replace the counts with those of a set of cards.
+ */
+inline void Composition::count_cards(std::span<const Card> cards) {
+	for (unsigned char &count : this->counts) {
+		count = 0;
+	}
+	for (const Card &card : cards) {
+		this->counts[card.get_numeric_value() - 2]++;
+	}
+	this->total = (int)cards.size();
+	this->rehash();
+}
+
+/*
+ * Bring the composition back in line with the cards left in a deck, for
+ * example after the deck was shuffled or drawn from without telling the
+ * composition.
+ *
+ * Parameters:
+ *	deck: Deck to count.
+ *
+ * Return:
+ *	Nothing
+ */
+inline void Composition::sync(Deck &deck) {
+	this->count_cards(deck.remaining_cards());
+}
+
+/*
+ * Work out the key and hash from scratch after the counts are filled in.
+ */
+inline void Composition::rehash() {
+	this->packed_key = 0;
+	this->zobrist_hash = 0;
+	for (int i = 0; i < COMPOSITION_VALUES; i++) {
+		this->packed_key |= (uint64_t)this->counts[i] << composition_key_shift[i];
+		this->zobrist_hash ^= composition_zobrist_table.numbers[i][this->counts[i]];
+	}
+}
+
+/*
+ * Put a card of a value back into the composition.
+ *
+ * Parameters:
+ *	value: Numeric value of the card, 2 through 11.
+ *
+ * Return:
+ *	Nothing
+ */
+inline void Composition::add(int value) {
+	int i = value - 2;
+	this->zobrist_hash ^= composition_zobrist_table.numbers[i][this->counts[i]] ^
+		composition_zobrist_table.numbers[i][this->counts[i] + 1];
+	this->packed_key += (uint64_t)1 << composition_key_shift[i];
+	this->counts[i]++;
+	this->total++;
+}
+
+/*
+ * Take a card of a value out of the composition. The caller must make sure
+ * there is one left.
+ *
+ * Parameters:
+ *	value: Numeric value of the card, 2 through 11.
+ *
+ * Return:
+ *	Nothing
+ */
+inline void Composition::remove(int value) {
+	int i = value - 2;
+	this->zobrist_hash ^= composition_zobrist_table.numbers[i][this->counts[i]] ^
+		composition_zobrist_table.numbers[i][this->counts[i] - 1];
+	this->packed_key -= (uint64_t)1 << composition_key_shift[i];
+	this->counts[i]--;
+	this->total--;
+}
+
+/*
+ * Put a card back into the composition.
+ *
+ * Parameters:
+ *	card: The card.
+ *
+ * Return:
+ *	Nothing
+ */
+inline void Composition::add(Card card) {
+	this->add(card.get_numeric_value());
+}
+
+/*
+ * Take a card out of the composition, for example one drawn from the deck
+ * the composition describes. The caller must make sure there is one left.
+ *
+ * Parameters:
+ *	card: The card.
+ *
+ * Return:
+ *	Nothing
+ */
+inline void Composition::remove(Card card) {
+	this->remove(card.get_numeric_value());
+}
+
+/*
+ * Put every card of another composition into this one.
+ *
+ * Parameters:
+ *	other: Cards to add. The counts must stay within COMPOSITION_MAX_DECKS decks.
+ *
+ * Return:
+ *	Nothing
+ */
+inline void Composition::add(const Composition &other) {
+#ifdef COMPOSITION_SSE2
+	__m128i sum = _mm_add_epi8(_mm_load_si128((const __m128i *)this->counts),
+		_mm_load_si128((const __m128i *)other.counts));
+	_mm_store_si128((__m128i *)this->counts, sum);
+#else
+	for (int i = 0; i < COMPOSITION_VALUES; i++) {
+		this->counts[i] += other.counts[i];
+	}
+#endif
+	this->total += other.total;
+	this->rehash();
+}
+
+/*
+ * Take every card of another composition out of this one, for example the
+ * cards of a hand. The caller must make sure this composition contains the
+ * other one.
+ *
+ * Parameters:
+ *	other: Cards to take out.
+ *
+ * Return:
+ *	Nothing
+ */
+inline void Composition::remove(const Composition &other) {
+#ifdef COMPOSITION_SSE2
+	__m128i difference = _mm_sub_epi8(_mm_load_si128((const __m128i *)this->counts),
+		_mm_load_si128((const __m128i *)other.counts));
+	_mm_store_si128((__m128i *)this->counts, difference);
+#else
+	for (int i = 0; i < COMPOSITION_VALUES; i++) {
+		this->counts[i] -= other.counts[i];
+	}
+#endif
+	this->total -= other.total;
+	this->rehash();
+}
+
+/*
+ * Check if every card of another composition is in this one.
+ *
+ * Parameters:
+ *	other: Composition to look for.
+ *
+ * Return:
+ *	True if this composition has at least as many cards of every value.
+ */
+inline bool Composition::contains(const Composition &other) const {
+#ifdef COMPOSITION_SSE2
+	/* Subtracting with saturation leaves zero in every lane where other has no more cards than this. */
+	__m128i missing = _mm_subs_epu8(_mm_load_si128((const __m128i *)other.counts),
+		_mm_load_si128((const __m128i *)this->counts));
+	return _mm_movemask_epi8(_mm_cmpeq_epi8(missing, _mm_setzero_si128())) == 0xFFFF;
+#else
+	for (int i = 0; i < COMPOSITION_VALUES; i++) {
+		if (other.counts[i] > this->counts[i]) {
+			return false;
+		}
+	}
+	return true;
+#endif
+}
+
+/*
+ * Check if two compositions have the same number of cards of every value.
+ *
+ * Parameters:
+ *	other: Composition to compare with.
+ *
+ * Return:
+ *	True if the compositions are the same.
+ */
+inline bool Composition::operator==(const Composition &other) const {
+#ifdef COMPOSITION_SSE2
+	__m128i equal = _mm_cmpeq_epi8(_mm_load_si128((const __m128i *)this->counts),
+		_mm_load_si128((const __m128i *)other.counts));
+	return _mm_movemask_epi8(equal) == 0xFFFF;
+#else
+	for (int i = 0; i < COMPOSITION_VALUES; i++) {
+		if (other.counts[i] != this->counts[i]) {
+			return false;
+		}
+	}
+	return true;
+#endif
+}
+
+/*
+ * Get the number of cards of a value left.
+ *
+ * Parameters:
+ *	value: Numeric value of the card, 2 through 11.
+ *
+ * Return:
+ *	Number of cards of the value.
+ */
+inline int Composition::count(int value) const {
+	return this->counts[value - 2];
+}
+
+/*
+ * Get the number of cards left.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Total number of cards in the composition.
+ */
+inline int Composition::size() const {
+	return this->total;
+}
+
+/*
+ * Get the chance that the next card dealt has a value.
+ *
+ * Parameters:
+ *	value: Numeric value of the card, 2 through 11.
+ *
+ * Return:
+ *	Probability between 0 and 1. Zero if the composition is empty.
+ */
+inline double Composition::probability(int value) const {
+	if (this->total == 0) {
+		return 0.0;
+	}
+	return (double)this->counts[value - 2] / (double)this->total;
+}
+
+/*
+ * Get a key that is unique for every composition of up to
+ * COMPOSITION_MAX_DECKS decks, with the count of each value packed into its
+ * own bits. The key is kept up to date as cards are added and removed.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Key identifying the composition.
+ */
+inline uint64_t Composition::key() const {
+	return this->packed_key;
+}
+
+/*
+ * Get the Zobrist hash of the composition. Unlike the key its bits are
+ * spread evenly so it can be used directly to index a hash table. The hash
+ * is kept up to date as cards are added and removed.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Hash of the composition.
+ */
+inline uint64_t Composition::hash() const {
+	return this->zobrist_hash;
+}
@@ -0,0 +1,335 @@
+#pragma once
+
+#include "Deck.h"
+#include "Composition.h"
+#include "CountingSystem.h"
+
+#include <span>
+
+/*
+ * Tracks the composition of the cards left in a deck along with the running
+ * count under a counting system. The tracker wraps a deck so every card that
+ * is drawn through it updates a 13 lane rank histogram and the running count
+ * in constant time. The full deck is only scanned when it is shuffled. The
+ * cards left are also kept as a Composition for the analytic engines, as
+ * long as the deck has no more than COMPOSITION_MAX_DECKS decks.
+ */
+template <typename System = HiLo>
+class CompositionTracker
+{
+private:
+	Deck &deck;
+	/* Number of cards of each rank left in the deck, indexed by rank - 2. */
+	int remaining[13];
+	/* The same cards by blackjack value, only kept when the deck fits in a Composition. */
+	Composition values;
+	bool track_values;
+	int cards_remaining;
+	int running;
+
+	void rebuild();
+
+public:
+	CompositionTracker(Deck &deck);
+
+	Card draw();
+	size_t draw_n(std::span<Card> out);
+	void discard(Card card);
+	size_t discard_n(std::span<const Card> in);
+	void shuffle();
+
+	int rank_remaining(CardRank rank) const;
+	int total_remaining() const;
+	int running_count() const;
+	float decks_remaining() const;
+	float true_count() const;
+	int aces_remaining() const;
+	int ace_side_count() const;
+	float ace_richness() const;
+	bool has_composition() const;
+	const Composition &composition() const;
+};
+
+/*
+ * Constructor for the CompositionTracker class. The tracker starts out in
+ * sync with the cards currently left in the deck and with the running count
+ * at the system's initial count.
+ *
+ * Parameters:
+ *	deck: Deck to draw from. The deck should only be drawn from or shuffled
+ *		  through the tracker while the tracker is in use.
+ */
+template <typename System>
+CompositionTracker<System>::CompositionTracker(Deck &deck) :
+	deck(deck), track_values(deck.deck_count() <= COMPOSITION_MAX_DECKS)
+{
+	this->rebuild();
+}
+
+/*
+ * Rebuild the histogram from the cards left in the deck and reset the
+ * running count. This is the only place the deck is scanned.
+ */
+template <typename System>
+void CompositionTracker<System>::rebuild() {
+	for (int i = 0; i < 13; i++) {
+		this->remaining[i] = 0;
+	}
+
+	std::span<const Card> cards = this->deck.remaining_cards();
+	for (const Card &card : cards) {
+		this->remaining[(int)card.get_card_rank() - 2]++;
+	}
+
+	if (this->track_values) {
+		this->values.sync(this->deck);
+	}
+	this->cards_remaining = (int)cards.size();
+	this->running = initial_running_count<System>(this->deck.deck_count());
+}
+
+/*
+ * Draw a card from the deck and update the composition.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	The drawn card. If the deck is empty an invalid card is returned.
+ */
+template <typename System>
+Card CompositionTracker<System>::draw() {
+	Card card = this->deck.draw();
+
+	if (card.is_valid()) {
+		this->remaining[(int)card.get_card_rank() - 2]--;
+		if (this->track_values) {
+			this->values.remove(card);
+		}
+		this->cards_remaining--;
+		this->running += count_value<System>(card);
+	}
+
+	return card;
+}
+
+/*
+ * Draw a batch of cards from the deck and update the composition.
+ *
+ * Parameters:
+ *	out: Buffer to fill with drawn cards.
+ *
+ * Return:
+ *	Number of cards actually drawn.
+ */
+template <typename System>
+size_t CompositionTracker<System>::draw_n(std::span<Card> out) {
+	size_t count = this->deck.draw_n(out);
+
+	for (size_t i = 0; i < count; i++) {
+		this->remaining[(int)out[i].get_card_rank() - 2]--;
+		this->running += count_value<System>(out[i]);
+	}
+	if (this->track_values) {
+		for (size_t i = 0; i < count; i++) {
+			this->values.remove(out[i]);
+		}
+	}
+	this->cards_remaining -= (int)count;
+
+	return count;
+}
+
+/*
+ * Discard a card into the deck. Discarded cards have already been counted
+ * when they were drawn so only the deck is updated.
+ *
+ * Parameters:
+ *	card: Card to discard.
+ *
+ * Return:
+ *	Nothing
+ */
+template <typename System>
+void CompositionTracker<System>::discard(Card card) {
+	this->deck.discard(card);
+}
+
+/*
+ * Discard a batch of cards into the deck.
+ *
+ * Parameters:
+ *	in: Cards to discard.
+ *
+ * Return:
+ *	Number of cards actually discarded.
+ */
+template <typename System>
+size_t CompositionTracker<System>::discard_n(std::span<const Card> in) {
+	return this->deck.discard_n(in);
+}
+
+/*
+ * Shuffle the deck and start tracking the new shoe.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Nothing
+ */
+template <typename System>
+void CompositionTracker<System>::shuffle() {
+	this->deck.shuffle();
+	this->rebuild();
+}
+
+/*
+ * Get the number of cards of a rank left in the deck.
+ *
+ * Parameters:
+ *	rank: Rank to look up.
+ *
+ * Return:
+ *	Number of cards of that rank left in the deck.
+ */
+template <typename System>
+int CompositionTracker<System>::rank_remaining(CardRank rank) const {
+	return this->remaining[(int)rank - 2];
+}
+
+/*
+ * Get the total number of cards left in the deck.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of cards left in the deck.
+ */
+template <typename System>
+int CompositionTracker<System>::total_remaining() const {
+	return this->cards_remaining;
+}
+
+/*
+ * Get the running count since the last shuffle.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Running count in units of the system's scale.
+ */
+template <typename System>
+int CompositionTracker<System>::running_count() const {
+	return this->running;
+}
+
+/*
+ * Get the number of decks left to be dealt.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Decks remaining as a fraction. Never less than one card's worth so it
+ *	is always safe to divide by.
+ */
+template <typename System>
+float CompositionTracker<System>::decks_remaining() const {
+	return (float)(this->cards_remaining > 0 ? this->cards_remaining : 1) / 52.0f;
+}
+
+/*
+ * Get the true count, the running count per deck left to be dealt.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True count in whole points. Scaled systems such as Wong Halves are
+ *	divided back down by their scale.
+ */
+template <typename System>
+float CompositionTracker<System>::true_count() const {
+	return (float)this->running / (float)System::scale / this->decks_remaining();
+}
+
+/*
+ * Get the number of aces left in the deck.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of aces left.
+ */
+template <typename System>
+int CompositionTracker<System>::aces_remaining() const {
+	return this->remaining[(int)CardRank::Ace - 2];
+}
+
+/*
+ * Get the ace side count, the number of aces dealt since the last shuffle.
+ * This is used alongside counting systems that leave aces at zero such as
+ * Hi-Opt II and Omega II.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of aces seen.
+ */
+template <typename System>
+int CompositionTracker<System>::ace_side_count() const {
+	return 4 * this->deck.deck_count() - this->aces_remaining();
+}
+
+/*
+ * Get how ace rich the rest of the deck is, the number of aces left beyond
+ * the one in thirteen a neutral deck has, per deck remaining.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Extra aces per remaining deck. Positive values mean the deck is ace rich.
+ */
+template <typename System>
+float CompositionTracker<System>::ace_richness() const {
+	float expected = (float)this->cards_remaining / 13.0f;
+	return ((float)this->aces_remaining() - expected) / this->decks_remaining();
+}
+
+/*
+ * Check if the tracker keeps a Composition of the cards left. It only does
+ * when the deck has no more than COMPOSITION_MAX_DECKS decks, since larger
+ * shoes would overflow its counts.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if composition() can be used.
+ */
+template <typename System>
+bool CompositionTracker<System>::has_composition() const {
+	return this->track_values;
+}
+
+/*
+ * Get the cards left in the deck by blackjack value, ready to be passed to
+ * the analytic engines or used as a cache key. Only valid if
+ * has_composition is true.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Composition of the cards left, kept in sync with every draw.
+ */
+template <typename System>
+const Composition &CompositionTracker<System>::composition() const {
+	return this->values;
+}
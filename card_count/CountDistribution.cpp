@@ -0,0 +1,300 @@
+#include "CountDistribution.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+
+/*
+ * Cards in the shoe that share a tag. Which rank a card has doesn't matter
+ * to the running count, only its tag, so ranks with the same tag are dealt
+ * with together.
+ */
+struct TagGroup {
+	int tag;
+	int cards;
+};
+
+/*
+ * Work out the exact count distribution for a counting system.
+ *
+ * The table holds, for every number of cards n and running count, how many
+ * sets of n cards taken from the groups seen so far have tags adding up to
+ * that count. Adding a group of K cards with tag t gives
+ *	next[n][count] = sum over k of C(K, k) * current[n - k][count - t * k]
+ * since k of the n cards can be any k of the group's K cards. Only the
+ * table for the groups seen so far and the one being filled in are kept,
+ * and every running count of the new table only reads the old one, so the
+ * running counts are split into blocks that are filled in on separate
+ * threads. Once every group is in, each row is divided by its total, the
+ * number of sets of n cards.
+ *
+ * Parameters:
+ *	deck_count: Number of decks in the shoe.
+ *	thread_count: Number of worker threads, zero for one per core.
+ *
+ * Return:
+ *	The distribution.
+ */
+template <typename System>
+static CountDistribution distribution_for(int deck_count, int thread_count) {
+	CountDistribution distribution;
+	distribution.deck_count = deck_count;
+	distribution.scale = System::scale;
+
+	std::vector<TagGroup> groups;
+	for (int rank = (int)CardRank::Two; rank <= (int)CardRank::Ace; rank++) {
+		int tag = count_value<System>(Card((CardRank)rank, CardSuit::Club, true));
+		auto group = std::find_if(groups.begin(), groups.end(), [&](const TagGroup &g) { return g.tag == tag; });
+		if (group == groups.end()) {
+			groups.push_back({ tag, 0 });
+			group = groups.end() - 1;
+		}
+		group->cards += 4 * deck_count;
+	}
+
+	int initial = initial_running_count<System>(deck_count);
+	distribution.min_running = initial;
+	distribution.max_running = initial;
+	for (const TagGroup &group : groups) {
+		if (group.tag < 0) {
+			distribution.min_running += group.tag * group.cards;
+		}
+		else {
+			distribution.max_running += group.tag * group.cards;
+		}
+	}
+
+	int width = distribution.width();
+	size_t rows = (size_t)distribution.card_count() + 1;
+	std::vector<double> current(rows * width, 0.0);
+	std::vector<double> next(rows * width, 0.0);
+	current[initial - distribution.min_running] = 1.0;
+
+	TaskScheduler scheduler(thread_count);
+	uint64_t blocks = (width + COUNT_DISTRIBUTION_BLOCK - 1) / COUNT_DISTRIBUTION_BLOCK;
+	std::vector<double> binomial;
+	int dealt = 0;
+
+	for (const TagGroup &group : groups) {
+		/* C(K, k) for every k, built up one factor at a time. */
+		binomial.assign(group.cards + 1, 1.0);
+		for (int k = 1; k <= group.cards; k++) {
+			binomial[k] = binomial[k - 1] * (double)(group.cards - k + 1) / (double)k;
+		}
+
+		int total = dealt + group.cards;
+		scheduler.run(blocks, [&](uint64_t task, int) {
+			int begin = (int)task * COUNT_DISTRIBUTION_BLOCK;
+			int end = std::min(begin + COUNT_DISTRIBUTION_BLOCK, width);
+
+			for (int n = 0; n <= total; n++) {
+				double *out = &next[(size_t)n * width];
+				std::fill(out + begin, out + end, 0.0);
+
+				for (int k = std::max(0, n - dealt); k <= std::min(group.cards, n); k++) {
+					const double *in = &current[(size_t)(n - k) * width];
+					double coefficient = binomial[k];
+					int shift = group.tag * k;
+					/* out[count] reads in[count - shift], which has to be inside the row. */
+					int low = std::max(begin, shift);
+					int high = std::min(end, width + shift);
+					for (int count = low; count < high; count++) {
+						out[count] += coefficient * in[count - shift];
+					}
+				}
+			}
+		});
+
+		current.swap(next);
+		dealt = total;
+	}
+
+	for (size_t n = 0; n < rows; n++) {
+		double *row = &current[n * width];
+		double sum = 0.0;
+		for (int count = 0; count < width; count++) {
+			sum += row[count];
+		}
+		for (int count = 0; count < width; count++) {
+			row[count] /= sum;
+		}
+	}
+
+	distribution.probability.swap(current);
+	return distribution;
+}
+
+/*
+ * Work out the exact chance of every running count at every depth of a
+ * shoe, using the count values of the cards under a counting system.
+ *
+ * Parameters:
+ *	counting_system: The counting system.
+ *	deck_count: Number of decks in the shoe, 1 to COUNT_DISTRIBUTION_MAX_DECKS.
+ *	thread_count: Number of worker threads, zero for one per core.
+ *
+ * Return:
+ *	The distribution, with an empty table if the number of decks is out of
+ *	range.
+ */
+CountDistribution count_distribution(CountingSystemId counting_system, int deck_count, int thread_count) {
+	if (deck_count < 1 || deck_count > COUNT_DISTRIBUTION_MAX_DECKS) {
+		return CountDistribution();
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	CountDistribution distribution = with_counting_system(counting_system, [&](auto system) {
+		return distribution_for<decltype(system)>(deck_count, thread_count);
+	});
+	distribution.counting_system = counting_system;
+	distribution.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return distribution;
+}
+
+/*
+ * Get the number of cards in the shoe.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of cards, the most that can be dealt.
+ */
+int CountDistribution::card_count() const {
+	return this->deck_count * 52;
+}
+
+/*
+ * Get the number of running counts stored for every depth.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of running counts from min_running to max_running.
+ */
+int CountDistribution::width() const {
+	return this->max_running - this->min_running + 1;
+}
+
+/*
+ * Get the chance of a running count after a number of cards are dealt.
+ *
+ * Parameters:
+ *	cards_dealt: Number of cards dealt since the shuffle.
+ *	running: Running count in units of the system's scale.
+ *
+ * Return:
+ *	Chance of the running count, zero if it can't happen.
+ */
+double CountDistribution::running_probability(int cards_dealt, int running) const {
+	if (cards_dealt < 0 || cards_dealt > this->card_count() || running < this->min_running ||
+		running > this->max_running) {
+		return 0.0;
+	}
+	return this->probability[(size_t)cards_dealt * this->width() + running - this->min_running];
+}
+
+/*
+ * Get the chance of each true count after a number of cards are dealt. The
+ * true counts are bucketed like the simulator's, rounded down and clamped.
+ *
+ * Parameters:
+ *	cards_dealt: Number of cards dealt since the shuffle.
+ *	frequency: Filled in with the chance of each bucket, indexed like
+ *			   SimulationResult::true_counts.
+ *
+ * Return:
+ *	Nothing
+ */
+void CountDistribution::true_counts(int cards_dealt, double (&frequency)[TRUE_COUNT_BUCKETS]) const {
+	for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+		frequency[i] = 0.0;
+	}
+	if (cards_dealt < 0 || cards_dealt > this->card_count()) {
+		return;
+	}
+
+	const double *row = &this->probability[(size_t)cards_dealt * this->width()];
+	int cards_remaining = this->card_count() - cards_dealt;
+	for (int count = 0; count < this->width(); count++) {
+		frequency[true_count_bucket(count + this->min_running, this->scale, cards_remaining)] += row[count];
+	}
+}
+
+/*
+ * Get the chance the true count is at least some value after a number of
+ * cards are dealt.
+ *
+ * Parameters:
+ *	cards_dealt: Number of cards dealt since the shuffle.
+ *	min_true_count: Smallest true count that counts as favourable, for
+ *					example 1 for a true count of +1 or more.
+ *
+ * Return:
+ *	Chance of a favourable true count.
+ */
+double CountDistribution::favourable(int cards_dealt, int min_true_count) const {
+	double frequency[TRUE_COUNT_BUCKETS];
+	this->true_counts(cards_dealt, frequency);
+
+	double sum = 0.0;
+	for (int i = std::max(min_true_count - TRUE_COUNT_MIN, 0); i < TRUE_COUNT_BUCKETS; i++) {
+		sum += frequency[i];
+	}
+	return sum;
+}
+
+/*
+ * Get how often the true count is at least some value over the part of the
+ * shoe dealt before the cut card, averaged over every card dealt.
+ *
+ * Parameters:
+ *	penetration: Fraction of the shoe dealt before the cut card comes out.
+ *	min_true_count: Smallest true count that counts as favourable.
+ *
+ * Return:
+ *	Fraction of the cards dealt at a favourable true count.
+ */
+double CountDistribution::favourable_frequency(float penetration, int min_true_count) const {
+	int cut = std::clamp((int)(penetration * this->card_count()), 1, this->card_count());
+
+	double sum = 0.0;
+	for (int n = 0; n < cut; n++) {
+		sum += this->favourable(n, min_true_count);
+	}
+	return sum / cut;
+}
+
+/*
+ * Write a count distribution to a text file. Each line holds the number of
+ * cards dealt, a running count in units of the system's scale and its
+ * chance. Running counts that can't happen at a depth are left out.
+ *
+ * Parameters:
+ *	path: Path of the file to write.
+ *	distribution: Distribution to write.
+ *
+ * Return:
+ *	True if the file was written and false otherwise.
+ */
+bool save_count_distribution(const char *path, const CountDistribution &distribution) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	fprintf(file, "# cards_dealt running_count probability\n");
+	for (int n = 0; n <= distribution.card_count(); n++) {
+		for (int running = distribution.min_running; running <= distribution.max_running; running++) {
+			double probability = distribution.running_probability(n, running);
+			if (probability > 0.0) {
+				fprintf(file, "%d %d %.17g\n", n, running, probability);
+			}
+		}
+	}
+
+	bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok;
+}
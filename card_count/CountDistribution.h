@@ -0,0 +1,44 @@
+#pragma once
+
+#include "Simulator.h"
+
+#include <vector>
+
+/* Most decks the exact count distribution is worked out for. */
+#define COUNT_DISTRIBUTION_MAX_DECKS 8
+/* Running counts given to one task when the table is split between threads. */
+#define COUNT_DISTRIBUTION_BLOCK 32
+
+/*
+ * Exact chance of every running count at every depth of a freshly shuffled
+ * shoe under a counting system, without simulating. The running count after
+ * n cards only depends on which n cards came out, and every set of n cards
+ * is as likely as any other, so the chance of a running count is the number
+ * of n card sets whose tags add up to it over the number of n card sets.
+ */
+struct CountDistribution {
+	CountingSystemId counting_system = CountingSystemId::HiLo;
+	int deck_count = 0;
+	/* Scale of the counting system's tags. Running counts are in units of it. */
+	int scale = 1;
+	/* Smallest and largest running count the shoe can reach, including the initial count. */
+	int min_running = 0;
+	int max_running = 0;
+	/*
+	 * Chance of each running count after n cards are dealt, stored at
+	 * n * width() + running - min_running for n from 0 to the whole shoe.
+	 */
+	std::vector<double> probability;
+	/* Time taken to work out the distribution. */
+	double seconds = 0.0;
+
+	int card_count() const;
+	int width() const;
+	double running_probability(int cards_dealt, int running) const;
+	void true_counts(int cards_dealt, double (&frequency)[TRUE_COUNT_BUCKETS]) const;
+	double favourable(int cards_dealt, int min_true_count) const;
+	double favourable_frequency(float penetration, int min_true_count) const;
+};
+
+CountDistribution count_distribution(CountingSystemId counting_system, int deck_count, int thread_count = 0);
+bool save_count_distribution(const char *path, const CountDistribution &distribution);
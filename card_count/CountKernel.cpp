@@ -0,0 +1,240 @@
+#include "CountKernel.h"
+
+#include <algorithm>
+
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#define COUNT_KERNEL_X86
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+/* MSVC lets any intrinsic be used in any function. */
+#define COUNT_KERNEL_TARGET(isa)
+#else
+/* GCC and clang need the instruction set enabled per function. */
+#define COUNT_KERNEL_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+/*
+ * Check which vector instruction sets the CPU supports.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	The fastest kernel level the CPU can run.
+ */
+CountKernelLevel detect_count_kernel_level() {
+#if defined(COUNT_KERNEL_X86) && defined(_MSC_VER)
+	int info[4];
+	__cpuid(info, 0);
+	int max_leaf = info[0];
+
+	__cpuid(info, 1);
+	bool ssse3 = (info[2] & (1 << 9)) != 0;
+	bool osxsave = (info[2] & (1 << 27)) != 0;
+	bool avx = (info[2] & (1 << 28)) != 0;
+	bool avx2 = false;
+	if (max_leaf >= 7 && osxsave && avx) {
+		/* Make sure the OS saves the upper halves of the ymm registers. */
+		bool ymm_enabled = (_xgetbv(0) & 0x6) == 0x6;
+		__cpuidex(info, 7, 0);
+		avx2 = ymm_enabled && (info[1] & (1 << 5)) != 0;
+	}
+
+	if (avx2) {
+		return CountKernelLevel::AVX2;
+	}
+	if (ssse3) {
+		return CountKernelLevel::SSSE3;
+	}
+#elif defined(COUNT_KERNEL_X86)
+	if (__builtin_cpu_supports("avx2")) {
+		return CountKernelLevel::AVX2;
+	}
+	if (__builtin_cpu_supports("ssse3")) {
+		return CountKernelLevel::SSSE3;
+	}
+#endif
+	return CountKernelLevel::Scalar;
+}
+
+/*
+ * Plain scalar version of the kernel. Used as the fallback on CPUs without
+ * SIMD support and for the tail of the stream in the vector versions.
+ */
+static int count_stream_scalar(const uint8_t *codes, size_t length, const signed char *tags,
+	int count, int *running_count) {
+	for (size_t i = 0; i < length; i++) {
+		count += tags[codes[i] & CARD_RANK_MASK];
+		running_count[i] = count;
+	}
+	return count;
+}
+
+#ifdef COUNT_KERNEL_X86
+
+/*
+ * Sign extend the 16 int8 prefix sums in a register to int32, add the count
+ * carried in from earlier blocks and store them.
+ */
+COUNT_KERNEL_TARGET("ssse3")
+static inline void store_prefix_16(__m128i prefix, __m128i carry, int *out) {
+	/* Interleaving a register with itself and shifting right sign extends each lane. */
+	__m128i low_16 = _mm_srai_epi16(_mm_unpacklo_epi8(prefix, prefix), 8);
+	__m128i high_16 = _mm_srai_epi16(_mm_unpackhi_epi8(prefix, prefix), 8);
+
+	_mm_storeu_si128((__m128i *)(out + 0), _mm_add_epi32(carry, _mm_srai_epi32(_mm_unpacklo_epi16(low_16, low_16), 16)));
+	_mm_storeu_si128((__m128i *)(out + 4), _mm_add_epi32(carry, _mm_srai_epi32(_mm_unpackhi_epi16(low_16, low_16), 16)));
+	_mm_storeu_si128((__m128i *)(out + 8), _mm_add_epi32(carry, _mm_srai_epi32(_mm_unpacklo_epi16(high_16, high_16), 16)));
+	_mm_storeu_si128((__m128i *)(out + 12), _mm_add_epi32(carry, _mm_srai_epi32(_mm_unpackhi_epi16(high_16, high_16), 16)));
+}
+
+/*
+ * Compute the inclusive prefix sum of 16 int8 lanes. With tags in [-7, 7]
+ * the sums stay within [-112, 112] so they can't overflow.
+ */
+COUNT_KERNEL_TARGET("ssse3")
+static inline __m128i prefix_sum_16(__m128i x) {
+	x = _mm_add_epi8(x, _mm_slli_si128(x, 1));
+	x = _mm_add_epi8(x, _mm_slli_si128(x, 2));
+	x = _mm_add_epi8(x, _mm_slli_si128(x, 4));
+	x = _mm_add_epi8(x, _mm_slli_si128(x, 8));
+	return x;
+}
+
+/*
+ * SSSE3 version of the kernel. pshufb uses the low nibble of each card code
+ * (the rank) to pick the tag out of the 16 byte tag table.
+ */
+COUNT_KERNEL_TARGET("ssse3")
+static int count_stream_ssse3(const uint8_t *codes, size_t length, const signed char *tags,
+	int count, int *running_count) {
+	const __m128i tag_table = _mm_loadu_si128((const __m128i *)tags);
+	const __m128i rank_mask = _mm_set1_epi8(CARD_RANK_MASK);
+
+	size_t i = 0;
+	for (; i + 16 <= length; i += 16) {
+		__m128i block = _mm_loadu_si128((const __m128i *)(codes + i));
+		__m128i block_tags = _mm_shuffle_epi8(tag_table, _mm_and_si128(block, rank_mask));
+		__m128i prefix = prefix_sum_16(block_tags);
+
+		store_prefix_16(prefix, _mm_set1_epi32(count), running_count + i);
+		count += (signed char)_mm_cvtsi128_si32(_mm_srli_si128(prefix, 15));
+	}
+
+	return count_stream_scalar(codes + i, length - i, tags, count, running_count + i);
+}
+
+/*
+ * AVX2 version of the kernel. This does the same as the SSSE3 version but
+ * on 32 cards at a time. vpshufb works on each 128 bit half on its own so
+ * the tag table is broadcast to both halves and the halves are summed
+ * separately.
+ */
+COUNT_KERNEL_TARGET("avx2")
+static int count_stream_avx2(const uint8_t *codes, size_t length, const signed char *tags,
+	int count, int *running_count) {
+	const __m256i tag_table = _mm256_broadcastsi128_si256(_mm_loadu_si128((const __m128i *)tags));
+	const __m256i rank_mask = _mm256_set1_epi8(CARD_RANK_MASK);
+
+	size_t i = 0;
+	for (; i + 32 <= length; i += 32) {
+		__m256i block = _mm256_loadu_si256((const __m256i *)(codes + i));
+		__m256i block_tags = _mm256_shuffle_epi8(tag_table, _mm256_and_si256(block, rank_mask));
+
+		/* In lane prefix sum, each 128 bit half is summed on its own. */
+		__m256i prefix = block_tags;
+		prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 1));
+		prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 2));
+		prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 4));
+		prefix = _mm256_add_epi8(prefix, _mm256_slli_si256(prefix, 8));
+
+		__m128i low = _mm256_castsi256_si128(prefix);
+		__m128i high = _mm256_extracti128_si256(prefix, 1);
+		int low_total = (signed char)_mm_cvtsi128_si32(_mm_srli_si128(low, 15));
+		int high_total = (signed char)_mm_cvtsi128_si32(_mm_srli_si128(high, 15));
+
+		/* Widen eight lanes at a time and add the carried in count. */
+		__m256i carry = _mm256_set1_epi32(count);
+		_mm256_storeu_si256((__m256i *)(running_count + i + 0), _mm256_add_epi32(carry, _mm256_cvtepi8_epi32(low)));
+		_mm256_storeu_si256((__m256i *)(running_count + i + 8), _mm256_add_epi32(carry, _mm256_cvtepi8_epi32(_mm_srli_si128(low, 8))));
+
+		carry = _mm256_set1_epi32(count + low_total);
+		_mm256_storeu_si256((__m256i *)(running_count + i + 16), _mm256_add_epi32(carry, _mm256_cvtepi8_epi32(high)));
+		_mm256_storeu_si256((__m256i *)(running_count + i + 24), _mm256_add_epi32(carry, _mm256_cvtepi8_epi32(_mm_srli_si128(high, 8))));
+
+		count += low_total + high_total;
+	}
+
+	return count_stream_scalar(codes + i, length - i, tags, count, running_count + i);
+}
+
+#endif
+
+/*
+ * Compute the running count after every card in a stream of card codes.
+ * If the requested implementation isn't available on this platform the
+ * scalar version is used.
+ *
+ * Parameters:
+ *	codes: Packed card codes in the order they were dealt.
+ *	tags: Count tags indexed by the rank bits of a card code. This is the
+ *		  tags table of one of the counting systems in CountingSystem.h.
+ *	initial_count: Running count before the first card.
+ *	running_count: Filled with the running count after each card. Only as
+ *				   many cards as fit in this span are counted.
+ *	level: Implementation to use.
+ *
+ * Return:
+ *	The running count after the last card.
+ */
+int count_stream(std::span<const uint8_t> codes, const signed char tags[16], int initial_count,
+	std::span<int> running_count, CountKernelLevel level) {
+	size_t length = std::min(codes.size(), running_count.size());
+
+	switch (level) {
+#ifdef COUNT_KERNEL_X86
+	case CountKernelLevel::AVX2:
+		return count_stream_avx2(codes.data(), length, tags, initial_count, running_count.data());
+	case CountKernelLevel::SSSE3:
+		return count_stream_ssse3(codes.data(), length, tags, initial_count, running_count.data());
+#endif
+	default:
+		return count_stream_scalar(codes.data(), length, tags, initial_count, running_count.data());
+	}
+}
+
+/*
+ * Compute the running count after every card using the fastest
+ * implementation the CPU supports. The CPU is only checked once.
+ * See the overload above for the parameters.
+ */
+int count_stream(std::span<const uint8_t> codes, const signed char tags[16], int initial_count,
+	std::span<int> running_count) {
+	static const CountKernelLevel level = detect_count_kernel_level();
+	return count_stream(codes, tags, initial_count, running_count, level);
+}
+
+/*
+ * Convert running counts into true counts (running count per deck left in
+ * the shoe). The loop has no dependencies between positions so the compiler
+ * vectorizes it.
+ *
+ * Parameters:
+ *	running_count: Running count after each card as returned by count_stream.
+ *	cards_in_shoe: Number of cards in the shoe before the first card was dealt.
+ *	true_count: Filled with the true count after each card. Once the shoe is
+ *				down to its last card the count is divided by that one card.
+ *
+ * Return:
+ *	Nothing
+ */
+void true_count_stream(std::span<const int> running_count, int cards_in_shoe, std::span<float> true_count) {
+	size_t length = std::min(running_count.size(), true_count.size());
+
+	for (size_t i = 0; i < length; i++) {
+		float cards_left = (float)std::max(cards_in_shoe - (int)i - 1, 1);
+		true_count[i] = (float)running_count[i] * 52.0f / cards_left;
+	}
+}
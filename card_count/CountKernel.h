@@ -0,0 +1,45 @@
+#pragma once
+
+#include "Deck.h"
+
+#include <cstdint>
+#include <span>
+
+/*
+ * Vectorized running count kernel for scoring recorded shoes. The kernel works
+ * on packed card codes (see Card::get_code) and looks the count tag of each
+ * card up with byte shuffles, sixteen or thirty two cards at a time.
+ *
+ * The best implementation for the CPU is picked at runtime. Tags are expected
+ * to be in the range [-7, 7] which covers every counting system in
+ * CountingSystem.h.
+ */
+
+enum class CountKernelLevel {
+	Scalar,
+	SSSE3,
+	AVX2
+};
+
+CountKernelLevel detect_count_kernel_level();
+
+int count_stream(std::span<const uint8_t> codes, const signed char tags[16], int initial_count,
+	std::span<int> running_count, CountKernelLevel level);
+int count_stream(std::span<const uint8_t> codes, const signed char tags[16], int initial_count,
+	std::span<int> running_count);
+
+void true_count_stream(std::span<const int> running_count, int cards_in_shoe, std::span<float> true_count);
+
+/*
+ * View a span of cards as their packed codes. Card is a single byte so this
+ * doesn't copy anything.
+ *
+ * Parameters:
+ *	cards: Cards to view.
+ *
+ * Return:
+ *	Span over the packed codes of the cards.
+ */
+inline std::span<const uint8_t> card_codes(std::span<const Card> cards) {
+	return std::span<const uint8_t>(reinterpret_cast<const uint8_t *>(cards.data()), cards.size());
+}
@@ -0,0 +1,182 @@
+#pragma once
+
+#include "Deck.h"
+
+#include <string_view>
+
+/*
+ * Card counting systems. Each system is a policy struct that describes the
+ * count value (tag) of every rank at compile time so code that is templated
+ * on the system gets the tags folded into its inner loop with no virtual
+ * calls or runtime table selection.
+ *
+ * The tags are indexed by the rank bits of a packed card code (the integer
+ * value of CardRank) so entries 0, 1 and 15 are unused and always zero.
+ * Systems with fractional tags store them multiplied by the scale value. For
+ * example Wong Halves has a scale of 2 so a tag of +1.5 is stored as 3.
+ *
+ * Every system provides:
+ *	name: Display name of the system.
+ *	scale: Value the tags have been multiplied by to make them integers.
+ *	balanced: True if the tags of a full deck sum to zero.
+ *	initial_count_per_deck/initial_count_offset: Used to compute the
+ *		initial running count of unbalanced systems.
+ *	tags: Per rank count values.
+ */
+
+struct HiLo {
+	static constexpr std::string_view name = "Hi-Lo";
+	static constexpr int scale = 1;
+	static constexpr bool balanced = true;
+	static constexpr int initial_count_per_deck = 0;
+	static constexpr int initial_count_offset = 0;
+	static constexpr signed char tags[16] = { 0, 0, 1, 1, 1, 1, 1, 0, 0, 0, -1, -1, -1, -1, -1, 0 };
+};
+
+struct KnockOut {
+	static constexpr std::string_view name = "KO";
+	static constexpr int scale = 1;
+	static constexpr bool balanced = false;
+	/* The KO initial running count is 4 - 4 * decks so the key count is the same for any shoe. */
+	static constexpr int initial_count_per_deck = -4;
+	static constexpr int initial_count_offset = 4;
+	static constexpr signed char tags[16] = { 0, 0, 1, 1, 1, 1, 1, 1, 0, 0, -1, -1, -1, -1, -1, 0 };
+};
+
+struct HiOptII {
+	static constexpr std::string_view name = "Hi-Opt II";
+	static constexpr int scale = 1;
+	static constexpr bool balanced = true;
+	static constexpr int initial_count_per_deck = 0;
+	static constexpr int initial_count_offset = 0;
+	static constexpr signed char tags[16] = { 0, 0, 1, 1, 2, 2, 1, 1, 0, 0, -2, -2, -2, -2, 0, 0 };
+};
+
+struct OmegaII {
+	static constexpr std::string_view name = "Omega II";
+	static constexpr int scale = 1;
+	static constexpr bool balanced = true;
+	static constexpr int initial_count_per_deck = 0;
+	static constexpr int initial_count_offset = 0;
+	static constexpr signed char tags[16] = { 0, 0, 1, 1, 2, 2, 2, 1, 0, -1, -2, -2, -2, -2, 0, 0 };
+};
+
+struct ZenCount {
+	static constexpr std::string_view name = "Zen";
+	static constexpr int scale = 1;
+	static constexpr bool balanced = true;
+	static constexpr int initial_count_per_deck = 0;
+	static constexpr int initial_count_offset = 0;
+	static constexpr signed char tags[16] = { 0, 0, 1, 1, 2, 2, 2, 1, 0, 0, -2, -2, -2, -2, -1, 0 };
+};
+
+struct WongHalves {
+	static constexpr std::string_view name = "Wong Halves";
+	static constexpr int scale = 2;
+	static constexpr bool balanced = true;
+	static constexpr int initial_count_per_deck = 0;
+	static constexpr int initial_count_offset = 0;
+	/* Tags are stored doubled. 2 -> +0.5, 5 -> +1.5, 9 -> -0.5 and so on. */
+	static constexpr signed char tags[16] = { 0, 0, 1, 2, 2, 3, 2, 1, 0, -1, -2, -2, -2, -2, -2, 0 };
+};
+
+/*
+ * Get the count value of a card under the given counting system. The value
+ * is in units of the system's scale.
+ *
+ * Parameters:
+ *	card: Card to get the count value of.
+ *
+ * Return:
+ *	Scaled count value of the card.
+ */
+template <typename System>
+constexpr int count_value(Card card) {
+	return System::tags[card.get_code() & CARD_RANK_MASK];
+}
+
+/*
+ * Get the running count a shoe starts at under the given counting system.
+ * This is zero for balanced systems.
+ *
+ * Parameters:
+ *	deck_count: Number of decks in the shoe.
+ *
+ * Return:
+ *	Scaled initial running count.
+ */
+template <typename System>
+constexpr int initial_running_count(int deck_count) {
+	return System::initial_count_offset + System::initial_count_per_deck * deck_count;
+}
+
+/*
+ * Identifiers for selecting a counting system at runtime, for example from
+ * the command line at startup.
+ */
+enum class CountingSystemId {
+	HiLo,
+	KnockOut,
+	HiOptII,
+	OmegaII,
+	Zen,
+	WongHalves,
+
+	CountingSystemId_END
+};
+
+/*
+ * Look up a counting system by name. Names are matched against the short
+ * identifiers "hilo", "ko", "hiopt2", "omega2", "zen" and "halves".
+ *
+ * Parameters:
+ *	name: Name of the counting system.
+ *	id: Set to the matching system if one is found.
+ *
+ * Return:
+ *	True if the name matched a counting system and false otherwise.
+ */
+inline bool counting_system_from_name(std::string_view name, CountingSystemId &id) {
+	const std::string_view names[] = { "hilo", "ko", "hiopt2", "omega2", "zen", "halves" };
+
+	for (int i = 0; i < (int)CountingSystemId::CountingSystemId_END; i++) {
+		if (name == names[i]) {
+			id = (CountingSystemId)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Call a function with the policy type of the selected counting system. This
+ * is the one place the runtime choice is turned into a compile time type so
+ * everything called from the function is specialized for that system.
+ *
+ * Parameters:
+ *	id: The counting system to use.
+ *	function: Generic callable that is passed a default constructed
+ *			  instance of the policy struct, for example
+ *			  [&](auto system) { run<decltype(system)>(); }
+ *
+ * Return:
+ *	Whatever the function returns.
+ */
+template <typename Function>
+auto with_counting_system(CountingSystemId id, Function &&function) {
+	switch (id) {
+	case CountingSystemId::KnockOut:
+		return function(KnockOut());
+	case CountingSystemId::HiOptII:
+		return function(HiOptII());
+	case CountingSystemId::OmegaII:
+		return function(OmegaII());
+	case CountingSystemId::Zen:
+		return function(ZenCount());
+	case CountingSystemId::WongHalves:
+		return function(WongHalves());
+	case CountingSystemId::HiLo:
+	default:
+		return function(HiLo());
+	}
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <chrono>
+
+/* Number of checks between looks at the clock. */
+#define DEADLINE_CHECK_INTERVAL 16
+
+/*
+ * A point in time for a long running search to give up at. Reading the
+ * clock costs more than a step of most searches, so it is only read every
+ * DEADLINE_CHECK_INTERVAL checks. Once the deadline has passed it stays
+ * passed. A default constructed deadline never passes.
+ */
+class Deadline
+{
+private:
+	std::chrono::steady_clock::time_point time;
+	bool enabled;
+	bool passed;
+	unsigned int checks_until_read;
+
+public:
+	Deadline();
+	Deadline(std::chrono::steady_clock::time_point time);
+
+	bool expired();
+	bool has_passed() const;
+};
+
+/*
+ * Constructor for a deadline that never passes.
+ */
+inline Deadline::Deadline() :
+	enabled(false), passed(false), checks_until_read(DEADLINE_CHECK_INTERVAL)
+{}
+
+/*
+ * Constructor for a deadline at a point in time.
+ *
+ * Parameters:
+ *	time: Time to give up at.
+ */
+inline Deadline::Deadline(std::chrono::steady_clock::time_point time) :
+	time(time), enabled(true), passed(false), checks_until_read(DEADLINE_CHECK_INTERVAL)
+{}
+
+/*
+ * Check if the deadline has passed, reading the clock every
+ * DEADLINE_CHECK_INTERVAL calls.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if the search should give up.
+ */
+inline bool Deadline::expired() {
+	if (!this->enabled || this->passed) {
+		return this->passed;
+	}
+
+	if (--this->checks_until_read == 0) {
+		this->checks_until_read = DEADLINE_CHECK_INTERVAL;
+		if (std::chrono::steady_clock::now() >= this->time) {
+			this->passed = true;
+		}
+	}
+	return this->passed;
+}
+
+/*
+ * Check if an earlier call to expired found the deadline had passed,
+ * without counting as a check.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if the deadline has been found to have passed.
+ */
+inline bool Deadline::has_passed() const {
+	return this->passed;
+}
@@ -0,0 +1,272 @@
+#include "DealerEngine.h"
+
+/*
+ * Add another set of counters into this one.
+ *
+ * Parameters:
+ *	other: Counters to add in.
+ *
+ * Return:
+ *	Nothing
+ */
+void DealerCacheCounters::merge(const DealerCacheCounters &other) {
+	this->lookups += other.lookups;
+	this->hits += other.hits;
+	this->evictions += other.evictions;
+}
+
+/*
+ * Get the fraction of lookups that were answered from the cache.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Hit rate between 0 and 1. Zero if there were no lookups.
+ */
+double DealerCacheCounters::hit_rate() const {
+	if (this->lookups == 0) {
+		return 0.0;
+	}
+	return (double)this->hits / (double)this->lookups;
+}
+
+/*
+ * Constructor for the DealerEngine class.
+ *
+ * Parameters:
+ *	rules: House rules the dealer plays by.
+ *	entries: Size of the cache. This is rounded up to a power of two.
+ */
+DealerEngine::DealerEngine(const RuleSet &rules, size_t entries) :
+	hits_soft_17(rules.dealer_hits_soft_17), clock(0), unfinished()
+{
+	size_t size = DEALER_CACHE_WAYS;
+	while (size < entries) {
+		size *= 2;
+	}
+
+	this->cache.resize(size);
+	this->mask = size - 1;
+	this->clear();
+}
+
+/*
+ * Deal the rest of the dealer's hand and add the chance of each final hand
+ * to the outcomes.
+ *
+ * Parameters:
+ *	shoe: Cards left. Cards are taken out and put back while recursing.
+ *	upcard: Numeric value of the dealer's upcard, 2 through 11.
+ *	total: Dealer's total so far.
+ *	soft_aces: Number of aces the dealer is counting as 11.
+ *	hole_card: True if the next card is the hole card.
+ *	probability: Chance of the dealer's hand so far.
+ *	outcomes: Outcomes to add to.
+ *
+ * Return:
+ *	Nothing
+ */
+void DealerEngine::deal(Composition &shoe, int upcard, int total, int soft_aces, bool hole_card,
+	double probability, DealerOutcomes &outcomes) const {
+	if (!hole_card) {
+		if (total > 21) {
+			outcomes.probability[DEALER_BUST] += probability;
+			return;
+		}
+		if (total >= 17 && !(total == 17 && soft_aces > 0 && this->hits_soft_17)) {
+			outcomes.probability[total - 17] += probability;
+			return;
+		}
+	}
+
+	double size = (double)shoe.size();
+	for (int value = 2; value <= 11; value++) {
+		int count = shoe.count(value);
+		if (count == 0) {
+			continue;
+		}
+		double card_probability = probability * count / size;
+
+		if (hole_card && upcard + value == 21) {
+			outcomes.probability[DEALER_BLACKJACK] += card_probability;
+			continue;
+		}
+
+		int next_total = total + value, next_soft_aces = soft_aces + (value == 11 ? 1 : 0);
+		while (next_total > 21 && next_soft_aces > 0) {
+			next_total -= 10;
+			next_soft_aces--;
+		}
+
+		shoe.remove(value);
+		this->deal(shoe, upcard, next_total, next_soft_aces, false, card_probability, outcomes);
+		shoe.add(value);
+	}
+}
+
+/*
+ * Work out the chance of each final dealer hand without using the cache.
+ *
+ * Parameters:
+ *	shoe: Cards left, not counting the upcard. The composition is used as
+ *		  scratch space while dealing but is left as it was.
+ *	upcard: Numeric value of the dealer's upcard, 2 through 11.
+ *
+ * Return:
+ *	Chances of each final dealer hand, including a blackjack.
+ */
+DealerOutcomes DealerEngine::compute(Composition &shoe, int upcard) const {
+	DealerOutcomes outcomes = {};
+	this->deal(shoe, upcard, upcard, upcard == 11 ? 1 : 0, true, 1.0, outcomes);
+	return outcomes;
+}
+
+/*
+ * Get the chance of each final dealer hand from a partly dealt hand, from
+ * the cache if it has been worked out before. Hands that are already done
+ * aren't cached since they take no work.
+ *
+ * Parameters:
+ *	shoe: Cards left. Cards are taken out and put back while recursing.
+ *	total: Dealer's total so far.
+ *	soft_aces: Number of aces the dealer is counting as 11.
+ *	hole_card: True if the next card is the hole card.
+ *	deadline: Optional deadline to give up at.
+ *
+ * Return:
+ *	Chances of each final dealer hand from this point. The reference is only
+ *	good until the next lookup since the entry may be replaced. If the
+ *	deadline passes the outcomes are meaningless and nothing is cached.
+ */
+const DealerOutcomes &DealerEngine::lookup(Composition &shoe, int total, int soft_aces, bool hole_card,
+	Deadline *deadline) {
+	/* Before the hole card the total is just the upcard so the total and flags describe the hand. */
+	int hand = (total << 2) | (soft_aces > 0 ? 2 : 0) | (hole_card ? 1 : 0);
+	uint64_t key = shoe.key();
+	size_t home = (size_t)((shoe.hash() ^ ((uint64_t)hand * 0x9E3779B97F4A7C15ULL)) & this->mask);
+
+	this->cache_counters.lookups++;
+	this->clock++;
+
+	for (size_t i = 0; i < DEALER_CACHE_WAYS; i++) {
+		CacheEntry &entry = this->cache[(home + i) & this->mask];
+		if (entry.key == key && entry.hand == hand) {
+			this->cache_counters.hits++;
+			entry.last_used = this->clock;
+			return entry.outcomes;
+		}
+	}
+
+	if (deadline != nullptr && deadline->expired()) {
+		return this->unfinished;
+	}
+
+	DealerOutcomes outcomes = {};
+	double size = (double)shoe.size();
+	for (int value = 2; value <= 11; value++) {
+		int count = shoe.count(value);
+		if (count == 0) {
+			continue;
+		}
+		double probability = count / size;
+
+		if (hole_card && total + value == 21) {
+			outcomes.probability[DEALER_BLACKJACK] += probability;
+			continue;
+		}
+
+		int next_total = total + value, next_soft_aces = soft_aces + (value == 11 ? 1 : 0);
+		while (next_total > 21 && next_soft_aces > 0) {
+			next_total -= 10;
+			next_soft_aces--;
+		}
+
+		if (next_total > 21) {
+			outcomes.probability[DEALER_BUST] += probability;
+		}
+		else if (next_total >= 17 && !(next_total == 17 && next_soft_aces > 0 && this->hits_soft_17)) {
+			outcomes.probability[next_total - 17] += probability;
+		}
+		else {
+			shoe.remove(value);
+			const DealerOutcomes &next = this->lookup(shoe, next_total, next_soft_aces, false, deadline);
+			for (int i = 0; i < DEALER_OUTCOMES; i++) {
+				outcomes.probability[i] += probability * next.probability[i];
+			}
+			shoe.add(value);
+		}
+	}
+
+	if (deadline != nullptr && deadline->has_passed()) {
+		return this->unfinished;
+	}
+
+	/* The victim is picked after recursing since the recursion fills in slots of its own. */
+	CacheEntry *victim = &this->cache[home];
+	for (size_t i = 1; i < DEALER_CACHE_WAYS; i++) {
+		CacheEntry &entry = this->cache[(home + i) & this->mask];
+		if (entry.last_used < victim->last_used) {
+			victim = &entry;
+		}
+	}
+
+	if (victim->hand != 0) {
+		this->cache_counters.evictions++;
+	}
+	victim->key = key;
+	victim->hand = hand;
+	victim->last_used = this->clock;
+	victim->outcomes = outcomes;
+
+	return victim->outcomes;
+}
+
+/*
+ * Get the chance of each final dealer hand, from the cache if it has been
+ * worked out before.
+ *
+ * Parameters:
+ *	shoe: Cards left, not counting the upcard. The composition is used as
+ *		  scratch space while dealing but is left as it was.
+ *	upcard: Numeric value of the dealer's upcard, 2 through 11.
+ *	deadline: Optional deadline to give up at.
+ *
+ * Return:
+ *	Chances of each final dealer hand, including a blackjack. The reference
+ *	is only good until the next call since the entry may be replaced. If the
+ *	deadline passes the outcomes are meaningless.
+ */
+const DealerOutcomes &DealerEngine::outcomes(Composition &shoe, int upcard, Deadline *deadline) {
+	return this->lookup(shoe, upcard, upcard == 11 ? 1 : 0, true, deadline);
+}
+
+/*
+ * Empty the cache. The counters are kept.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Nothing
+ */
+void DealerEngine::clear() {
+	for (CacheEntry &entry : this->cache) {
+		entry.key = 0;
+		entry.hand = 0;
+		entry.last_used = 0;
+	}
+}
+
+/*
+ * Get the cache counters.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Lookups, hits and evictions since the engine was made.
+ */
+const DealerCacheCounters &DealerEngine::counters() const {
+	return this->cache_counters;
+}
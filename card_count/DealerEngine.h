@@ -0,0 +1,84 @@
+#pragma once
+
+#include "Composition.h"
+#include "RuleSet.h"
+#include "Deadline.h"
+
+#include <cstdint>
+#include <vector>
+
+/* Final dealer hands: 17 through 21 are stored at total - 17, followed by bust and blackjack. */
+#define DEALER_OUTCOMES 7
+#define DEALER_BUST 5
+#define DEALER_BLACKJACK 6
+
+/* Number of neighbouring slots a cache entry can be stored in. */
+#define DEALER_CACHE_WAYS 8
+/* Default number of cache entries. */
+#define DEALER_CACHE_DEFAULT_ENTRIES (1 << 17)
+
+/*
+ * Chance of each final dealer hand for one upcard and composition.
+ */
+struct DealerOutcomes {
+	double probability[DEALER_OUTCOMES];
+};
+
+/*
+ * Counters for how well the dealer outcome cache is working.
+ */
+struct DealerCacheCounters {
+	uint64_t lookups = 0;
+	uint64_t hits = 0;
+	uint64_t evictions = 0;
+
+	void merge(const DealerCacheCounters &other);
+	double hit_rate() const;
+};
+
+/*
+ * Works out the chance of each final dealer hand given the upcard and the
+ * composition of the cards left, by dealing out every possible dealer hand.
+ * Results are kept in a fixed size open addressing cache indexed by the
+ * composition's Zobrist hash, which is updated as cards are taken out, so a
+ * repeated lookup costs a hash table probe instead of the full draw out.
+ * Every partly dealt dealer hand is cached as well as the starting one.
+ * Different player hands lead to the same dealer hands with the same cards
+ * left all the time, for example the player drawing a 3 and the dealer a 5
+ * or the other way around, so most of a new draw out is found in the cache.
+ * Each entry can live in one of DEALER_CACHE_WAYS slots after its home slot
+ * and when they are all full the least recently used one is replaced.
+ *
+ * An engine is not thread safe. Give every thread its own engine.
+ */
+class DealerEngine
+{
+private:
+	struct CacheEntry {
+		/* Exact composition key and dealer hand, the hand is zero for an empty slot. */
+		uint64_t key;
+		int hand;
+		uint64_t last_used;
+		DealerOutcomes outcomes;
+	};
+
+	bool hits_soft_17;
+	std::vector<CacheEntry> cache;
+	size_t mask;
+	uint64_t clock;
+	DealerCacheCounters cache_counters;
+	/* Returned in place of a cache entry when a lookup gives up at its deadline. */
+	DealerOutcomes unfinished;
+
+	void deal(Composition &shoe, int upcard, int total, int soft_aces, bool hole_card,
+		double probability, DealerOutcomes &outcomes) const;
+	const DealerOutcomes &lookup(Composition &shoe, int total, int soft_aces, bool hole_card, Deadline *deadline);
+
+public:
+	DealerEngine(const RuleSet &rules, size_t entries = DEALER_CACHE_DEFAULT_ENTRIES);
+
+	DealerOutcomes compute(Composition &shoe, int upcard) const;
+	const DealerOutcomes &outcomes(Composition &shoe, int upcard, Deadline *deadline = nullptr);
+	void clear();
+	const DealerCacheCounters &counters() const;
+};
@@ -1,4 +1,5 @@
 #include <string>
+#include <random>
 
 #include "Deck.h"
 
@@ -6,8 +7,7 @@
  * Default constructor for the Card class.
  */
 Card::Card() :
-	rank(CardRank::CardRank_END), suit(CardSuit::CardSuit_END),
-	count_value(0), numeric_value(0), valid(false)
+	code(CARD_INVALID_BIT | ((int)CardSuit::CardSuit_END << CARD_SUIT_SHIFT) | (int)CardRank::CardRank_END)
 {}
 
 /*
@@ -20,41 +20,35 @@ Card::Card() :
  *	in a good state.
  */
 Card::Card(CardRank rank, CardSuit suit, bool valid = true) :
-	rank(rank), suit(suit), valid(valid)
-{
-	/* Set the numeric value based on the rank. */
-	if (this->rank == CardRank::Ace) {
-		this->numeric_value = 11;
-	}
-	else if (this->rank == CardRank::Jack ||
-		this->rank == CardRank::Queen ||
-		this->rank == CardRank::King) {
-		this->numeric_value = 10;
-	}
-	else {
-		/* This is a similification we can make for number cards only. */
-		this->numeric_value = (char)this->rank;
-	}
+	code((uint8_t)(((int)suit << CARD_SUIT_SHIFT) | (int)rank | (valid ? 0 : CARD_INVALID_BIT)))
+{}
 
-	/* Set the count value. */
-	if (this->rank == CardRank::Ten ||
-		this->rank == CardRank::Jack ||
-		this->rank == CardRank::Queen ||
-		this->rank == CardRank::King ||
-		this->rank == CardRank::Ace) {
-		this->count_value = -1;
-	}
-	else if (this->rank == CardRank::Two ||
-		this->rank == CardRank::Three ||
-		this->rank == CardRank::Four ||
-		this->rank == CardRank::Five ||
-		this->rank == CardRank::Six) {
-		this->count_value = 1;
-	}
-	/* This condition handles 7, 8, 9.*/
-	else {
-		this->count_value = 0;
-	}
+/*
+ * Create a card from its packed single byte representation.
+ *
+ * Parameters:
+ *	code: Packed card as returned by get_code.
+ *
+ * Return:
+ *	Card object wrapping the given code.
+ */
+Card Card::from_code(uint8_t code) {
+	Card card;
+	card.code = code;
+	return card;
+}
+
+/*
+ * Get the packed single byte representation of the card.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	The card packed into an 8 bit value.
+ */
+uint8_t Card::get_code() const {
+	return this->code;
 }
 
 /*
@@ -67,7 +61,7 @@ Card::Card(CardRank rank, CardSuit suit, bool valid = true) :
  *	The numeric value of the card as an 8 bit value.
  */
 char Card::get_numeric_value() const {
-	return this->numeric_value;
+	return card_value_table.numeric_value[this->code];
 }
 
 /*
@@ -80,7 +74,7 @@ char Card::get_numeric_value() const {
  *	Count value of the card as an 8 bit value.
  */
 char Card::get_count_value() const {
-	return this->count_value;
+	return card_value_table.count_value[this->code];
 }
 
 /*
@@ -93,7 +87,7 @@ char Card::get_count_value() const {
  *	The rank of the card as a CardRank enum.
  */
 CardRank Card::get_card_rank() const {
-	return this->rank;
+	return (CardRank)(this->code & CARD_RANK_MASK);
 }
 
 /*
@@ -106,9 +100,48 @@ CardRank Card::get_card_rank() const {
  *	The suit of the card as a CardSuit enum.
  */
 CardSuit Card::get_card_suit() const {
-	return this->suit;
+	return (CardSuit)((this->code >> CARD_SUIT_SHIFT) & CARD_SUIT_MASK);
 }
 
+/*
+ * Table of the ascii names of every possible packed card code. It is filled
+ * in at compile time so looking up a name never allocates. Codes that don't
+ * map to a real rank and suit are named "ERROR".
+ */
+struct CardNameTable {
+	char names[256][6];
+	unsigned char lengths[256];
+
+	constexpr CardNameTable() : names(), lengths() {
+		const char *rank_names[] = { "2", "3", "4", "5", "6", "7", "8", "9", "10", "J", "Q", "K", "A" };
+		const char suit_names[] = { 'C', 'D', 'H', 'S' };
+
+		for (int code = 0; code < 256; code++) {
+			int rank = code & CARD_RANK_MASK;
+			int suit = (code >> CARD_SUIT_SHIFT) & CARD_SUIT_MASK;
+			const char *name = "ERROR";
+			int length = 0;
+
+			bool known = rank >= (int)CardRank::Two && rank < (int)CardRank::CardRank_END &&
+				suit < (int)CardSuit::CardSuit_END;
+
+			if (known) {
+				name = rank_names[rank - (int)CardRank::Two];
+			}
+			while (name[length] != '\0') {
+				this->names[code][length] = name[length];
+				length++;
+			}
+			if (known) {
+				this->names[code][length++] = suit_names[suit];
+			}
+			this->lengths[code] = (unsigned char)length;
+		}
+	}
+};
+
+static constexpr CardNameTable card_name_table;
+
 /*
  * Return the rank and suit of the card represented
  * as an ascii string.
@@ -119,76 +152,76 @@ CardSuit Card::get_card_suit() const {
  * Return:
  *	String representation of the rank/suit of the card.
  *	For exmaple the 5 of clubs would be represented as
- *	"5C".
+ *	"5C". The returned view points into a static table
+ *	so it is always valid.
  */
-std::string Card::ascii() const {
-	std::string str;
+std::string_view Card::ascii() const {
+	return std::string_view(card_name_table.names[this->code], card_name_table.lengths[this->code]);
+}
 
-	switch (this->rank) {
-	case CardRank::Two:
-		str += "2";
-		break;
-	case CardRank::Three:
-		str += "3";
-		break;
-	case CardRank::Four:
-		str += "4";
-		break;
-	case CardRank::Five:
-		str += "5";
-		break;
-	case CardRank::Six:
-		str += "6";
-		break;
-	case CardRank::Seven:
-		str += "7";
-		break;
-	case CardRank::Eight:
-		str += "8";
-		break;
-	case CardRank::Nine:
-		str += "9";
+/*
+ * Parse a card from its ascii representation. This is the inverse of the
+ * ascii method so "5C" is parsed as the 5 of clubs.
+ *
+ * Parameters:
+ *	text: Ascii representation of the card.
+ *
+ * Return:
+ *	The parsed card. If the text isn't a valid card name an invalid card is
+ *	returned so the result should be checked using the is_valid method.
+ */
+Card Card::from_ascii(std::string_view text) {
+	CardRank rank;
+	size_t suit_position = 1;
+
+	if (text.size() < 2) {
+		return Card();
+	}
+
+	switch (text[0]) {
+	case '2': case '3': case '4': case '5': case '6': case '7': case '8': case '9':
+		rank = (CardRank)(text[0] - '0');
 		break;
-	case CardRank::Ten:
-		str += "10";
+	case '1':
+		/* The only rank starting with a 1 is the ten. */
+		if (text[1] != '0') {
+			return Card();
+		}
+		rank = CardRank::Ten;
+		suit_position = 2;
 		break;
-	case CardRank::Jack:
-		str += "J";
+	case 'J':
+		rank = CardRank::Jack;
 		break;
-	case CardRank::Queen:
-		str += "Q";
+	case 'Q':
+		rank = CardRank::Queen;
 		break;
-	case CardRank::King:
-		str += "K";
+	case 'K':
+		rank = CardRank::King;
 		break;
-	case CardRank::Ace:
-		str += "A";
+	case 'A':
+		rank = CardRank::Ace;
 		break;
-
 	default:
-		str += "ERROR";
+		return Card();
 	}
 
-	switch (this->suit) {
-	case CardSuit::Club:
-		str += "C";
-		break;
-	case CardSuit::Diamond:
-		str += "D";
-		break;
-	case CardSuit::Heart:
-		str += "H";
-		break;
-	case CardSuit::Spade:
-		str += "S";
-		break;
+	if (text.size() != suit_position + 1) {
+		return Card();
+	}
 
+	switch (text[suit_position]) {
+	case 'C':
+		return Card(rank, CardSuit::Club);
+	case 'D':
+		return Card(rank, CardSuit::Diamond);
+	case 'H':
+		return Card(rank, CardSuit::Heart);
+	case 'S':
+		return Card(rank, CardSuit::Spade);
 	default:
-		str += "ERROR";
+		return Card();
 	}
-
-	return str;
-
 }
 
 /*
@@ -202,20 +235,30 @@ std::string Card::ascii() const {
  *	false otherwise.
  */
 bool Card::is_valid() const {
-	return this->valid;
+	return (this->code & CARD_INVALID_BIT) == 0;
 }
 
 /*
  * Constructor for the Deck class.
  * 
  * Parameters:
- *	None
+ *	deck_count: Number of standard 52 card decks to build the deck from.
  */
-Deck::Deck() {
-	/* Create one instance of each card. */
-	for (int suit = (int)CardSuit::Club; suit < (int)CardSuit::CardSuit_END; suit++) {
-		for (int rank = (int)CardRank::Two; rank < (int)CardRank::CardRank_END; rank++) {
-			this->unshuffled.push_back(Card((CardRank)rank, (CardSuit)suit));
+Deck::Deck(int deck_count) :
+	discarded(0), dealt(0), engine_seed(std::random_device()()), engine(engine_seed)
+{
+	/*
+	 * Reserve the full buffer up front. This is the only allocation the
+	 * deck ever does.
+	 */
+	this->cards.reserve(52 * deck_count);
+
+	/* Create one instance of each card for every deck. */
+	for (int deck = 0; deck < deck_count; deck++) {
+		for (int suit = (int)CardSuit::Club; suit < (int)CardSuit::CardSuit_END; suit++) {
+			for (int rank = (int)CardRank::Two; rank < (int)CardRank::CardRank_END; rank++) {
+				this->cards.push_back(Card((CardRank)rank, (CardSuit)suit));
+			}
 		}
 	}
 
@@ -224,29 +267,97 @@ Deck::Deck() {
 }
 
 /*
- * Helper function to huffle the deck.
- * 
+ * Re-seed the random engine used by the shuffle method. The engine is
+ * keyed by the seed and the shoe index so every (seed, shoe index) pair
+ * gets its own independent stream. Using the same pair will reproduce the
+ * same sequence of shuffles.
+ *
  * Parameters:
- *	None
- * 
+ *	seed: Seed value for the engine.
+ *	shoe_index: Index of the random stream to use.
+ *
  * Return:
  *	Nothing
  */
-void Deck::shuffle() {
-	/* Empty the shuffled deck before starting. */
-	while (!this->shuffled.empty()) {
-		this->unshuffled.push_back(this->shuffled.back());
-		this->shuffled.pop_back();
+void Deck::seed(uint64_t seed, uint64_t shoe_index) {
+	this->engine_seed = seed;
+	this->engine.seed(seed, shoe_index);
+}
+
+/*
+ * Start a new shoe from scratch. Every card, including any still in play,
+ * is returned to the deck in factory order and the deck is then shuffled
+ * with the random stream for the given shoe index. The resulting order only
+ * depends on the seed and the shoe index so any shoe of a long run can be
+ * regenerated on its own, on any thread, without replaying the shoes that
+ * came before it.
+ *
+ * The antithetic shoe of a shuffle is the same shuffle with its low and high
+ * cards swapped by mirror_counts. Pairing a shoe with its antithetic shoe
+ * cancels out much of the luck of the count.
+ *
+ * Parameters:
+ *	shoe_index: Index of the shoe to start.
+ *	antithetic: True to deal the antithetic shoe of the shuffle.
+ *
+ * Return:
+ *	Nothing
+ */
+void Deck::start_shoe(uint64_t shoe_index, bool antithetic) {
+	/* Put every card back in factory order. This overwrites the buffer in place. */
+	size_t i = 0;
+	while (i < this->cards.size()) {
+		for (int suit = (int)CardSuit::Club; suit < (int)CardSuit::CardSuit_END; suit++) {
+			for (int rank = (int)CardRank::Two; rank < (int)CardRank::CardRank_END; rank++) {
+				this->cards[i++] = Card((CardRank)rank, (CardSuit)suit);
+			}
+		}
 	}
+	this->discarded = 0;
+	this->dealt = 0;
 
-	/* Randomly move cards from the unshffled deck to the shuffled deck. */
-	while (!this->unshuffled.empty()) {
-		int index = rand() % unshuffled.size();
-		this->shuffled.push_back(this->unshuffled.at(index));
-		this->unshuffled.erase(this->unshuffled.begin() + index);
+	this->engine.seed(this->engine_seed, shoe_index);
+	this->shuffle();
+	if (antithetic) {
+		this->mirror_counts();
+	}
+}
+
+/*
+ * Swap the ranks of the low cards and the high cards left in the shuffled
+ * deck: twos become aces, threes kings, fours queens, fives jacks and sixes
+ * tens, and the other way around. Every rank has as many cards as its mirror
+ * so the deck keeps its make up, while every Hi-Lo running count of the deck
+ * is negated. Doing this to a uniformly shuffled deck gives another uniformly
+ * shuffled deck since it is its own inverse.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Nothing
+ */
+void Deck::mirror_counts() {
+	for (size_t i = this->dealt; i < this->cards.size(); i++) {
+		Card card = this->cards[i];
+		int rank = (int)card.get_card_rank();
+		if (card.get_count_value() != 0) {
+			this->cards[i] = Card((CardRank)((int)CardRank::Two + (int)CardRank::Ace - rank), card.get_card_suit());
+		}
 	}
+}
 
-	return;
+/*
+ * Helper function to shuffle the deck using the deck's own random engine.
+ * 
+ * Parameters:
+ *	None
+ * 
+ * Return:
+ *	Nothing
+ */
+void Deck::shuffle() {
+	this->shuffle(this->engine);
 }
 
 /*
@@ -263,17 +374,40 @@ void Deck::shuffle() {
  */
 Card Deck::draw() {
 
-	if (this->shuffled.empty()) {
+	if (this->dealt == this->cards.size()) {
 		return Card();
 	}
-	Card card = this->shuffled.back();
-	this->shuffled.pop_back();
 
-	return card;
+	return this->cards[this->dealt++];
+}
+
+/*
+ * Remove the next card with a given value from the shuffled deck, for
+ * example to take the cards of a hand being studied out of the shoe. The
+ * card is swapped with the next card to be drawn and then drawn, so the
+ * rest of the deck stays in random order.
+ *
+ * Parameters:
+ *	numeric_value: Value of the card to draw, 2 through 11 for an ace.
+ *
+ * Return:
+ *	The drawn card, or an invalid card if no card with the value is left
+ *	in the shuffled deck.
+ */
+Card Deck::draw_value(int numeric_value) {
+	for (size_t i = this->dealt; i < this->cards.size(); i++) {
+		if (this->cards[i].get_numeric_value() == numeric_value) {
+			std::swap(this->cards[i], this->cards[this->dealt]);
+			return this->cards[this->dealt++];
+		}
+	}
+	return Card();
 }
 
 /*
- * Places a card into the unshuffled deck.
+ * Places a card into the unshuffled deck. Only cards that have been
+ * drawn can be discarded. If every drawn card has already been discarded
+ * the card is ignored.
  * 
  * Parameters:
  *	card: Card object to place in the unshuffled deck.
@@ -282,7 +416,49 @@ Card Deck::draw() {
  *	Nothing
  */
 void Deck::discard(Card card) {
-	this->unshuffled.push_back(card);
+	if (this->discarded < this->dealt) {
+		this->cards[this->discarded++] = card;
+	}
+}
+
+/*
+ * Draw a batch of cards from the shuffled deck in one call. Cards are
+ * copied straight out of the deck's buffer into the caller's buffer.
+ *
+ * Parameters:
+ *	out: Buffer to fill with drawn cards. Up to out.size() cards are drawn.
+ *
+ * Return:
+ *	Number of cards actually drawn. This is less than out.size() if the
+ *	shuffled deck ran out, in which case the rest of out is left untouched.
+ */
+size_t Deck::draw_n(std::span<Card> out) {
+	size_t count = std::min(out.size(), this->cards.size() - this->dealt);
+
+	std::copy_n(this->cards.begin() + this->dealt, count, out.begin());
+	this->dealt += count;
+
+	return count;
+}
+
+/*
+ * Place a batch of cards into the unshuffled deck in one call. As with
+ * discard only cards that have been drawn can be discarded.
+ *
+ * Parameters:
+ *	in: Cards to place in the unshuffled deck.
+ *
+ * Return:
+ *	Number of cards actually discarded. Any cards past the number of cards
+ *	currently in play are ignored.
+ */
+size_t Deck::discard_n(std::span<const Card> in) {
+	size_t count = std::min(in.size(), this->dealt - this->discarded);
+
+	std::copy_n(in.begin(), count, this->cards.begin() + this->discarded);
+	this->discarded += count;
+
+	return count;
 }
 
 /*
@@ -296,7 +472,7 @@ void Deck::discard(Card card) {
  *	Number of cards in the shuffled deck as an integer.
  */
 int Deck::shuffeled_card_count() {
-	return this->shuffled.size();
+	return (int)(this->cards.size() - this->dealt);
 }
 
 /*
@@ -310,5 +486,81 @@ int Deck::shuffeled_card_count() {
  *	Number of cards in the unshuffled deck as an integer.
  */
 int Deck::unshuffeled_card_count() {
-	return this->unshuffled.size();
+	return (int)this->discarded;
+}
+
+/*
+ * Returns the number of standard decks the deck was built from.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of decks as an integer.
+ */
+int Deck::deck_count() {
+	return (int)(this->cards.size() / 52);
+}
+
+/*
+ * Get a view of the cards left in the shuffled deck in the order they will
+ * be drawn. The view is invalidated by the next shuffle.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Span over the cards left in the shuffled deck.
+ */
+std::span<const Card> Deck::remaining_cards() {
+	return std::span<const Card>(this->cards.data() + this->dealt, this->cards.size() - this->dealt);
+}
+
+/*
+ * Constructor for the Shoe class.
+ *
+ * Parameters:
+ *	deck_count: Number of standard 52 card decks in the shoe.
+ *	penetration: Fraction of the shoe that is dealt before the cut card
+ *				 comes out. Casinos typically use somewhere between 0.65
+ *				 and 0.85. The value is clamped to the range [0, 1].
+ */
+Shoe::Shoe(int deck_count, float penetration) :
+	Deck(deck_count)
+{
+	if (penetration < 0.0f) {
+		penetration = 0.0f;
+	}
+	else if (penetration > 1.0f) {
+		penetration = 1.0f;
+	}
+	this->cut_card_position = (size_t)(penetration * this->cards.size());
+}
+
+/*
+ * Check if the cut card has come out of the shoe. Once this returns true
+ * the shoe should be shuffled after the current round is finished.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if the cut card has been reached and false otherwise.
+ */
+bool Shoe::cut_card_reached() {
+	return this->dealt >= this->cut_card_position;
+}
+
+/*
+ * Get the penetration of the shoe, that is the fraction of the shoe that is
+ * dealt before the cut card comes out.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Penetration as a fraction between 0 and 1.
+ */
+float Shoe::penetration() {
+	return (float)this->cut_card_position / (float)this->cards.size();
 }
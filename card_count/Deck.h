@@ -2,6 +2,13 @@
 
 #include <vector>
 #include <string>
+#include <string_view>
+#include <utility>
+#include <algorithm>
+#include <cstdint>
+#include <span>
+
+#include "Random.h"
 
 /*
  * NOTE: The order here matters since we depend on in when generating a deck.
@@ -37,40 +44,164 @@ enum class CardSuit {
 };
 
 
+/*
+ * Helpers for computing the per-rank card values. These are only used at
+ * compile time to fill in the lookup tables below.
+ */
+constexpr signed char rank_numeric_value(int rank) {
+	/* Number cards can be converted directly. Face cards are all worth 10 and aces 11. */
+	return (rank >= (int)CardRank::Two && rank <= (int)CardRank::Ten) ? (signed char)rank :
+		(rank >= (int)CardRank::Jack && rank <= (int)CardRank::King) ? 10 :
+		(rank == (int)CardRank::Ace) ? 11 : 0;
+}
+
+constexpr signed char rank_count_value(int rank) {
+	/* [2-6] -> +1, [7-9] -> 0, [10-A] -> -1 */
+	return (rank >= (int)CardRank::Two && rank <= (int)CardRank::Six) ? 1 :
+		(rank >= (int)CardRank::Ten && rank <= (int)CardRank::Ace) ? -1 : 0;
+}
+
+/*
+ * A card is packed into a single byte laid out as follows:
+ *
+ *	bits 0-3	Rank as the integer value of CardRank.
+ *	bits 4-6	Suit as the integer value of CardSuit.
+ *	bit 7		Set if the card is invalid.
+ *
+ * The card values are looked up in tables indexed by the full byte so
+ * reading them is a single load.
+ */
+#define CARD_RANK_MASK		0x0F
+#define CARD_SUIT_SHIFT		4
+#define CARD_SUIT_MASK		0x07
+#define CARD_INVALID_BIT	0x80
+
+struct CardValueTable {
+	signed char numeric_value[256];
+	signed char count_value[256];
+
+	constexpr CardValueTable() : numeric_value(), count_value() {
+		for (int code = 0; code < 256; code++) {
+			this->numeric_value[code] = rank_numeric_value(code & CARD_RANK_MASK);
+			this->count_value[code] = rank_count_value(code & CARD_RANK_MASK);
+		}
+	}
+};
+
+constexpr CardValueTable card_value_table;
+
 /*
  * Class for representing playing cards from a standard 52 card deck.
  */
 class Card {
-	//SDL_Texture* texture_ptr;
-	CardRank rank;
-	CardSuit suit;
-	char count_value;
-	char numeric_value;
-	bool valid;
+	uint8_t code;
 
 public:
 	Card();
 	Card(CardRank value, CardSuit suit, bool valid);
+	static Card from_code(uint8_t code);
+	uint8_t get_code() const;
 	char get_numeric_value() const;
 	char get_count_value() const;
 	CardRank get_card_rank() const;
 	CardSuit get_card_suit() const;
-	std::string ascii() const;
+	std::string_view ascii() const;
+	static Card from_ascii(std::string_view text);
 	bool is_valid() const;
 };
 
+static_assert(sizeof(Card) == 1, "Card is expected to pack into a single byte");
+
 /*
- * Class for representing a deck of playing cards.
+ * Class for representing a deck of playing cards. A deck may be built from
+ * several standard 52 card decks. All cards live in one buffer that is
+ * allocated once in the constructor and is split into three regions:
+ *
+ *	[0, discarded)			Discard pile (the unshuffled deck).
+ *	[discarded, dealt)		Cards that have been drawn but not discarded yet.
+ *	[dealt, cards.size())	Cards left in the shuffled deck.
+ *
+ * Drawing, discarding and shuffling only move cards around inside this
+ * buffer so they never allocate.
  */
 class Deck
 {
-private:
-	std::vector<Card> unshuffled, shuffled;
+protected:
+	std::vector<Card> cards;
+	size_t discarded, dealt;
+	uint64_t engine_seed;
+	Philox4x32 engine;
 public:
-	Deck();
+	Deck(int deck_count = 1);
+	void seed(uint64_t seed, uint64_t shoe_index = 0);
+	void start_shoe(uint64_t shoe_index, bool antithetic = false);
+	void mirror_counts();
 	void shuffle();
+	template <typename Engine>
+	void shuffle(Engine &engine);
 	Card draw();
+	Card draw_value(int numeric_value);
 	void discard(Card card);
+	size_t draw_n(std::span<Card> out);
+	size_t discard_n(std::span<const Card> in);
 	int shuffeled_card_count();
 	int unshuffeled_card_count();
+	int deck_count();
+	std::span<const Card> remaining_cards();
 };
+
+/*
+ * Class for representing a multi-deck shoe with a cut card. The cut card is
+ * placed at a fixed penetration into the shoe and once it has been reached
+ * the shoe should be reshuffled before the next round. Cards can still be
+ * drawn past the cut card so the current round can be finished.
+ */
+class Shoe : public Deck
+{
+private:
+	size_t cut_card_position;
+public:
+	Shoe(int deck_count, float penetration);
+	bool cut_card_reached();
+	float penetration();
+};
+
+/*
+ * Shuffle the deck using the given random engine. The discard pile is merged
+ * back into the shuffled deck and a Fisher-Yates shuffle is done in place.
+ * Cards that have been drawn but not discarded yet are still in play so they
+ * are left out of the shuffle. This runs in linear time and never allocates.
+ *
+ * Parameters:
+ *	engine: Random engine to draw from. Any engine that satisfies the standard
+ *			UniformRandomBitGenerator requirements can be used, for example
+ *			Xoshiro256StarStar, Pcg64 or std::mt19937_64. Engines that give
+ *			fewer than 64 bits per call, such as std::minstd_rand, are called
+ *			several times per card (see random_u64).
+ *
+ * Return:
+ *	Nothing
+ */
+template <typename Engine>
+void Deck::shuffle(Engine &engine) {
+	/*
+	 * Move the cards in play to the front of the buffer. Everything after
+	 * them (the discard pile and the undealt cards) gets shuffled.
+	 */
+	std::rotate(this->cards.begin(), this->cards.begin() + this->discarded,
+		this->cards.begin() + this->dealt);
+	size_t in_play = this->dealt - this->discarded;
+
+	/* Swap each position with a random position at or below it. */
+	for (size_t i = this->cards.size(); i > in_play + 1; i--) {
+		size_t j = in_play + (size_t)random_index(engine, i - in_play);
+		std::swap(this->cards[i - 1], this->cards[j]);
+	}
+
+	/*
+	 * The cards in play will be discarded into the slots they now occupy so
+	 * the discard pile starts over from the front of the buffer.
+	 */
+	this->discarded = 0;
+	this->dealt = in_play;
+}
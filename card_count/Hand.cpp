@@ -0,0 +1,152 @@
+#include "Hand.h"
+
+/*
+ * Constructor for the Hand class. Hands start out empty.
+ */
+Hand::Hand() :
+	total_value(0), soft_aces(0), card_count(0)
+{}
+
+/*
+ * Add a card to the hand. Aces are counted as 11 until that would bust the
+ * hand at which point they are counted as 1 instead.
+ *
+ * Parameters:
+ *	card: Card to add to the hand.
+ *
+ * Return:
+ *	Nothing
+ */
+void Hand::add(Card card) {
+	if (this->card_count == 0) {
+		this->first = card;
+	}
+	else if (this->card_count == 1) {
+		this->second = card;
+	}
+	this->card_count++;
+
+	this->total_value += card.get_numeric_value();
+	if (card.get_card_rank() == CardRank::Ace) {
+		this->soft_aces++;
+	}
+
+	while (this->total_value > 21 && this->soft_aces > 0) {
+		this->total_value -= 10;
+		this->soft_aces--;
+	}
+}
+
+/*
+ * Split a pair. The hand keeps its first card and the second card is
+ * returned so it can start a new hand.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	The second card of the hand.
+ */
+Card Hand::split() {
+	Card kept = this->first;
+	Card card = this->second;
+
+	*this = Hand();
+	this->add(kept);
+
+	return card;
+}
+
+/*
+ * Get the total of the hand.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Total of the hand with aces counted in the player's favour.
+ */
+int Hand::total() const {
+	return this->total_value;
+}
+
+/*
+ * Get the number of cards in the hand.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of cards in the hand.
+ */
+int Hand::size() const {
+	return this->card_count;
+}
+
+/*
+ * Check if the hand is soft, that is if it has an ace counted as 11.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if the hand is soft and false otherwise.
+ */
+bool Hand::is_soft() const {
+	return this->soft_aces > 0;
+}
+
+/*
+ * Check if the hand is a pair that could be split. Any two cards with the
+ * same value count as a pair so a jack and a king can be split.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if the hand is two cards of the same value.
+ */
+bool Hand::is_pair() const {
+	return this->card_count == 2 &&
+		this->first.get_numeric_value() == this->second.get_numeric_value();
+}
+
+/*
+ * Get the value of the cards making up a pair.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Numeric value of the first card in the hand. Aces are 11.
+ */
+int Hand::pair_value() const {
+	return this->first.get_numeric_value();
+}
+
+/*
+ * Check if the hand is a natural blackjack. Hands made by splitting should
+ * not be counted as blackjacks by the caller.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if the hand is two cards totalling 21.
+ */
+bool Hand::is_blackjack() const {
+	return this->card_count == 2 && this->total_value == 21;
+}
+
+/*
+ * Check if the hand has busted.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if the hand is over 21.
+ */
+bool Hand::is_bust() const {
+	return this->total_value > 21;
+}
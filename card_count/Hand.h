@@ -0,0 +1,29 @@
+#pragma once
+
+#include "Deck.h"
+
+/*
+ * Class for representing a blackjack hand. Only what is needed to play the
+ * hand is kept: the total, how many aces are still counted as 11 and the
+ * first two cards so the hand can be split.
+ */
+class Hand
+{
+private:
+	Card first, second;
+	unsigned char total_value;
+	unsigned char soft_aces;
+	unsigned char card_count;
+
+public:
+	Hand();
+	void add(Card card);
+	Card split();
+	int total() const;
+	int size() const;
+	bool is_soft() const;
+	bool is_pair() const;
+	int pair_value() const;
+	bool is_blackjack() const;
+	bool is_bust() const;
+};
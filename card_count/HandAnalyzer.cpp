@@ -0,0 +1,321 @@
+#include "HandAnalyzer.h"
+
+#include <algorithm>
+
+/*
+ * Add another hand's values into this one, for combining every two card hand
+ * with the same total into one row of the chart.
+ *
+ * Parameters:
+ *	other: Values to add.
+ *	weight: Chance of being dealt the other hand.
+ *
+ * Return:
+ *	Nothing
+ */
+void ActionValues::add(const ActionValues &other, double weight) {
+	this->stand += other.stand * weight;
+	this->hit += other.hit * weight;
+	this->double_down += other.double_down * weight;
+	this->surrender += other.surrender * weight;
+}
+
+/*
+ * Get the value of the best play on the hand other than splitting.
+ *
+ * Parameters:
+ *	rules: House rules in effect.
+ *
+ * Return:
+ *	The largest expected value of hitting, standing, doubling and, if it is
+ *	allowed, surrendering.
+ */
+double ActionValues::best_without_split(const RuleSet &rules) const {
+	double best = std::max(std::max(this->stand, this->hit), this->double_down);
+	if (rules.late_surrender) {
+		best = std::max(best, this->surrender);
+	}
+	return best;
+}
+
+/*
+ * Add a card to a hand total. Aces are counted as 11 until that would bust
+ * the hand, the same as Hand::add.
+ */
+static void add_value(int &total, int &soft_aces, int value) {
+	total += value;
+	if (value == 11) {
+		soft_aces++;
+	}
+	while (total > 21 && soft_aces > 0) {
+		total -= 10;
+		soft_aces--;
+	}
+}
+
+/*
+ * Constructor for the HandAnalyzer class.
+ *
+ * Parameters:
+ *	rules: House rules to play by.
+ *	dealer: Engine to get the dealer's outcomes from.
+ *	upcard: Numeric value of the dealer's upcard, 2 through 11.
+ */
+HandAnalyzer::HandAnalyzer(const RuleSet &rules, DealerEngine &dealer, int upcard) :
+	rules(rules), dealer(dealer), upcard(upcard)
+{}
+
+/*
+ * Set a time after which the analysis gives up.
+ *
+ * Parameters:
+ *	deadline: Time to give up at.
+ *
+ * Return:
+ *	Nothing
+ */
+void HandAnalyzer::set_deadline(std::chrono::steady_clock::time_point deadline) {
+	this->deadline = Deadline(deadline);
+}
+
+/*
+ * Check if the deadline passed during the analysis.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if the analysis gave up and its values can't be used.
+ */
+bool HandAnalyzer::timed_out() const {
+	return this->deadline.has_passed();
+}
+
+/*
+ * Get the chance that the dealer's hole card doesn't make a blackjack.
+ */
+double HandAnalyzer::no_blackjack_probability(const Composition &shoe) const {
+	if (this->upcard == 11) {
+		return 1.0 - shoe.probability(10);
+	}
+	if (this->upcard == 10) {
+		return 1.0 - shoe.probability(11);
+	}
+	return 1.0;
+}
+
+/*
+ * Get the value of standing.
+ *
+ * Parameters:
+ *	shoe: Cards left.
+ *	total: Player's total, 21 or less.
+ *
+ * Return:
+ *	Expected value of standing.
+ */
+double HandAnalyzer::stand_value(Composition &shoe, int total) {
+	const DealerOutcomes &outcomes = this->dealer.outcomes(shoe, this->upcard, &this->deadline);
+
+	double value = outcomes.probability[DEALER_BUST];
+	for (int dealer_total = 17; dealer_total <= 21; dealer_total++) {
+		if (total > dealer_total) {
+			value += outcomes.probability[dealer_total - 17];
+		}
+		else if (total < dealer_total) {
+			value -= outcomes.probability[dealer_total - 17];
+		}
+	}
+	return value;
+}
+
+/*
+ * Get the value of taking a card and then playing on as well as possible.
+ *
+ * Parameters:
+ *	shoe: Cards left. Cards are taken out and put back while recursing.
+ *	total: Player's total.
+ *	soft_aces: Number of aces the player is counting as 11.
+ *
+ * Return:
+ *	Expected value of hitting.
+ */
+double HandAnalyzer::hit_value(Composition &shoe, int total, int soft_aces) {
+	double value = 0.0;
+
+	for (int value_drawn = 2; value_drawn <= 11; value_drawn++) {
+		double probability = shoe.probability(value_drawn);
+		if (probability == 0.0) {
+			continue;
+		}
+
+		int next_total = total, next_soft_aces = soft_aces;
+		add_value(next_total, next_soft_aces, value_drawn);
+		shoe.remove(value_drawn);
+		value += probability * this->best_value(shoe, next_total, next_soft_aces);
+		shoe.add(value_drawn);
+	}
+
+	return value;
+}
+
+/*
+ * Get the value of doubling, taking exactly one card for twice the bet.
+ *
+ * Parameters:
+ *	shoe: Cards left. Cards are taken out and put back while recursing.
+ *	total: Player's total.
+ *	soft_aces: Number of aces the player is counting as 11.
+ *
+ * Return:
+ *	Expected value of doubling, in units of the original bet.
+ */
+double HandAnalyzer::double_value(Composition &shoe, int total, int soft_aces) {
+	double value = 0.0;
+
+	for (int value_drawn = 2; value_drawn <= 11; value_drawn++) {
+		double probability = shoe.probability(value_drawn);
+		if (probability == 0.0) {
+			continue;
+		}
+
+		int next_total = total, next_soft_aces = soft_aces;
+		add_value(next_total, next_soft_aces, value_drawn);
+		shoe.remove(value_drawn);
+		if (next_total > 21) {
+			value -= probability * this->no_blackjack_probability(shoe);
+		}
+		else {
+			value += probability * this->stand_value(shoe, next_total);
+		}
+		shoe.add(value_drawn);
+	}
+
+	return 2.0 * value;
+}
+
+/*
+ * Get the value of the better of hitting and standing. Results are cached
+ * by composition.
+ *
+ * Below 17 a hand that can't bust on the next card, a hard 11 or less or any
+ * soft hand, is never worse off hitting: standing only wins when the dealer
+ * busts, the player can still stand after the next card and the dealer is
+ * just as likely to bust once a random card is gone. Standing on those hands
+ * is skipped, which saves a dealer lookup for most of the small hands the
+ * recursion goes through.
+ *
+ * Parameters:
+ *	shoe: Cards left.
+ *	total: Player's total.
+ *	soft_aces: Number of aces the player is counting as 11.
+ *
+ * Return:
+ *	Expected value of playing the hand on as well as possible.
+ */
+double HandAnalyzer::best_value(Composition &shoe, int total, int soft_aces) {
+	if (total > 21) {
+		return -this->no_blackjack_probability(shoe);
+	}
+	if (total == 21) {
+		return this->stand_value(shoe, total);
+	}
+
+	uint64_t key = shoe.key();
+	auto cached = this->hand_cache.find(key);
+	if (cached != this->hand_cache.end()) {
+		return cached->second;
+	}
+
+	if (this->deadline.expired()) {
+		return 0.0;
+	}
+
+	double value = this->hit_value(shoe, total, soft_aces);
+	if (total >= 17 || (total > 11 && soft_aces == 0)) {
+		value = std::max(value, this->stand_value(shoe, total));
+	}
+
+	if (!this->deadline.has_passed()) {
+		this->hand_cache.emplace(key, value);
+	}
+	return value;
+}
+
+/*
+ * Get the value of every play on a two card hand other than splitting.
+ *
+ * Parameters:
+ *	shoe: Cards left after the hand and the upcard have been dealt.
+ *	first, second: Numeric values of the player's cards.
+ *
+ * Return:
+ *	Expected value of each play.
+ */
+ActionValues HandAnalyzer::hand_values(Composition &shoe, int first, int second) {
+	ActionValues values;
+	int total = 0, soft_aces = 0;
+	add_value(total, soft_aces, first);
+	add_value(total, soft_aces, second);
+
+	values.stand = this->stand_value(shoe, total);
+	values.hit = this->hit_value(shoe, total, soft_aces);
+	values.double_down = this->double_value(shoe, total, soft_aces);
+	values.surrender = -0.5 * this->no_blackjack_probability(shoe);
+
+	return values;
+}
+
+/*
+ * Get the value of splitting a pair. Each hand gets a card and is then
+ * played as well as possible, including doubling if it is allowed after a
+ * split. Split aces get a single card. Resplitting is not considered and
+ * each hand is played from the composition with both pair cards taken out,
+ * which is the usual approximation and is within a small fraction of a
+ * percent of the exact value.
+ *
+ * The player's cards are no longer the whole difference between the shoe
+ * and the starting shoe, so the hand cache is cleared before and after.
+ *
+ * Parameters:
+ *	shoe: Cards left after the pair and the upcard have been dealt.
+ *	pair_value: Numeric value of the pair cards.
+ *
+ * Return:
+ *	Expected value of splitting, in units of the original bet.
+ */
+double HandAnalyzer::split_value(Composition &shoe, int pair_value) {
+	double value = 0.0;
+
+	this->hand_cache.clear();
+
+	for (int value_drawn = 2; value_drawn <= 11; value_drawn++) {
+		double probability = shoe.probability(value_drawn);
+		if (probability == 0.0) {
+			continue;
+		}
+
+		int total = 0, soft_aces = 0;
+		add_value(total, soft_aces, pair_value);
+		add_value(total, soft_aces, value_drawn);
+		shoe.remove(value_drawn);
+
+		double hand_value;
+		if (pair_value == 11) {
+			hand_value = this->stand_value(shoe, total);
+		}
+		else {
+			hand_value = this->best_value(shoe, total, soft_aces);
+			if (this->rules.double_after_split) {
+				hand_value = std::max(hand_value, this->double_value(shoe, total, soft_aces));
+			}
+		}
+		value += probability * hand_value;
+
+		shoe.add(value_drawn);
+	}
+
+	this->hand_cache.clear();
+
+	return 2.0 * value;
+}
@@ -0,0 +1,72 @@
+#pragma once
+
+#include "Composition.h"
+#include "DealerEngine.h"
+#include "Deadline.h"
+#include "RuleSet.h"
+
+#include <chrono>
+#include <cstdint>
+#include <unordered_map>
+
+/*
+ * Expected value of every play on a hand other than splitting. Values are
+ * weighted by the chance the dealer doesn't have blackjack, see
+ * HandAnalyzer.
+ */
+struct ActionValues {
+	double stand = 0.0;
+	double hit = 0.0;
+	double double_down = 0.0;
+	double surrender = 0.0;
+
+	void add(const ActionValues &other, double weight);
+	double best_without_split(const RuleSet &rules) const;
+};
+
+/*
+ * Works out the exact expected value of every play against one dealer
+ * upcard by recursing over every card the player and dealer could draw,
+ * taking each card out of the composition as it is dealt.
+ *
+ * The dealer checks for blackjack before the player acts, so every decision
+ * is made knowing the dealer doesn't have one. Rather than conditioning each
+ * draw on that, values are the expected result on the rounds where the dealer
+ * doesn't have blackjack times the chance of those rounds. At any decision
+ * every option is scaled by the same chance so comparing them picks the same
+ * play, and since the dealer's hole card is just as likely to be any unseen
+ * card it can be dealt after the player's cards without changing anything.
+ *
+ * Dealer outcomes come from a DealerEngine and its cache, and the player's
+ * best play is memoized by composition. For a fixed upcard and starting shoe
+ * the composition alone tells which cards the player holds so it is the
+ * whole key. An analyzer must only be used for hands dealt from one starting
+ * shoe.
+ *
+ * An optional deadline bounds how long the analysis can take. Once it has
+ * passed the analysis unwinds as fast as it can and the values it returns
+ * are meaningless, which the caller can check with timed_out.
+ */
+class HandAnalyzer
+{
+private:
+	const RuleSet &rules;
+	DealerEngine &dealer;
+	int upcard;
+	std::unordered_map<uint64_t, double> hand_cache;
+	Deadline deadline;
+	double no_blackjack_probability(const Composition &shoe) const;
+	double stand_value(Composition &shoe, int total);
+	double hit_value(Composition &shoe, int total, int soft_aces);
+	double double_value(Composition &shoe, int total, int soft_aces);
+	double best_value(Composition &shoe, int total, int soft_aces);
+
+public:
+	HandAnalyzer(const RuleSet &rules, DealerEngine &dealer, int upcard);
+
+	void set_deadline(std::chrono::steady_clock::time_point deadline);
+	bool timed_out() const;
+
+	ActionValues hand_values(Composition &shoe, int first, int second);
+	double split_value(Composition &shoe, int pair_value);
+};
@@ -0,0 +1,490 @@
+#include "HandRecords.h"
+
+#include <algorithm>
+#include <cstring>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+/* Bytes per value of every column. */
+static const size_t column_widths[HAND_COLUMN_COUNT] = {
+	sizeof(uint64_t), sizeof(int8_t), sizeof(uint8_t), sizeof(uint8_t), sizeof(uint8_t), sizeof(int16_t)
+};
+
+/*
+ * Round a size up to the alignment of chunks and columns.
+ */
+static uint64_t align_size(uint64_t size) {
+	return (size + HAND_RECORD_ALIGNMENT - 1) / HAND_RECORD_ALIGNMENT * HAND_RECORD_ALIGNMENT;
+}
+
+/*
+ * Get the display name of a hand outcome.
+ *
+ * Parameters:
+ *	outcome: The outcome to name.
+ *
+ * Return:
+ *	Name of the outcome as a constant string.
+ */
+const char *hand_outcome_name(HandOutcome outcome) {
+	switch (outcome) {
+	case HandOutcome::Loss:
+		return "Loss";
+	case HandOutcome::Push:
+		return "Push";
+	case HandOutcome::Win:
+		return "Win";
+	case HandOutcome::Blackjack:
+		return "Blackjack";
+	case HandOutcome::Bust:
+		return "Bust";
+	case HandOutcome::Surrender:
+		return "Surrender";
+	default:
+		return "ERROR";
+	}
+}
+
+/*
+ * Constructor for the HandRecordBuffer class.
+ *
+ * Parameters:
+ *	writer: Writer to hand full chunks to.
+ */
+HandRecordBuffer::HandRecordBuffer(HandRecordWriter *writer) : writer(writer) {
+	this->shoes.reserve(HAND_RECORD_CHUNK_ROWS);
+	this->true_counts.reserve(HAND_RECORD_CHUNK_ROWS);
+	this->bets.reserve(HAND_RECORD_CHUNK_ROWS);
+	this->outcomes.reserve(HAND_RECORD_CHUNK_ROWS);
+	this->decisions.reserve(HAND_RECORD_CHUNK_ROWS);
+	this->units.reserve(HAND_RECORD_CHUNK_ROWS);
+}
+
+/*
+ * Destructor for the HandRecordBuffer class. Writes out any rows left.
+ */
+HandRecordBuffer::~HandRecordBuffer() {
+	this->flush();
+}
+
+/*
+ * Add a hand to the buffer, writing the buffer out as a chunk once it is
+ * full.
+ *
+ * Parameters:
+ *	record: The hand to add.
+ *
+ * Return:
+ *	Nothing
+ */
+void HandRecordBuffer::add(const HandRecord &record) {
+	this->shoes.push_back(record.shoe);
+	this->true_counts.push_back(record.true_count);
+	this->bets.push_back(record.bet);
+	this->outcomes.push_back((uint8_t)record.outcome);
+	this->decisions.push_back(record.decisions);
+	this->units.push_back(record.units);
+
+	if (this->shoes.size() >= HAND_RECORD_CHUNK_ROWS) {
+		this->flush();
+	}
+}
+
+/*
+ * Write out the buffered rows as a chunk and empty the buffer.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Nothing
+ */
+void HandRecordBuffer::flush() {
+	if (this->shoes.empty()) {
+		return;
+	}
+	this->writer->write_chunk(*this);
+
+	this->shoes.clear();
+	this->true_counts.clear();
+	this->bets.clear();
+	this->outcomes.clear();
+	this->decisions.clear();
+	this->units.clear();
+}
+
+/*
+ * Constructor for the HandRecordWriter class.
+ */
+HandRecordWriter::HandRecordWriter() : file(NULL), rows(0), write_failed(false) {
+}
+
+/*
+ * Destructor for the HandRecordWriter class. Closes the file if it is open.
+ */
+HandRecordWriter::~HandRecordWriter() {
+	this->close();
+}
+
+/*
+ * Create a hand record file and write its header.
+ *
+ * Parameters:
+ *	path: Path of the file to create.
+ *
+ * Return:
+ *	True if the file was created and false otherwise.
+ */
+bool HandRecordWriter::open(const std::string &path) {
+	this->close();
+	this->file = fopen(path.c_str(), "wb");
+	if (this->file == NULL) {
+		return false;
+	}
+	this->rows = 0;
+	this->write_failed = false;
+
+	HandFileHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = HAND_RECORD_MAGIC;
+	header.version = HAND_RECORD_VERSION;
+	header.column_count = HAND_COLUMN_COUNT;
+	header.chunk_rows = HAND_RECORD_CHUNK_ROWS;
+	return this->write(&header, sizeof(header));
+}
+
+/*
+ * Write bytes to the file, remembering if it fails.
+ */
+bool HandRecordWriter::write(const void *data, size_t size) {
+	if (fwrite(data, 1, size, this->file) != size) {
+		this->write_failed = true;
+	}
+	return !this->write_failed;
+}
+
+/*
+ * Find the smallest and largest value of a column.
+ */
+template <typename T>
+static void column_range(const std::vector<T> &values, int64_t &min, int64_t &max) {
+	auto range = std::minmax_element(values.begin(), values.end());
+	min = (int64_t)*range.first;
+	max = (int64_t)*range.second;
+}
+
+/*
+ * Write the rows of a buffer to the file as a chunk. Called by the worker
+ * threads' buffers, so only one chunk is written at a time.
+ *
+ * Parameters:
+ *	buffer: The rows to write.
+ *
+ * Return:
+ *	Nothing
+ */
+void HandRecordWriter::write_chunk(const HandRecordBuffer &buffer) {
+	const void *columns[HAND_COLUMN_COUNT] = {
+		buffer.shoes.data(), buffer.true_counts.data(), buffer.bets.data(),
+		buffer.outcomes.data(), buffer.decisions.data(), buffer.units.data()
+	};
+	uint32_t rows = (uint32_t)buffer.shoes.size();
+
+	HandChunkHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = HAND_CHUNK_MAGIC;
+	header.rows = rows;
+	uint64_t offset = align_size(sizeof(HandChunkHeader));
+	for (int c = 0; c < HAND_COLUMN_COUNT; c++) {
+		header.offsets[c] = offset;
+		offset += align_size(column_widths[c] * rows);
+	}
+	header.size = offset;
+
+	/* The shoe column holds the antithetic bit, which would make its range useless, so leave it out. */
+	auto shoe_range = std::minmax_element(buffer.shoes.begin(), buffer.shoes.end(), [](uint64_t a, uint64_t b) {
+		return (a & ~HAND_RECORD_ANTITHETIC_SHOE) < (b & ~HAND_RECORD_ANTITHETIC_SHOE);
+	});
+	header.min[(int)HandColumn::Shoe] = (int64_t)(*shoe_range.first & ~HAND_RECORD_ANTITHETIC_SHOE);
+	header.max[(int)HandColumn::Shoe] = (int64_t)(*shoe_range.second & ~HAND_RECORD_ANTITHETIC_SHOE);
+	column_range(buffer.true_counts, header.min[(int)HandColumn::TrueCount], header.max[(int)HandColumn::TrueCount]);
+	column_range(buffer.bets, header.min[(int)HandColumn::Bet], header.max[(int)HandColumn::Bet]);
+	column_range(buffer.outcomes, header.min[(int)HandColumn::Outcome], header.max[(int)HandColumn::Outcome]);
+	column_range(buffer.decisions, header.min[(int)HandColumn::Decisions], header.max[(int)HandColumn::Decisions]);
+	column_range(buffer.units, header.min[(int)HandColumn::Units], header.max[(int)HandColumn::Units]);
+
+	static const unsigned char padding[HAND_RECORD_ALIGNMENT] = {};
+
+	std::lock_guard<std::mutex> guard(this->lock);
+	if (this->file == NULL || this->write_failed) {
+		return;
+	}
+	this->write(&header, sizeof(header));
+	this->write(padding, align_size(sizeof(header)) - sizeof(header));
+	for (int c = 0; c < HAND_COLUMN_COUNT; c++) {
+		size_t size = column_widths[c] * rows;
+		this->write(columns[c], size);
+		this->write(padding, align_size(size) - size);
+	}
+	this->rows += rows;
+}
+
+/*
+ * Close the file.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if every chunk was written and false if any write failed.
+ */
+bool HandRecordWriter::close() {
+	std::lock_guard<std::mutex> guard(this->lock);
+	if (this->file != NULL) {
+		if (fclose(this->file) != 0) {
+			this->write_failed = true;
+		}
+		this->file = NULL;
+	}
+	return !this->write_failed;
+}
+
+/*
+ * Get the number of rows written so far.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of rows written.
+ */
+uint64_t HandRecordWriter::row_count() {
+	std::lock_guard<std::mutex> guard(this->lock);
+	return this->rows;
+}
+
+/*
+ * Constructor for the HandRecordFile class.
+ */
+HandRecordFile::HandRecordFile() :
+	data(nullptr), size(0), file_handle(nullptr), mapping_handle(nullptr), rows(0)
+{
+}
+
+/*
+ * Destructor for the HandRecordFile class. Unmaps the file.
+ */
+HandRecordFile::~HandRecordFile() {
+	this->close();
+}
+
+/*
+ * Map a hand record file into memory and find its chunks.
+ *
+ * Parameters:
+ *	path: Path of the file to open.
+ *
+ * Return:
+ *	True if the file was mapped and is a whole hand record file of this
+ *	version. False if it couldn't be opened or is damaged.
+ */
+bool HandRecordFile::open(const std::string &path) {
+	this->close();
+
+#ifdef _WIN32
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING,
+		FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+	if (file == INVALID_HANDLE_VALUE) {
+		return false;
+	}
+	LARGE_INTEGER file_size;
+	if (!GetFileSizeEx(file, &file_size) || file_size.QuadPart == 0) {
+		CloseHandle(file);
+		return false;
+	}
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) {
+		CloseHandle(file);
+		return false;
+	}
+	this->data = (const unsigned char *)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (this->data == nullptr) {
+		CloseHandle(mapping);
+		CloseHandle(file);
+		return false;
+	}
+	this->size = (size_t)file_size.QuadPart;
+	this->file_handle = file;
+	this->mapping_handle = mapping;
+#else
+	int file = ::open(path.c_str(), O_RDONLY);
+	if (file < 0) {
+		return false;
+	}
+	struct stat status;
+	if (fstat(file, &status) != 0 || status.st_size == 0) {
+		::close(file);
+		return false;
+	}
+	void *mapping = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+	/* The mapping keeps the file open. */
+	::close(file);
+	if (mapping == MAP_FAILED) {
+		return false;
+	}
+	madvise(mapping, (size_t)status.st_size, MADV_SEQUENTIAL);
+	this->data = (const unsigned char *)mapping;
+	this->size = (size_t)status.st_size;
+#endif
+
+	const HandFileHeader *header = (const HandFileHeader *)this->data;
+	if (this->size < sizeof(HandFileHeader) || header->magic != HAND_RECORD_MAGIC ||
+		header->version != HAND_RECORD_VERSION || header->column_count != HAND_COLUMN_COUNT) {
+		this->close();
+		return false;
+	}
+
+	uint64_t offset = sizeof(HandFileHeader);
+	while (offset < this->size) {
+		const HandChunkHeader *chunk = (const HandChunkHeader *)(this->data + offset);
+		uint64_t left = this->size - offset;
+		/* A chunk has to at least hold its header, or a size of zero would never move on to the next chunk. */
+		bool ok = left >= sizeof(HandChunkHeader) && chunk->magic == HAND_CHUNK_MAGIC &&
+			chunk->size >= sizeof(HandChunkHeader) && chunk->size <= left &&
+			chunk->size % HAND_RECORD_ALIGNMENT == 0;
+		for (int c = 0; ok && c < HAND_COLUMN_COUNT; c++) {
+			ok = chunk->offsets[c] % HAND_RECORD_ALIGNMENT == 0 && chunk->offsets[c] >= sizeof(HandChunkHeader) &&
+				chunk->offsets[c] <= chunk->size && column_widths[c] * chunk->rows <= chunk->size - chunk->offsets[c];
+		}
+		if (!ok) {
+			this->close();
+			return false;
+		}
+
+		this->chunks.push_back(chunk);
+		this->rows += chunk->rows;
+		offset += chunk->size;
+	}
+
+	return true;
+}
+
+/*
+ * Unmap the file.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Nothing
+ */
+void HandRecordFile::close() {
+	if (this->data != nullptr) {
+#ifdef _WIN32
+		UnmapViewOfFile(this->data);
+		CloseHandle((HANDLE)this->mapping_handle);
+		CloseHandle((HANDLE)this->file_handle);
+#else
+		munmap((void *)this->data, this->size);
+#endif
+	}
+	this->data = nullptr;
+	this->size = 0;
+	this->file_handle = nullptr;
+	this->mapping_handle = nullptr;
+	this->chunks.clear();
+	this->rows = 0;
+}
+
+/*
+ * Get the number of chunks in the file.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of chunks.
+ */
+size_t HandRecordFile::chunk_count() const {
+	return this->chunks.size();
+}
+
+/*
+ * Get the number of rows in the file.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of rows in every chunk.
+ */
+uint64_t HandRecordFile::row_count() const {
+	return this->rows;
+}
+
+/*
+ * Get the header of a chunk, for example to skip chunks using the range of
+ * a column.
+ *
+ * Parameters:
+ *	chunk: Index of the chunk.
+ *
+ * Return:
+ *	The chunk's header.
+ */
+const HandChunkHeader &HandRecordFile::chunk(size_t chunk) const {
+	return *this->chunks[chunk];
+}
+
+/*
+ * Get a view of a column of a chunk.
+ */
+template <typename T>
+std::span<const T> HandRecordFile::column(size_t chunk, HandColumn column) const {
+	const HandChunkHeader *header = this->chunks[chunk];
+	const unsigned char *start = (const unsigned char *)header + header->offsets[(int)column];
+	return std::span<const T>((const T *)start, header->rows);
+}
+
+/*
+ * Get views of the columns of a chunk. The views point into the mapped file
+ * and stay valid until the file is closed.
+ *
+ * Parameters:
+ *	chunk: Index of the chunk.
+ *
+ * Return:
+ *	The values of the column for every row of the chunk.
+ */
+std::span<const uint64_t> HandRecordFile::shoes(size_t chunk) const {
+	return this->column<uint64_t>(chunk, HandColumn::Shoe);
+}
+
+std::span<const int8_t> HandRecordFile::true_counts(size_t chunk) const {
+	return this->column<int8_t>(chunk, HandColumn::TrueCount);
+}
+
+std::span<const uint8_t> HandRecordFile::bets(size_t chunk) const {
+	return this->column<uint8_t>(chunk, HandColumn::Bet);
+}
+
+std::span<const HandOutcome> HandRecordFile::outcomes(size_t chunk) const {
+	return this->column<HandOutcome>(chunk, HandColumn::Outcome);
+}
+
+std::span<const uint8_t> HandRecordFile::decisions(size_t chunk) const {
+	return this->column<uint8_t>(chunk, HandColumn::Decisions);
+}
+
+std::span<const int16_t> HandRecordFile::units(size_t chunk) const {
+	return this->column<int16_t>(chunk, HandColumn::Units);
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <mutex>
+#include <span>
+#include <string>
+#include <vector>
+
+/* First bytes of a hand record file ("HREC") and of every chunk in it ("CHNK"), and the version of the layout. */
+#define HAND_RECORD_MAGIC 0x43455248u
+#define HAND_CHUNK_MAGIC 0x4B4E4843u
+#define HAND_RECORD_VERSION 1u
+
+/* Rows a writer buffers per thread before writing them out as a chunk. */
+#define HAND_RECORD_CHUNK_ROWS 65536
+/* Every chunk and every column in a chunk starts on a multiple of this many bytes. */
+#define HAND_RECORD_ALIGNMENT 64
+
+/* Set in the shoe column for hands from the antithetic copy of a shoe. */
+#define HAND_RECORD_ANTITHETIC_SHOE (1ull << 63)
+
+/* Bits of the decisions column, one for every kind of play made on a hand. */
+#define HAND_DECISION_HIT 0x01
+#define HAND_DECISION_STAND 0x02
+#define HAND_DECISION_DOUBLE 0x04
+#define HAND_DECISION_SPLIT 0x08
+#define HAND_DECISION_SURRENDER 0x10
+
+/*
+ * How a player hand ended.
+ */
+enum class HandOutcome : uint8_t {
+	Loss,
+	Push,
+	Win,
+	Blackjack,
+	Bust,
+	Surrender
+};
+
+/*
+ * Columns of a hand record file, in the order they are stored in a chunk.
+ */
+enum class HandColumn {
+	/* uint64_t: Index of the shoe the hand was dealt from. */
+	Shoe,
+	/* int8_t: True count at the start of the round, clamped like SimulationResult::true_counts. */
+	TrueCount,
+	/* uint8_t: Bet on the hand in units, 2 after doubling. */
+	Bet,
+	/* uint8_t: A HandOutcome. */
+	Outcome,
+	/* uint8_t: HAND_DECISION_ bits of the plays made on the hand. */
+	Decisions,
+	/* int16_t: Amount won or lost on the hand in tenths of a unit, like the simulator's totals. */
+	Units,
+
+	HandColumn_END
+};
+
+#define HAND_COLUMN_COUNT ((int)HandColumn::HandColumn_END)
+
+/*
+ * One player hand. Hands from splitting get a record each.
+ */
+struct HandRecord {
+	uint64_t shoe;
+	int8_t true_count;
+	uint8_t bet;
+	HandOutcome outcome;
+	uint8_t decisions;
+	int16_t units;
+};
+
+/*
+ * Header at the start of a hand record file.
+ */
+struct HandFileHeader {
+	uint32_t magic;
+	uint32_t version;
+	uint32_t column_count;
+	uint32_t chunk_rows;
+	uint8_t padding[HAND_RECORD_ALIGNMENT - 16];
+};
+
+/*
+ * Header at the start of every chunk. The columns follow it, each one an
+ * array of fixed width values, so a column of a chunk can be read straight
+ * out of the file. The smallest and largest value of every column let a
+ * scan skip chunks that can't hold the rows it is looking for.
+ */
+struct HandChunkHeader {
+	uint32_t magic;
+	uint32_t rows;
+	/* Bytes from the start of this header to the next chunk. */
+	uint64_t size;
+	/* Bytes from the start of this header to each column. */
+	uint64_t offsets[HAND_COLUMN_COUNT];
+	int64_t min[HAND_COLUMN_COUNT];
+	int64_t max[HAND_COLUMN_COUNT];
+};
+
+class HandRecordWriter;
+
+/*
+ * Records buffered by one worker thread. Once a chunk's worth of rows has
+ * built up it is handed to the writer, so threads only contend for the file
+ * once per chunk.
+ */
+class HandRecordBuffer
+{
+private:
+	HandRecordWriter *writer;
+	std::vector<uint64_t> shoes;
+	std::vector<int8_t> true_counts;
+	std::vector<uint8_t> bets;
+	std::vector<uint8_t> outcomes;
+	std::vector<uint8_t> decisions;
+	std::vector<int16_t> units;
+
+	friend class HandRecordWriter;
+
+public:
+	HandRecordBuffer(HandRecordWriter *writer);
+	~HandRecordBuffer();
+
+	void add(const HandRecord &record);
+	void flush();
+};
+
+/*
+ * Writes the chunks of every thread's buffer to a hand record file. Chunks
+ * are written in the order they fill up, so rows from different threads are
+ * interleaved; use the shoe column to put them back in order.
+ */
+class HandRecordWriter
+{
+private:
+	FILE *file;
+	std::mutex lock;
+	uint64_t rows;
+	bool write_failed;
+
+	bool write(const void *data, size_t size);
+
+public:
+	HandRecordWriter();
+	~HandRecordWriter();
+
+	bool open(const std::string &path);
+	void write_chunk(const HandRecordBuffer &buffer);
+	bool close();
+	uint64_t row_count();
+};
+
+/*
+ * A hand record file mapped into memory. Columns are read through views
+ * straight into the mapping, so nothing is copied and scanning a column
+ * runs at the speed of memory.
+ */
+class HandRecordFile
+{
+private:
+	const unsigned char *data;
+	size_t size;
+	/* Handles the mapping is held open with on Windows. */
+	void *file_handle;
+	void *mapping_handle;
+	std::vector<const HandChunkHeader *> chunks;
+	uint64_t rows;
+
+	template <typename T>
+	std::span<const T> column(size_t chunk, HandColumn column) const;
+
+public:
+	HandRecordFile();
+	~HandRecordFile();
+	HandRecordFile(const HandRecordFile &) = delete;
+	HandRecordFile &operator=(const HandRecordFile &) = delete;
+
+	bool open(const std::string &path);
+	void close();
+
+	size_t chunk_count() const;
+	uint64_t row_count() const;
+	const HandChunkHeader &chunk(size_t chunk) const;
+
+	std::span<const uint64_t> shoes(size_t chunk) const;
+	std::span<const int8_t> true_counts(size_t chunk) const;
+	std::span<const uint8_t> bets(size_t chunk) const;
+	std::span<const HandOutcome> outcomes(size_t chunk) const;
+	std::span<const uint8_t> decisions(size_t chunk) const;
+	std::span<const int16_t> units(size_t chunk) const;
+};
+
+const char *hand_outcome_name(HandOutcome outcome);
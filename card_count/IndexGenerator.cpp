@@ -0,0 +1,673 @@
+#include "IndexGenerator.h"
+#include "Hand.h"
+
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+
+/* Shuffles to try when looking for a true count before giving up on it. */
+#define INDEX_MAX_SHUFFLES 10000
+
+/*
+ * A starting hand along with a play to compare to the basic strategy play.
+ */
+struct IndexComparison {
+	int first, second, upcard;
+	PlayerAction basic_action;
+	PlayerAction deviation;
+};
+
+/*
+ * Make a card with a value. Tens are all dealt as tens and suits don't
+ * matter to the play.
+ *
+ * Parameters:
+ *	value: Value of the card, 2 through 11 for an ace.
+ *
+ * Return:
+ *	A card with the value.
+ */
+static Card card_with_value(int value) {
+	return Card(value == 11 ? CardRank::Ace : (CardRank)value, CardSuit::Spade, true);
+}
+
+/*
+ * Simulates rounds that start with a fixed hand against a fixed upcard at a
+ * chosen true count. The hand and the upcard are taken out of the shoe for
+ * good and counted as seen, then the shoe is dealt out a card at a time until
+ * the true count is the one wanted and a round is played from there. Every
+ * round is played once with each of the two plays on the same cards so the
+ * difference between them has far less noise than two separate runs would.
+ * The player is templated on the counting system like the simulator.
+ */
+template <typename System>
+class IndexPlayer
+{
+private:
+	const RuleSet &rules;
+	const StrategyTable *strategy;
+	Shoe shoe;
+	int running_count;
+	/* The player's cards and the upcard, held out of the shoe, and their count. */
+	Card hand_cards[3];
+	int hand_count_value;
+	/* Cards of the current round. Each play starts over from the first of them. */
+	Card round_cards[INDEX_ROUND_CARDS];
+	size_t round_card_count;
+	size_t next_round_card;
+	bool out_of_cards;
+
+	void shuffle();
+	bool advance_to(int bucket);
+	Card draw();
+	PlayerAction decide(const Hand &hand, int upcard_value, bool can_double, bool can_split);
+	void play_hand(Hand *hands, int *bets, bool *split_aces, int &hand_count, int h, int upcard_value);
+	int64_t play(PlayerAction action);
+	bool play_round(const IndexComparison &comparison, RoundTotals &totals);
+	int sign_at(const IndexComparison &comparison, int bucket, uint64_t max_rounds, RoundTotals &totals);
+
+public:
+	IndexPlayer(const RuleSet &rules, const StrategyTable *strategy, uint64_t seed);
+	bool find_index(uint64_t comparison_index, const IndexComparison &comparison, uint64_t max_rounds, IndexPlay &play);
+};
+
+/*
+ * Constructor for the IndexPlayer class.
+ *
+ * Parameters:
+ *	rules: House rules to play by.
+ *	strategy: Strategy for every decision after the first, or null for the
+ *			  built in charts.
+ *	seed: Seed for the shoe shuffles.
+ */
+template <typename System>
+IndexPlayer<System>::IndexPlayer(const RuleSet &rules, const StrategyTable *strategy, uint64_t seed) :
+	rules(rules), strategy(strategy), shoe(rules.deck_count, rules.penetration), running_count(0),
+	hand_count_value(0), round_card_count(0), next_round_card(0), out_of_cards(false)
+{
+	this->shoe.seed(seed);
+}
+
+/*
+ * Shuffle the shoe and start the count over. The hand and the upcard stay
+ * out of the shoe and are counted as already seen.
+ */
+template <typename System>
+void IndexPlayer<System>::shuffle() {
+	this->shoe.shuffle();
+	this->running_count = initial_running_count<System>(this->rules.deck_count) + this->hand_count_value;
+}
+
+/*
+ * Deal cards out of the shoe until the true count is in a bucket, shuffling
+ * whenever the cut card comes out.
+ *
+ * Parameters:
+ *	bucket: Index of the true count bucket to stop at.
+ *
+ * Return:
+ *	True if the true count was reached and false if it wasn't reached after
+ *	INDEX_MAX_SHUFFLES shuffles.
+ */
+template <typename System>
+bool IndexPlayer<System>::advance_to(int bucket) {
+	int shuffles = 0;
+
+	while (true) {
+		if (this->shoe.cut_card_reached()) {
+			if (++shuffles > INDEX_MAX_SHUFFLES) {
+				return false;
+			}
+			this->shuffle();
+		}
+		if (true_count_bucket(this->running_count, System::scale, this->shoe.shuffeled_card_count()) == bucket) {
+			return true;
+		}
+
+		Card card = this->shoe.draw();
+		this->running_count += count_value<System>(card);
+		this->shoe.discard(card);
+	}
+}
+
+/*
+ * Draw the next card of the round. The first play of a round draws its cards
+ * from the shoe and the other plays are dealt the same cards again, only
+ * drawing from the shoe once they go past the cards already dealt. If the
+ * shoe runs out the round is marked to be thrown away.
+ */
+template <typename System>
+Card IndexPlayer<System>::draw() {
+	if (this->next_round_card < this->round_card_count) {
+		return this->round_cards[this->next_round_card++];
+	}
+
+	Card card;
+	if (this->round_card_count < INDEX_ROUND_CARDS) {
+		card = this->shoe.draw();
+	}
+	if (!card.is_valid()) {
+		/* Any card will do to finish the round since it isn't counted. */
+		this->out_of_cards = true;
+		return card_with_value(10);
+	}
+
+	this->round_cards[this->round_card_count++] = card;
+	this->next_round_card++;
+	return card;
+}
+
+/*
+ * Get the strategy play for a decision after the first one.
+ */
+template <typename System>
+PlayerAction IndexPlayer<System>::decide(const Hand &hand, int upcard_value, bool can_double, bool can_split) {
+	return this->strategy ?
+		table_strategy(*this->strategy, hand, upcard_value, this->rules, can_double, can_split, false) :
+		basic_strategy(hand, upcard_value, this->rules, can_double, can_split, false);
+}
+
+/*
+ * Play out one of the player's hands with the strategy, the same way the
+ * simulator does. Splitting adds hands to the end of the list.
+ *
+ * Parameters:
+ *	hands, bets, split_aces: The player's hands, their bets and whether
+ *							 they came from splitting aces.
+ *	hand_count: Number of hands, increased if the hand is split.
+ *	h: Index of the hand to play.
+ *	upcard_value: Value of the dealer's upcard.
+ *
+ * Return:
+ *	Nothing
+ */
+template <typename System>
+void IndexPlayer<System>::play_hand(Hand *hands, int *bets, bool *split_aces, int &hand_count, int h, int upcard_value) {
+	const RuleSet &rules = this->rules;
+	int max_hands = rules.max_hands < 8 ? rules.max_hands : 8;
+
+	while (true) {
+		Hand &hand = hands[h];
+		bool has_split = hand_count > 1;
+
+		if (hand.total() >= 21) {
+			break;
+		}
+
+		bool can_split = hand.is_pair() && hand_count < max_hands &&
+			(!split_aces[h] || rules.resplit_aces);
+		/* Split aces only get one card unless they can be split again. */
+		if (split_aces[h] && !can_split) {
+			break;
+		}
+		bool can_double = hand.size() == 2 && !split_aces[h] &&
+			(!has_split || rules.double_after_split);
+
+		PlayerAction action = this->decide(hand, upcard_value, can_double, can_split);
+		if (split_aces[h] && action != PlayerAction::Split) {
+			break;
+		}
+
+		if (action == PlayerAction::Hit) {
+			hand.add(this->draw());
+		}
+		else if (action == PlayerAction::Double) {
+			bets[h] = 2;
+			hand.add(this->draw());
+			break;
+		}
+		else if (action == PlayerAction::Split) {
+			bool aces = hand.pair_value() == 11;
+			Hand &new_hand = hands[hand_count];
+
+			new_hand = Hand();
+			new_hand.add(hand.split());
+			bets[hand_count] = 1;
+			split_aces[h] = aces;
+			split_aces[hand_count] = aces;
+			hand_count++;
+
+			hand.add(this->draw());
+			new_hand.add(this->draw());
+		}
+		else {
+			break;
+		}
+	}
+}
+
+/*
+ * Play the round dealt so far with a first play on the starting hand. Every
+ * decision after the first follows the strategy.
+ *
+ * Parameters:
+ *	action: Play to make on the starting hand.
+ *
+ * Return:
+ *	Units won or lost on the round in tenths of a unit.
+ */
+template <typename System>
+int64_t IndexPlayer<System>::play(PlayerAction action) {
+	Hand hands[8];
+	int bets[8];
+	bool split_aces[8];
+	int hand_count = 1;
+	int64_t units = 0;
+
+	this->next_round_card = 0;
+
+	hands[0].add(this->hand_cards[0]);
+	hands[0].add(this->hand_cards[1]);
+	bets[0] = 1;
+	split_aces[0] = false;
+
+	Hand dealer;
+	dealer.add(this->hand_cards[2]);
+	dealer.add(this->draw());
+	int upcard_value = this->hand_cards[2].get_numeric_value();
+
+	/* The dealer peeks for blackjack so every play loses the same. */
+	if (dealer.is_blackjack()) {
+		return -SIM_UNIT_SCALE;
+	}
+
+	if (action == PlayerAction::Surrender) {
+		return -SIM_UNIT_SCALE / 2;
+	}
+	else if (action == PlayerAction::Double) {
+		bets[0] = 2;
+		hands[0].add(this->draw());
+	}
+	else if (action == PlayerAction::Hit) {
+		hands[0].add(this->draw());
+		this->play_hand(hands, bets, split_aces, hand_count, 0, upcard_value);
+	}
+	else if (action == PlayerAction::Split) {
+		bool aces = hands[0].pair_value() == 11;
+
+		hands[1].add(hands[0].split());
+		bets[1] = 1;
+		split_aces[0] = aces;
+		split_aces[1] = aces;
+		hand_count = 2;
+
+		hands[0].add(this->draw());
+		hands[1].add(this->draw());
+		for (int h = 0; h < hand_count; h++) {
+			this->play_hand(hands, bets, split_aces, hand_count, h, upcard_value);
+		}
+	}
+
+	/* The dealer only needs to play if some hand is still live. */
+	bool dealer_plays = false;
+	for (int h = 0; h < hand_count; h++) {
+		if (!hands[h].is_bust()) {
+			dealer_plays = true;
+		}
+	}
+	if (dealer_plays) {
+		while (dealer.total() < 17 ||
+			(this->rules.dealer_hits_soft_17 && dealer.total() == 17 && dealer.is_soft())) {
+			dealer.add(this->draw());
+		}
+	}
+
+	for (int h = 0; h < hand_count; h++) {
+		int64_t bet = bets[h] * SIM_UNIT_SCALE;
+
+		if (hands[h].is_bust()) {
+			units -= bet;
+		}
+		else if (dealer.is_bust() || hands[h].total() > dealer.total()) {
+			units += bet;
+		}
+		else if (hands[h].total() < dealer.total()) {
+			units -= bet;
+		}
+	}
+
+	return units;
+}
+
+/*
+ * Play one round from the current position in the shoe with both plays and
+ * add the difference between them to the totals. The cards used by the
+ * longest play are counted and discarded.
+ *
+ * Parameters:
+ *	comparison: The plays to compare.
+ *	totals: Totals of the deviation's win minus the basic strategy win.
+ *
+ * Return:
+ *	True if the round was played and false if the shoe ran out during it.
+ */
+template <typename System>
+bool IndexPlayer<System>::play_round(const IndexComparison &comparison, RoundTotals &totals) {
+	this->round_card_count = 0;
+	this->out_of_cards = false;
+
+	int64_t basic_units = this->play(comparison.basic_action);
+	int64_t deviation_units = this->play(comparison.deviation);
+
+	for (size_t i = 0; i < this->round_card_count; i++) {
+		this->running_count += count_value<System>(this->round_cards[i]);
+	}
+	this->shoe.discard_n(std::span<const Card>(this->round_cards, this->round_card_count));
+
+	if (this->out_of_cards) {
+		return false;
+	}
+	totals.add(deviation_units - basic_units);
+	return true;
+}
+
+/*
+ * Find out which play is better at a true count. Rounds are played in
+ * batches until the confidence interval of the difference between the plays
+ * excludes zero or the most rounds have been played.
+ *
+ * Parameters:
+ *	comparison: The plays to compare.
+ *	bucket: Index of the true count bucket to play at.
+ *	max_rounds: Most rounds to play.
+ *	totals: Totals of the deviation's win minus the basic strategy win.
+ *
+ * Return:
+ *	1 if the deviation is better and -1 if the basic strategy play is at
+ *	least as good. If the interval never excluded zero this is the sign of
+ *	the average difference.
+ */
+template <typename System>
+int IndexPlayer<System>::sign_at(const IndexComparison &comparison, int bucket, uint64_t max_rounds, RoundTotals &totals) {
+	while (totals.rounds < max_rounds) {
+		if (totals.rounds >= INDEX_BATCH_ROUNDS) {
+			double margin = INDEX_CONFIDENCE_Z * std::sqrt(totals.variance() / (double)totals.rounds);
+			if (std::fabs(totals.mean()) > margin) {
+				break;
+			}
+		}
+
+		for (int i = 0; i < INDEX_BATCH_ROUNDS; i++) {
+			if (!this->advance_to(bucket)) {
+				return totals.mean() > 0.0 ? 1 : -1;
+			}
+			this->play_round(comparison, totals);
+		}
+	}
+
+	return totals.mean() > 0.0 ? 1 : -1;
+}
+
+/*
+ * Find the true count at which a deviation becomes better than the basic
+ * strategy play. The difference between the plays is taken to change sign
+ * once over the range of true counts, so the ends of the range are checked
+ * and then the change is found by bisection, which only needs a handful of
+ * true counts to be simulated.
+ *
+ * Parameters:
+ *	comparison_index: Index of the comparison. This selects the random stream
+ *					  so the result doesn't depend on the thread it ran on.
+ *	comparison: The plays to compare.
+ *	max_rounds: Most rounds to play at a true count.
+ *	play: Filled in with the index if there is one.
+ *
+ * Return:
+ *	True if there is an index in the range of true counts and false if one
+ *	of the plays is better at every true count.
+ */
+template <typename System>
+bool IndexPlayer<System>::find_index(uint64_t comparison_index, const IndexComparison &comparison, uint64_t max_rounds, IndexPlay &play) {
+	/* Start from a fresh shoe and take the hand and the upcard out of it. */
+	this->shoe.start_shoe(comparison_index);
+	this->hand_cards[0] = this->shoe.draw_value(comparison.first);
+	this->hand_cards[1] = this->shoe.draw_value(comparison.second);
+	this->hand_cards[2] = this->shoe.draw_value(comparison.upcard);
+	this->hand_count_value = 0;
+	for (Card card : this->hand_cards) {
+		this->hand_count_value += count_value<System>(card);
+	}
+	this->running_count = initial_running_count<System>(this->rules.deck_count) + this->hand_count_value;
+
+	RoundTotals totals[TRUE_COUNT_BUCKETS];
+	int signs[TRUE_COUNT_BUCKETS] = {};
+	auto sign = [&](int bucket) {
+		if (signs[bucket] == 0) {
+			signs[bucket] = this->sign_at(comparison, bucket, max_rounds, totals[bucket]);
+		}
+		return signs[bucket];
+	};
+
+	int low = 0, high = TRUE_COUNT_BUCKETS - 1;
+	int low_sign = sign(low);
+	int high_sign = sign(high);
+
+	if (low_sign != high_sign) {
+		while (high - low > 1) {
+			int middle = (low + high) / 2;
+			if (sign(middle) == low_sign) {
+				low = middle;
+			}
+			else {
+				high = middle;
+			}
+		}
+	}
+
+	play.first = comparison.first;
+	play.second = comparison.second;
+	play.upcard = comparison.upcard;
+	play.basic_action = comparison.basic_action;
+	play.deviation = comparison.deviation;
+	play.above = high_sign > 0;
+	play.index = (play.above ? high : low) + TRUE_COUNT_MIN;
+	play.rounds = 0;
+	for (const RoundTotals &bucket : totals) {
+		play.rounds += bucket.rounds;
+	}
+
+	return low_sign != high_sign;
+}
+
+/*
+ * List every starting hand against every upcard with each play that could
+ * be made instead of the basic strategy play. Hard totals are dealt as a ten
+ * and a small card where they can be since that is the most common way to
+ * get them. Standing on a hard 11 or less is left out since hitting it can't
+ * do worse.
+ *
+ * Parameters:
+ *	rules: House rules to play by.
+ *	strategy: Strategy table, or null for the built in charts.
+ *
+ * Return:
+ *	Every comparison to find an index for.
+ */
+static std::vector<IndexComparison> index_comparisons(const RuleSet &rules, const StrategyTable *strategy) {
+	std::vector<std::pair<int, int>> hands;
+	for (int total = 5; total <= 19; total++) {
+		if (total >= 12) {
+			hands.push_back({ 10, total - 10 });
+		}
+		else {
+			hands.push_back({ total / 2 + 1, total - (total / 2 + 1) });
+		}
+	}
+	for (int other = 2; other <= 9; other++) {
+		hands.push_back({ 11, other });
+	}
+	for (int value = 2; value <= 11; value++) {
+		hands.push_back({ value, value });
+	}
+
+	const PlayerAction actions[] = {
+		PlayerAction::Hit, PlayerAction::Stand, PlayerAction::Double, PlayerAction::Split, PlayerAction::Surrender
+	};
+
+	std::vector<IndexComparison> comparisons;
+	for (const auto &cards : hands) {
+		Hand hand;
+		hand.add(card_with_value(cards.first));
+		hand.add(card_with_value(cards.second));
+		bool can_split = hand.is_pair() && rules.max_hands >= 2;
+
+		for (int upcard = 2; upcard <= 11; upcard++) {
+			PlayerAction basic = strategy ?
+				table_strategy(*strategy, hand, upcard, rules, true, can_split, rules.late_surrender) :
+				basic_strategy(hand, upcard, rules, true, can_split, rules.late_surrender);
+
+			for (PlayerAction action : actions) {
+				if (action == basic ||
+					(action == PlayerAction::Split && !can_split) ||
+					(action == PlayerAction::Surrender && !rules.late_surrender) ||
+					(action == PlayerAction::Stand && !hand.is_soft() && hand.total() <= 11)) {
+					continue;
+				}
+				comparisons.push_back({ cards.first, cards.second, upcard, basic, action });
+			}
+		}
+	}
+	return comparisons;
+}
+
+/*
+ * Find the index plays for a rule set: for every starting hand against every
+ * upcard, the true count at which each other play becomes better than the
+ * basic strategy play. Every comparison is a task on the work stealing
+ * scheduler and is dealt from its own random stream, so the results are the
+ * same no matter how many threads are used.
+ *
+ * Parameters:
+ *	config: Settings for the run.
+ *	progress: Optional function called periodically from the calling thread
+ *			  with the number of comparisons done so far.
+ *
+ * Return:
+ *	Every index found, ordered by hand and then upcard.
+ */
+std::vector<IndexPlay> generate_index_plays(const IndexConfig &config, const TaskScheduler::ProgressFunction &progress) {
+	std::vector<IndexComparison> comparisons = index_comparisons(config.rules, config.strategy);
+	std::vector<IndexPlay> plays(comparisons.size());
+	std::vector<char> found(comparisons.size(), 0);
+
+	TaskScheduler scheduler(config.thread_count);
+
+	with_counting_system(config.counting_system, [&](auto system) {
+		typedef IndexPlayer<decltype(system)> Player;
+
+		std::vector<std::unique_ptr<Player>> players;
+		for (int w = 0; w < scheduler.worker_count(); w++) {
+			players.emplace_back(new Player(config.rules, config.strategy, config.seed));
+		}
+
+		scheduler.run(comparisons.size(), [&](uint64_t task, int worker) {
+			found[task] = players[worker]->find_index(task, comparisons[task], config.max_rounds, plays[task]);
+		}, progress);
+	});
+
+	std::vector<IndexPlay> result;
+	for (size_t i = 0; i < plays.size(); i++) {
+		if (found[i]) {
+			result.push_back(plays[i]);
+		}
+	}
+	return result;
+}
+
+/*
+ * Get the name of the starting hand of an index play, in the same style as
+ * the strategy charts: "16" for a hard total, "A,7" for a soft total and
+ * "8,8" for a pair.
+ *
+ * Parameters:
+ *	play: The index play.
+ *
+ * Return:
+ *	Name of the hand.
+ */
+std::string index_hand_name(const IndexPlay &play) {
+	auto card_name = [](int value) {
+		return value == 11 ? std::string("A") : std::to_string(value);
+	};
+
+	if (play.first == play.second) {
+		return card_name(play.first) + "," + card_name(play.second);
+	}
+	if (play.first == 11 || play.second == 11) {
+		return "A," + card_name(play.first == 11 ? play.second : play.first);
+	}
+	return std::to_string(play.first + play.second);
+}
+
+/*
+ * Write index plays to a text file the trainer can quiz on. Each line holds
+ * the player's cards, the upcard, the basic strategy play, the deviation,
+ * ">=" or "<=" and the index, for example "10 6 10 Hit Stand >= 0".
+ *
+ * Parameters:
+ *	path: Path of the file to write.
+ *	plays: Index plays to write.
+ *
+ * Return:
+ *	True if the file was written and false otherwise.
+ */
+bool save_index_plays(const char *path, const std::vector<IndexPlay> &plays) {
+	FILE *file = fopen(path, "w");
+	if (file == NULL) {
+		return false;
+	}
+
+	fprintf(file, "# first second upcard basic deviation direction index\n");
+	for (const IndexPlay &play : plays) {
+		fprintf(file, "%d %d %d %s %s %s %d\n", play.first, play.second, play.upcard,
+			player_action_name(play.basic_action), player_action_name(play.deviation),
+			play.above ? ">=" : "<=", play.index);
+	}
+
+	bool ok = ferror(file) == 0;
+	return fclose(file) == 0 && ok;
+}
+
+/*
+ * Read index plays written by save_index_plays. Blank lines and lines
+ * starting with '#' are skipped.
+ *
+ * Parameters:
+ *	path: Path of the file to read.
+ *	plays: Filled in with the plays in the file.
+ *
+ * Return:
+ *	True if the file was read and every line was valid and false otherwise.
+ */
+bool load_index_plays(const char *path, std::vector<IndexPlay> &plays) {
+	FILE *file = fopen(path, "r");
+	if (file == NULL) {
+		return false;
+	}
+
+	plays.clear();
+	bool ok = true;
+	char line[256];
+	while (fgets(line, sizeof(line), file) != NULL) {
+		if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') {
+			continue;
+		}
+
+		IndexPlay play = {};
+		char basic[16], deviation[16], direction[3];
+		if (sscanf(line, "%d %d %d %15s %15s %2s %d", &play.first, &play.second, &play.upcard,
+				basic, deviation, direction, &play.index) != 7 ||
+			!player_action_from_name(basic, play.basic_action) ||
+			!player_action_from_name(deviation, play.deviation) ||
+			(strcmp(direction, ">=") != 0 && strcmp(direction, "<=") != 0)) {
+			ok = false;
+			break;
+		}
+		play.above = strcmp(direction, ">=") == 0;
+		plays.push_back(play);
+	}
+
+	fclose(file);
+	return ok;
+}
@@ -0,0 +1,57 @@
+#pragma once
+
+#include "Simulator.h"
+
+#include <cstdint>
+#include <string>
+#include <vector>
+
+/* Rounds simulated at a true count between checks of the confidence interval. */
+#define INDEX_BATCH_ROUNDS 1000
+/* Width of the confidence interval in standard errors, about 99%. */
+#define INDEX_CONFIDENCE_Z 2.576
+/* Most cards a round can use, including every split hand and the dealer's hand. */
+#define INDEX_ROUND_CARDS 64
+
+/*
+ * Settings for generating index plays.
+ */
+struct IndexConfig {
+	RuleSet rules;
+	CountingSystemId counting_system = CountingSystemId::HiLo;
+	/* Seed for the shoe shuffles. Comparison n is always dealt from stream n of this seed. */
+	uint64_t seed = 0;
+	/*
+	 * Most rounds to simulate at one true count. A true count stops as soon
+	 * as its confidence interval excludes a difference of zero, so only true
+	 * counts very close to an index get this many.
+	 */
+	uint64_t max_rounds = 200000;
+	/* Number of worker threads. Zero uses one thread per core. */
+	int thread_count = 0;
+	/* Strategy for every decision after the first. Null plays the built in charts. */
+	const StrategyTable *strategy = nullptr;
+};
+
+/*
+ * A deviation from basic strategy: the true count at which another play
+ * becomes better than the basic strategy play on a starting hand.
+ */
+struct IndexPlay {
+	/* The player's cards and the dealer's upcard as values 2 through 11. */
+	int first, second, upcard;
+	PlayerAction basic_action;
+	PlayerAction deviation;
+	/* True count, rounded down, at which the deviation starts to be the better play. */
+	int index;
+	/* True if the deviation is played at the index and above and false at the index and below. */
+	bool above;
+	/* Rounds simulated to find the index. */
+	uint64_t rounds;
+};
+
+std::vector<IndexPlay> generate_index_plays(const IndexConfig &config,
+	const TaskScheduler::ProgressFunction &progress = nullptr);
+std::string index_hand_name(const IndexPlay &play);
+bool save_index_plays(const char *path, const std::vector<IndexPlay> &plays);
+bool load_index_plays(const char *path, std::vector<IndexPlay> &plays);
@@ -0,0 +1,326 @@
+#pragma once
+
+#include <cstdint>
+#include <limits>
+
+/*
+ * Random number engines that can be plugged into Deck::shuffle. All of the
+ * engines here satisfy the standard UniformRandomBitGenerator requirements so
+ * they can be used interchangeably with the engines from <random> such as
+ * std::mt19937_64.
+ */
+
+/*
+ * Multiply two 64 bit values and return the full 128 bit result split into
+ * its high and low halves. This is done by hand since MSVC has no 128 bit
+ * integer type.
+ *
+ * Parameters:
+ *	a: First operand.
+ *	b: Second operand.
+ *	high: Set to the upper 64 bits of the product.
+ *
+ * Return:
+ *	The lower 64 bits of the product.
+ */
+inline uint64_t multiply_128(uint64_t a, uint64_t b, uint64_t &high) {
+	uint64_t a_lo = a & 0xFFFFFFFF, a_hi = a >> 32;
+	uint64_t b_lo = b & 0xFFFFFFFF, b_hi = b >> 32;
+
+	uint64_t lo_lo = a_lo * b_lo;
+	uint64_t hi_lo = a_hi * b_lo;
+	uint64_t lo_hi = a_lo * b_hi;
+	uint64_t hi_hi = a_hi * b_hi;
+
+	/* Sum up the middle terms keeping track of the carry into the top half. */
+	uint64_t middle = (lo_lo >> 32) + (hi_lo & 0xFFFFFFFF) + lo_hi;
+	high = hi_hi + (hi_lo >> 32) + (middle >> 32);
+
+	return (middle << 32) | (lo_lo & 0xFFFFFFFF);
+}
+
+/*
+ * SplitMix64 step. This is used to expand a single 64 bit seed into the
+ * larger state needed by the other engines.
+ */
+constexpr uint64_t splitmix64(uint64_t &state) {
+	uint64_t z = (state += 0x9E3779B97F4A7C15ULL);
+	z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+	z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+	return z ^ (z >> 31);
+}
+
+/*
+ * xoshiro256** engine by Blackman and Vigna. Fast, small state and good
+ * statistical quality.
+ */
+class Xoshiro256StarStar {
+private:
+	uint64_t state[4];
+
+	static uint64_t rotl(uint64_t x, int k) {
+		return (x << k) | (x >> (64 - k));
+	}
+
+public:
+	typedef uint64_t result_type;
+
+	explicit Xoshiro256StarStar(uint64_t seed = 0) {
+		this->seed(seed);
+	}
+
+	void seed(uint64_t seed) {
+		for (int i = 0; i < 4; i++) {
+			this->state[i] = splitmix64(seed);
+		}
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	result_type operator()() {
+		uint64_t result = rotl(this->state[1] * 5, 7) * 9;
+		uint64_t t = this->state[1] << 17;
+
+		this->state[2] ^= this->state[0];
+		this->state[3] ^= this->state[1];
+		this->state[1] ^= this->state[2];
+		this->state[0] ^= this->state[3];
+		this->state[2] ^= t;
+		this->state[3] = rotl(this->state[3], 45);
+
+		return result;
+	}
+};
+
+/*
+ * PCG64 engine (PCG-XSL-RR 128/64) by O'Neill. The 128 bit state is kept as
+ * two 64 bit halves so it works with compilers that lack a 128 bit type.
+ */
+class Pcg64 {
+private:
+	uint64_t state_hi, state_lo;
+	uint64_t inc_hi, inc_lo;
+
+	/* Advance the 128 bit LCG by one step. */
+	void step() {
+		const uint64_t mult_hi = 0x2360ED051FC65DA4ULL;
+		const uint64_t mult_lo = 0x4385DF649FCCF645ULL;
+
+		uint64_t high;
+		uint64_t low = multiply_128(this->state_lo, mult_lo, high);
+		high += this->state_hi * mult_lo + this->state_lo * mult_hi;
+
+		/* Add the increment with carry from the low half. */
+		this->state_lo = low + this->inc_lo;
+		this->state_hi = high + this->inc_hi + (this->state_lo < low ? 1 : 0);
+	}
+
+public:
+	typedef uint64_t result_type;
+
+	explicit Pcg64(uint64_t seed = 0, uint64_t stream = 0) {
+		this->seed(seed, stream);
+	}
+
+	void seed(uint64_t seed, uint64_t stream = 0) {
+		/* The increment must be odd. */
+		this->inc_hi = stream;
+		this->inc_lo = (0x14057B7EF767814FULL ^ (stream << 1)) | 1;
+		this->state_hi = 0;
+		this->state_lo = 0;
+		this->step();
+		this->state_hi += splitmix64(seed);
+		this->state_lo += splitmix64(seed);
+		this->step();
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	result_type operator()() {
+		this->step();
+		unsigned int rot = (unsigned int)(this->state_hi >> 58);
+		uint64_t xored = this->state_hi ^ this->state_lo;
+		return (xored >> rot) | (xored << ((64 - rot) & 63));
+	}
+};
+
+/*
+ * Philox4x32-10 counter based engine by Salmon et al. Each output block is a
+ * pure function of a key and a 128 bit counter, so any position of any stream
+ * can be produced directly without generating what came before it. This is
+ * the default engine used by the Deck class.
+ *
+ * The key is the 64 bit seed and the upper half of the counter is the stream
+ * index (for example the index of a shoe in a simulation run). The lower half
+ * of the counter is the block position within the stream. Two streams with
+ * the same seed and different indices never overlap.
+ */
+class Philox4x32 {
+private:
+	uint32_t key[2];
+	uint64_t stream;
+	uint64_t block;
+	uint32_t output[4];
+	/* Index of the next unused 64 bit half of the output block. */
+	int output_index;
+
+	static void round(uint32_t counter[4], const uint32_t key[2]) {
+		uint64_t product_0 = (uint64_t)0xD2511F53 * counter[0];
+		uint64_t product_1 = (uint64_t)0xCD9E8D57 * counter[2];
+
+		uint32_t next[4];
+		next[0] = (uint32_t)(product_1 >> 32) ^ counter[1] ^ key[0];
+		next[1] = (uint32_t)product_1;
+		next[2] = (uint32_t)(product_0 >> 32) ^ counter[3] ^ key[1];
+		next[3] = (uint32_t)product_0;
+
+		for (int i = 0; i < 4; i++) {
+			counter[i] = next[i];
+		}
+	}
+
+	/* Run the ten rounds of the cipher on the current counter. */
+	void generate() {
+		uint32_t counter[4] = {
+			(uint32_t)this->block, (uint32_t)(this->block >> 32),
+			(uint32_t)this->stream, (uint32_t)(this->stream >> 32)
+		};
+		uint32_t round_key[2] = { this->key[0], this->key[1] };
+
+		for (int i = 0; i < 10; i++) {
+			if (i > 0) {
+				round_key[0] += 0x9E3779B9;
+				round_key[1] += 0xBB67AE85;
+			}
+			round(counter, round_key);
+		}
+
+		for (int i = 0; i < 4; i++) {
+			this->output[i] = counter[i];
+		}
+	}
+
+public:
+	typedef uint64_t result_type;
+
+	explicit Philox4x32(uint64_t seed = 0, uint64_t stream = 0) {
+		this->seed(seed, stream);
+	}
+
+	/* Select the key and stream and rewind to the start of the stream. */
+	void seed(uint64_t seed, uint64_t stream = 0) {
+		this->key[0] = (uint32_t)seed;
+		this->key[1] = (uint32_t)(seed >> 32);
+		this->stream = stream;
+		this->set_position(0);
+	}
+
+	/* Get the number of values produced since the start of the stream. */
+	uint64_t position() const {
+		return this->block * 2 + (uint64_t)this->output_index;
+	}
+
+	/* Jump to any position in the stream in constant time. */
+	void set_position(uint64_t position) {
+		this->block = position / 2;
+		this->output_index = (int)(position % 2);
+		this->generate();
+	}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return std::numeric_limits<result_type>::max(); }
+
+	result_type operator()() {
+		if (this->output_index == 2) {
+			this->block++;
+			this->output_index = 0;
+			this->generate();
+		}
+
+		int i = 2 * this->output_index++;
+		return ((uint64_t)this->output[i + 1] << 32) | this->output[i];
+	}
+};
+
+/*
+ * Get the number of whole random bits an engine gives per call, that is the
+ * largest b such that the engine can produce every value below 2^b.
+ */
+template <typename Engine>
+constexpr int random_bits_per_call() {
+	uint64_t range = (uint64_t)(Engine::max() - Engine::min());
+	if (range == std::numeric_limits<uint64_t>::max()) {
+		return 64;
+	}
+
+	int bits = 0;
+	while (bits < 63 && ((uint64_t)1 << (bits + 1)) - 1 <= range) {
+		bits++;
+	}
+	return bits;
+}
+
+/*
+ * Get 64 random bits out of any engine. Engines that produce fewer than 64
+ * bits per call (for example std::mt19937, std::minstd_rand or
+ * std::ranlux24) are called as many times as needed. When the range of an
+ * engine is not a power of two, values above the largest power of two that
+ * fits in it are thrown away so every bit stays uniform, the same way
+ * std::uniform_int_distribution does it.
+ *
+ * Parameters:
+ *	engine: The random engine to draw from.
+ *
+ * Return:
+ *	Uniformly distributed 64 bit value.
+ */
+template <typename Engine>
+inline uint64_t random_u64(Engine &engine) {
+	constexpr int bits = random_bits_per_call<Engine>();
+	static_assert(bits > 0, "The engine has to produce at least one random bit per call");
+
+	if constexpr (bits == 64) {
+		return (uint64_t)(engine() - Engine::min());
+	}
+	else {
+		constexpr uint64_t mask = ((uint64_t)1 << bits) - 1;
+		uint64_t result = 0;
+		for (int filled = 0; filled < 64; filled += bits) {
+			uint64_t value;
+			do {
+				value = (uint64_t)(engine() - Engine::min());
+			} while (value > mask);
+			result = (result << bits) | value;
+		}
+		return result;
+	}
+}
+
+/*
+ * Get an unbiased random index in the range [0, bound). This uses Lemire's
+ * multiply and reject method which, unlike rand() % bound, has no modulo bias
+ * and almost never needs a division.
+ *
+ * Parameters:
+ *	engine: The random engine to draw from, see random_u64.
+ *	bound: Exclusive upper bound of the returned value. Must be non-zero.
+ *
+ * Return:
+ *	Random value in the range [0, bound).
+ */
+template <typename Engine>
+inline uint64_t random_index(Engine &engine, uint64_t bound) {
+	uint64_t high;
+	uint64_t low = multiply_128(random_u64(engine), bound, high);
+
+	if (low < bound) {
+		uint64_t threshold = (0 - bound) % bound;
+		while (low < threshold) {
+			low = multiply_128(random_u64(engine), bound, high);
+		}
+	}
+
+	return high;
+}
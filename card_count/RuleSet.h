@@ -0,0 +1,89 @@
+#pragma once
+
+/*
+ * House rules for a game of blackjack. The defaults describe a typical six
+ * deck shoe game.
+ */
+struct RuleSet {
+	/* Number of decks in the shoe. */
+	int deck_count = 6;
+	/* Fraction of the shoe dealt before the cut card comes out. */
+	float penetration = 0.75f;
+	/* True if the dealer hits soft 17 (H17) and false if they stand (S17). */
+	bool dealer_hits_soft_17 = false;
+	/* True if doubling down is allowed after splitting (DAS). */
+	bool double_after_split = true;
+	/* True if aces can be split again after being split (RSA). */
+	bool resplit_aces = false;
+	/* True if late surrender is allowed. */
+	bool late_surrender = false;
+	/* Maximum number of hands a player can have after splitting. */
+	int max_hands = 4;
+	/* Amount a blackjack pays per unit bet. 1.5 for 3:2 and 1.2 for 6:5. */
+	float blackjack_payout = 1.5f;
+};
+
+/*
+ * Rule policies. The rules the innermost hand playing loops check (H17,
+ * DAS, RSA and late surrender) are read through a policy struct so code
+ * that is templated on the policy has them folded in at compile time for
+ * the common rule sets, leaving no rule branches in the loop. Rule sets
+ * without a fixed policy use RuntimeRules, which reads them from the
+ * RuleSet like before. The number of decks and the blackjack payout don't
+ * need a policy since they are only used when a shoe is set up.
+ *
+ * Every policy provides a static function for each rule that is passed the
+ * RuleSet in effect and returns whether the rule applies.
+ */
+
+struct RuntimeRules {
+	static bool dealer_hits_soft_17(const RuleSet &rules) { return rules.dealer_hits_soft_17; }
+	static bool double_after_split(const RuleSet &rules) { return rules.double_after_split; }
+	static bool resplit_aces(const RuleSet &rules) { return rules.resplit_aces; }
+	static bool late_surrender(const RuleSet &rules) { return rules.late_surrender; }
+};
+
+template <bool H17, bool DAS, bool RSA, bool LS>
+struct FixedRules {
+	static constexpr bool dealer_hits_soft_17(const RuleSet &) { return H17; }
+	static constexpr bool double_after_split(const RuleSet &) { return DAS; }
+	static constexpr bool resplit_aces(const RuleSet &) { return RSA; }
+	static constexpr bool late_surrender(const RuleSet &) { return LS; }
+};
+
+/*
+ * The rule sets that get a fixed policy, as H17, DAS, RSA and late
+ * surrender flags. X is called once for every rule set.
+ */
+#define FIXED_RULE_SETS(X) \
+	X(false, true, false, false) \
+	X(true, true, false, false) \
+	X(false, true, false, true) \
+	X(true, true, false, true) \
+	X(false, false, false, false) \
+	X(true, false, false, false)
+
+/*
+ * Call a function with the rule policy for a rule set: a FixedRules for the
+ * common rule sets listed in FIXED_RULE_SETS and RuntimeRules for the rest.
+ *
+ * Parameters:
+ *	rules: The rules in effect.
+ *	function: Generic callable that is passed a default constructed
+ *			  instance of the policy struct, for example
+ *			  [&](auto policy) { run<decltype(policy)>(); }
+ *
+ * Return:
+ *	Whatever the function returns.
+ */
+template <typename Function>
+auto with_rule_policy(const RuleSet &rules, Function &&function) {
+#define RULE_POLICY_CASE(h17, das, rsa, ls) \
+	if (rules.dealer_hits_soft_17 == h17 && rules.double_after_split == das && \
+		rules.resplit_aces == rsa && rules.late_surrender == ls) { \
+		return function(FixedRules<h17, das, rsa, ls>()); \
+	}
+	FIXED_RULE_SETS(RULE_POLICY_CASE)
+#undef RULE_POLICY_CASE
+	return function(RuntimeRules());
+}
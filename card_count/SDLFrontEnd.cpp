@@ -177,10 +177,19 @@ SDLFrontEnd::SDLFrontEnd(Deck &deck) :
 	this->render_ptr = SDL_CreateRenderer(this->window_ptr, -1, SDL_RENDERER_ACCELERATED);
 	SDL_SetRenderDrawColor(this->render_ptr, 0, 0, 0, 255);
 
-	/* Load card textures. */
+	/*
+	 * Load card textures. A multi-deck shoe has several copies of each card
+	 * so skip any card whose texture has already been loaded.
+	 */
 	Card card = deck.draw();
 	while (card.is_valid()) {
-		std::string file_name = "resources/cards_png/" + card.ascii() + ".png";
+		if (this->card_textures[(int)card.get_card_suit()][(int)card.get_card_rank() - 2] != NULL) {
+			deck.discard(card);
+			card = deck.draw();
+			continue;
+		}
+
+		std::string file_name = "resources/cards_png/" + std::string(card.ascii()) + ".png";
 
 		int width, height, channels;
 		unsigned char* image_buffer = stbi_load(file_name.c_str(),
@@ -0,0 +1,352 @@
+#include "ShuffleTest.h"
+
+#include <cmath>
+
+/*
+ * Get the index of a card in a new deck, clubs first and twos first in each
+ * suit.
+ */
+static int card_index(Card card) {
+	return (int)card.get_card_suit() * 13 + (int)card.get_card_rank() - 2;
+}
+
+/*
+ * Constructor for the ShuffleTally class.
+ *
+ * Parameters:
+ *	deck_count: Number of decks in the shuffled deck.
+ */
+ShuffleTally::ShuffleTally(int deck_count) :
+	deck_count(deck_count), positions((size_t)deck_count * 52 * 52, 0),
+	rising(deck_count == 1 ? 53 : 0, 0)
+{
+}
+
+/*
+ * Add the cards of one shuffle, which started from new deck order.
+ *
+ * Parameters:
+ *	cards: The shuffled cards, top card first.
+ *
+ * Return:
+ *	Nothing
+ */
+void ShuffleTally::add(std::span<const Card> cards) {
+	int where[52];
+	int previous = -1;
+	uint64_t same = 0, kept = 0;
+
+	for (size_t i = 0; i < cards.size(); i++) {
+		int card = card_index(cards[i]);
+		this->positions[i * 52 + card]++;
+		if (previous >= 0) {
+			same += (card % 13) == (previous % 13);
+			/* The last card of a new deck is followed by the first card of the next deck. */
+			kept += card == (previous + 1) % 52;
+		}
+		where[card] = (int)i;
+		previous = card;
+	}
+
+	this->same_rank += same;
+	this->same_rank_squares += same * same;
+	this->sequences += kept;
+	this->sequence_squares += kept * kept;
+
+	/*
+	 * A rising sequence is a run of cards in new deck order, 2, 3, 4, that
+	 * are in that order in the shuffled deck but not necessarily next to
+	 * each other. A new sequence starts every time a card comes before the
+	 * card under it in a new deck.
+	 */
+	if (!this->rising.empty()) {
+		int sequences = 1;
+		for (int card = 1; card < 52; card++) {
+			sequences += where[card] < where[card - 1];
+		}
+		this->rising[sequences]++;
+	}
+
+	this->shuffles++;
+}
+
+/*
+ * Add the totals of another tally with the same number of decks.
+ *
+ * Parameters:
+ *	other: Tally to add.
+ *
+ * Return:
+ *	Nothing
+ */
+void ShuffleTally::merge(const ShuffleTally &other) {
+	for (size_t i = 0; i < this->positions.size(); i++) {
+		this->positions[i] += other.positions[i];
+	}
+	for (size_t i = 0; i < this->rising.size(); i++) {
+		this->rising[i] += other.rising[i];
+	}
+	this->same_rank += other.same_rank;
+	this->same_rank_squares += other.same_rank_squares;
+	this->sequences += other.sequences;
+	this->sequence_squares += other.sequence_squares;
+	this->shuffles += other.shuffles;
+}
+
+/*
+ * Get the cards of a deck in new deck order: clubs, diamonds, hearts and
+ * spades, each from two to ace, repeated for every deck.
+ *
+ * Parameters:
+ *	deck_count: Number of decks.
+ *
+ * Return:
+ *	The cards.
+ */
+std::vector<Card> new_deck_order(int deck_count) {
+	std::vector<Card> cards;
+	cards.reserve((size_t)deck_count * 52);
+	for (int deck = 0; deck < deck_count; deck++) {
+		for (int suit = (int)CardSuit::Club; suit < (int)CardSuit::CardSuit_END; suit++) {
+			for (int rank = (int)CardRank::Two; rank <= (int)CardRank::Ace; rank++) {
+				cards.push_back(Card((CardRank)rank, (CardSuit)suit, true));
+			}
+		}
+	}
+	return cards;
+}
+
+/*
+ * Shuffle cards the way Deck used to: pick a card from the unshuffled ones
+ * with rand() % size, erase it from the middle of the unshuffled cards and
+ * append it to the shuffled ones. This takes quadratic time and, since the
+ * 32768 values of rand() don't divide evenly by most sizes, favours some
+ * cards slightly. It is kept for checking the shuffle tests catch its bias.
+ *
+ * Parameters:
+ *	cards: Cards to shuffle, shuffled in place.
+ *	unshuffled: Buffer for the unshuffled cards, so repeated shuffles reuse it.
+ *	random: The rand() to draw from.
+ *
+ * Return:
+ *	Nothing
+ */
+void legacy_shuffle(std::vector<Card> &cards, std::vector<Card> &unshuffled, CRand15 &random) {
+	unshuffled.assign(cards.begin(), cards.end());
+	cards.clear();
+
+	while (!unshuffled.empty()) {
+		size_t index = random() % unshuffled.size();
+		cards.push_back(unshuffled[index]);
+		unshuffled.erase(unshuffled.begin() + index);
+	}
+}
+
+/*
+ * Check the shuffle the deck used to have, rand() % size with the 15 bit
+ * rand() and erasing each picked card, the same way run_shuffle_test checks
+ * Deck::shuffle. Its bias is small: on a single deck the position test
+ * flags it for every seed tried at a hundred million shuffles, the default,
+ * but only for some at ten million.
+ *
+ * Parameters:
+ *	config: Settings for the run.
+ *	progress: Called with the number of shuffles done so far. Optional.
+ *
+ * Return:
+ *	Outcome of each test.
+ */
+ShuffleTestResult run_legacy_shuffle_test(const ShuffleTestConfig &config,
+	const TaskScheduler::ProgressFunction &progress) {
+	std::vector<Card> order = new_deck_order(config.deck_count);
+
+	return run_shuffle_blocks(config, progress, [&](uint64_t seed, uint64_t count, ShuffleTally &tally) {
+		CRand15 random(seed);
+		std::vector<Card> cards, unshuffled;
+
+		for (uint64_t i = 0; i < count; i++) {
+			cards = order;
+			legacy_shuffle(cards, unshuffled, random);
+			tally.add(cards);
+		}
+	});
+}
+
+/*
+ * Get the chance a chi-square variable is at least a value. Every test has
+ * enough degrees of freedom for the Wilson-Hilferty cube root approximation
+ * to be accurate well past the flagging threshold.
+ *
+ * Parameters:
+ *	statistic: Chi-square statistic.
+ *	degrees_of_freedom: Degrees of freedom.
+ *
+ * Return:
+ *	Upper tail probability.
+ */
+double chi_square_p_value(double statistic, double degrees_of_freedom) {
+	double variance = 2.0 / (9.0 * degrees_of_freedom);
+	double z = (std::cbrt(statistic / degrees_of_freedom) - (1.0 - variance)) / std::sqrt(variance);
+	return 0.5 * std::erfc(z / std::sqrt(2.0));
+}
+
+/*
+ * Fill in a test from its p-value. Whether it is biased is decided once
+ * every test is in, by analyze_shuffles.
+ */
+static ShuffleTestOutcome outcome(const char *name, double statistic, double degrees_of_freedom, double p_value) {
+	ShuffleTestOutcome test;
+	test.name = name;
+	test.statistic = statistic;
+	test.degrees_of_freedom = degrees_of_freedom;
+	test.p_value = p_value;
+	return test;
+}
+
+/*
+ * Test the mean of a count taken once per shuffle against its exact
+ * expected value. The shuffles are independent so by the central limit
+ * theorem the mean is normal with the variance seen in the shuffles.
+ */
+static ShuffleTestOutcome z_test(const char *name, uint64_t sum, uint64_t sum_squares, uint64_t shuffles,
+	double expected) {
+	double n = (double)shuffles;
+	double mean = (double)sum / n;
+	double variance = ((double)sum_squares / n - mean * mean) * n / (n - 1.0);
+	if (variance <= 0.0) {
+		/* Every shuffle gave the same count. */
+		return outcome(name, 0.0, 0.0, mean == expected ? 1.0 : 0.0);
+	}
+
+	double z = (mean - expected) / std::sqrt(variance / n);
+	return outcome(name, z, 0.0, std::erfc(std::fabs(z) / std::sqrt(2.0)));
+}
+
+/*
+ * Check a tally of shuffles for bias. The tests are:
+ *
+ *	Position by card: every card should be equally likely to end up at
+ *	every position. This is a chi-square test of the position by card
+ *	table. Each shuffle puts exactly one card at each position, so the
+ *	statistic is scaled by (P - 1) / P for P positions to follow the
+ *	chi-square distribution with (P - 1) * 51 degrees of freedom.
+ *
+ *	Same rank neighbours: the number of neighbouring cards of the same rank
+ *	should average 4 * decks - 1, the chance of a card matching the one
+ *	above it times the number of neighbours.
+ *
+ *	Cards left in sequence: the number of neighbouring cards that are
+ *	still in new deck order should average one per deck. Shuffles that
+ *	don't move cards far enough, like too few riffles, leave more.
+ *
+ *	Rising sequences: the riffle shuffle test of Bayer and Diaconis. For a
+ *	single deck, the number of rising sequences of a uniform shuffle
+ *	follows the Eulerian numbers, which this is a chi-square test against,
+ *	with the tails pooled so every cell expects enough shuffles. With
+ *	several decks, or too few shuffles to pool, it is marked as skipped.
+ *
+ * Parameters:
+ *	tally: Totals of the shuffles.
+ *
+ * Return:
+ *	Outcome of each test. A test flags the shuffle as biased when its
+ *	p-value is below SHUFFLE_TEST_ALPHA divided by the number of tests run,
+ *	so the chance of any false alarm in a run stays below SHUFFLE_TEST_ALPHA.
+ */
+ShuffleTestResult analyze_shuffles(const ShuffleTally &tally) {
+	ShuffleTestResult result;
+	result.shuffles = tally.shuffles;
+	if (tally.shuffles < 2) {
+		return result;
+	}
+
+	double n = (double)tally.shuffles;
+	int cards = tally.deck_count * 52;
+
+	double expected = n / 52.0;
+	double chi_square = 0.0;
+	for (uint64_t count : tally.positions) {
+		double difference = (double)count - expected;
+		chi_square += difference * difference / expected;
+	}
+	chi_square *= (double)(cards - 1) / cards;
+	double degrees = (double)(cards - 1) * 51.0;
+	result.tests.push_back(outcome("Position by card", chi_square, degrees, chi_square_p_value(chi_square, degrees)));
+
+	result.tests.push_back(z_test("Same rank neighbours", tally.same_rank, tally.same_rank_squares,
+		tally.shuffles, 4.0 * tally.deck_count - 1.0));
+	result.tests.push_back(z_test("Cards left in sequence", tally.sequences, tally.sequence_squares,
+		tally.shuffles, (double)tally.deck_count));
+
+	if (!tally.rising.empty()) {
+		/* Chance of k rising sequences in a shuffle of m cards, built up one card at a time. */
+		std::vector<double> chance(53, 0.0);
+		chance[1] = 1.0;
+		for (int m = 2; m <= 52; m++) {
+			for (int k = m; k >= 1; k--) {
+				chance[k] = ((double)k * chance[k] + (double)(m - k + 1) * chance[k - 1]) / m;
+			}
+		}
+
+		/* Pool each tail into its innermost cell that expects enough shuffles. */
+		int low = 1, high = 52;
+		while (low < high && chance[low] * n < SHUFFLE_TEST_MIN_EXPECTED) {
+			low++;
+		}
+		while (high > low && chance[high] * n < SHUFFLE_TEST_MIN_EXPECTED) {
+			high--;
+		}
+
+		chi_square = 0.0;
+		for (int k = low; k <= high; k++) {
+			double cell_chance = 0.0;
+			uint64_t count = 0;
+			for (int j = (k == low ? 1 : k); j <= (k == high ? 52 : k); j++) {
+				cell_chance += chance[j];
+				count += tally.rising[j];
+			}
+			double difference = (double)count - cell_chance * n;
+			chi_square += difference * difference / (cell_chance * n);
+		}
+		degrees = (double)(high - low);
+		if (degrees > 0.0) {
+			result.tests.push_back(outcome("Rising sequences", chi_square, degrees,
+				chi_square_p_value(chi_square, degrees)));
+		}
+	}
+	if (result.tests.back().name != "Rising sequences") {
+		ShuffleTestOutcome skipped;
+		skipped.name = "Rising sequences";
+		skipped.skipped = true;
+		result.tests.push_back(skipped);
+	}
+
+	int run = 0;
+	for (const ShuffleTestOutcome &test : result.tests) {
+		run += !test.skipped;
+	}
+	result.test_alpha = SHUFFLE_TEST_ALPHA / run;
+	for (ShuffleTestOutcome &test : result.tests) {
+		test.biased = !test.skipped && test.p_value < result.test_alpha;
+	}
+
+	return result;
+}
+
+/*
+ * Check if any test flagged the shuffle as biased.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if at least one test failed.
+ */
+bool ShuffleTestResult::biased() const {
+	for (const ShuffleTestOutcome &test : this->tests) {
+		if (test.biased) {
+			return true;
+		}
+	}
+	return false;
+}
@@ -0,0 +1,274 @@
+#pragma once
+
+#include "Deck.h"
+#include "Random.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <random>
+#include <span>
+#include <string>
+#include <string_view>
+#include <vector>
+
+/* Shuffles done by one task. Every task uses its own engine seeded from the test seed and the task index. */
+#define SHUFFLE_TEST_BLOCK 65536
+/*
+ * Chance of flagging an unbiased shuffle as biased in a whole run. This is
+ * split evenly over the tests that are run (the Bonferroni correction), so a
+ * test flags the shuffle when its p-value is below SHUFFLE_TEST_ALPHA divided
+ * by the number of tests.
+ */
+#define SHUFFLE_TEST_ALPHA 0.01
+/* Rising sequence counts are pooled into the tails until every cell expects at least this many shuffles. */
+#define SHUFFLE_TEST_MIN_EXPECTED 20.0
+
+/*
+ * Stand in for the C library rand() the deck used to be shuffled with: the
+ * MSVC linear congruential generator, which only gives 15 bits per call.
+ * legacy_shuffle uses it the way the old shuffle did. Deck::shuffle can use
+ * it too: random_u64 calls it five times for every 64 bits, so the only
+ * weakness left is its short 32 bit state.
+ */
+class CRand15 {
+private:
+	uint32_t state;
+
+public:
+	typedef uint32_t result_type;
+
+	explicit CRand15(uint64_t seed = 0) : state((uint32_t)seed) {}
+
+	static constexpr result_type min() { return 0; }
+	static constexpr result_type max() { return 0x7FFF; }
+
+	result_type operator()() {
+		this->state = this->state * 214013u + 2531011u;
+		return (this->state >> 16) & 0x7FFF;
+	}
+};
+
+/*
+ * Identifiers for the random engines the shuffle tests can be run against.
+ */
+enum class ShuffleEngineId {
+	Philox,
+	Xoshiro,
+	Pcg,
+	Mt19937,
+	Mt19937_64,
+	CRand,
+	/* Not an engine: the old rand() % size shuffle, run with run_legacy_shuffle_test. */
+	Legacy,
+
+	ShuffleEngineId_END
+};
+
+/*
+ * Look up a random engine by name. Names are matched against "philox",
+ * "xoshiro", "pcg", "mt19937", "mt19937_64", "rand" and "legacy".
+ *
+ * Parameters:
+ *	name: Name of the engine.
+ *	id: Set to the matching engine if one is found.
+ *
+ * Return:
+ *	True if the name matched an engine and false otherwise.
+ */
+inline bool shuffle_engine_from_name(std::string_view name, ShuffleEngineId &id) {
+	const std::string_view names[] = { "philox", "xoshiro", "pcg", "mt19937", "mt19937_64", "rand", "legacy" };
+	for (int i = 0; i < (int)ShuffleEngineId::ShuffleEngineId_END; i++) {
+		if (name == names[i]) {
+			id = (ShuffleEngineId)i;
+			return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Call a function with the type of the selected random engine. Legacy
+ * isn't an engine and gets Philox, the same as an unknown id.
+ *
+ * Parameters:
+ *	id: The engine to use.
+ *	function: Generic callable that is passed a default constructed engine,
+ *			  for example [&](auto engine) { run<decltype(engine)>(); }
+ *
+ * Return:
+ *	Whatever the function returns.
+ */
+template <typename Function>
+auto with_shuffle_engine(ShuffleEngineId id, Function &&function) {
+	switch (id) {
+	case ShuffleEngineId::Xoshiro:
+		return function(Xoshiro256StarStar());
+	case ShuffleEngineId::Pcg:
+		return function(Pcg64());
+	case ShuffleEngineId::Mt19937:
+		return function(std::mt19937());
+	case ShuffleEngineId::Mt19937_64:
+		return function(std::mt19937_64());
+	case ShuffleEngineId::CRand:
+		return function(CRand15());
+	case ShuffleEngineId::Philox:
+	default:
+		return function(Philox4x32());
+	}
+}
+
+/*
+ * Settings for a shuffle test run.
+ */
+struct ShuffleTestConfig {
+	/* Number of decks in the shuffled deck. The rising sequence test needs a single deck. */
+	int deck_count = 1;
+	uint64_t shuffles = 100000000;
+	uint64_t seed = 0;
+	/* Number of worker threads. Zero uses one thread per core. */
+	int thread_count = 0;
+};
+
+/*
+ * Running totals of the statistics the tests look at, over a set of
+ * shuffles. Every shuffle starts from the same new deck order, so where a
+ * card ends up only depends on the shuffle.
+ */
+struct ShuffleTally {
+	int deck_count;
+	uint64_t shuffles = 0;
+	/* Times each card, by suit * 13 + rank - 2, ended up at each position, at position * 52 + card. */
+	std::vector<uint64_t> positions;
+	/* Neighbouring cards of the same rank, and the sum of the squares of the count per shuffle. */
+	uint64_t same_rank = 0;
+	uint64_t same_rank_squares = 0;
+	/* Neighbouring cards still in new deck order, and the sum of the squares of the count per shuffle. */
+	uint64_t sequences = 0;
+	uint64_t sequence_squares = 0;
+	/* Shuffles with each number of rising sequences. Only kept for a single deck. */
+	std::vector<uint64_t> rising;
+
+	ShuffleTally(int deck_count);
+
+	void add(std::span<const Card> cards);
+	void merge(const ShuffleTally &other);
+};
+
+/*
+ * Result of one statistical test.
+ */
+struct ShuffleTestOutcome {
+	std::string name;
+	/* Chi-square statistic or z score. */
+	double statistic = 0.0;
+	/* Degrees of freedom of a chi-square test, zero for a z test. */
+	double degrees_of_freedom = 0.0;
+	double p_value = 1.0;
+	bool biased = false;
+	/* True if the test couldn't be run on these shuffles, such as the rising sequence test on several decks. */
+	bool skipped = false;
+};
+
+/*
+ * Results of a shuffle test run.
+ */
+struct ShuffleTestResult {
+	uint64_t shuffles = 0;
+	double seconds = 0.0;
+	std::vector<ShuffleTestOutcome> tests;
+	/* P-value below which a single test flags the shuffle, SHUFFLE_TEST_ALPHA over the tests run. */
+	double test_alpha = SHUFFLE_TEST_ALPHA;
+
+	bool biased() const;
+};
+
+std::vector<Card> new_deck_order(int deck_count);
+void legacy_shuffle(std::vector<Card> &cards, std::vector<Card> &unshuffled, CRand15 &random);
+ShuffleTestResult analyze_shuffles(const ShuffleTally &tally);
+double chi_square_p_value(double statistic, double degrees_of_freedom);
+
+ShuffleTestResult run_legacy_shuffle_test(const ShuffleTestConfig &config,
+	const TaskScheduler::ProgressFunction &progress = nullptr);
+
+/*
+ * Run blocks of shuffles across every core, tally them and check the
+ * tallies for bias. The shuffles are split into blocks that each get their
+ * own seed made from the test seed and the block index, so the tallies, and
+ * with them the results, are the same for any number of threads.
+ *
+ * Parameters:
+ *	config: Settings for the run.
+ *	progress: Called with the number of shuffles done so far. Optional.
+ *	shuffle_block: Called as shuffle_block(seed, count, tally) to do count
+ *				   shuffles from new deck order, seeded with seed, and add
+ *				   each of them to tally.
+ *
+ * Return:
+ *	Outcome of each test.
+ */
+template <typename ShuffleBlock>
+ShuffleTestResult run_shuffle_blocks(const ShuffleTestConfig &config,
+	const TaskScheduler::ProgressFunction &progress, ShuffleBlock &&shuffle_block) {
+	auto start = std::chrono::steady_clock::now();
+	TaskScheduler scheduler(config.thread_count);
+	std::vector<ShuffleTally> tallies(scheduler.worker_count(), ShuffleTally(config.deck_count));
+	uint64_t blocks = (config.shuffles + SHUFFLE_TEST_BLOCK - 1) / SHUFFLE_TEST_BLOCK;
+
+	TaskScheduler::ProgressFunction block_progress = nullptr;
+	if (progress != nullptr) {
+		block_progress = [&](uint64_t completed, uint64_t) {
+			progress(std::min(completed * SHUFFLE_TEST_BLOCK, config.shuffles), config.shuffles);
+		};
+	}
+
+	scheduler.run(blocks, [&](uint64_t block, int worker) {
+		uint64_t state = config.seed ^ (block * 0xD1B54A32D192ED03ULL);
+		uint64_t first = block * SHUFFLE_TEST_BLOCK;
+
+		/* Tallied locally so workers don't share cache lines, then added to the worker's tally. */
+		ShuffleTally tally(config.deck_count);
+		shuffle_block(splitmix64(state), std::min<uint64_t>(SHUFFLE_TEST_BLOCK, config.shuffles - first), tally);
+		tallies[worker].merge(tally);
+	}, block_progress);
+
+	for (size_t i = 1; i < tallies.size(); i++) {
+		tallies[0].merge(tallies[i]);
+	}
+	ShuffleTestResult result = analyze_shuffles(tallies[0]);
+	result.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	return result;
+}
+
+/*
+ * Shuffle a deck over and over with a random engine and check the results
+ * for bias. Every shuffle starts from new deck order and goes through
+ * Deck::shuffle, with an engine of its block's own seed.
+ *
+ * Parameters:
+ *	config: Settings for the run.
+ *	progress: Called with the number of shuffles done so far. Optional.
+ *
+ * Return:
+ *	Outcome of each test.
+ */
+template <typename Engine>
+ShuffleTestResult run_shuffle_test(const ShuffleTestConfig &config,
+	const TaskScheduler::ProgressFunction &progress = nullptr) {
+	std::vector<Card> order = new_deck_order(config.deck_count);
+
+	return run_shuffle_blocks(config, progress, [&](uint64_t seed, uint64_t count, ShuffleTally &tally) {
+		Engine engine(seed);
+		Deck deck(config.deck_count);
+		std::vector<Card> cards(order.size());
+		deck.draw_n(cards);
+
+		for (uint64_t i = 0; i < count; i++) {
+			deck.discard_n(order);
+			deck.shuffle(engine);
+			deck.draw_n(cards);
+			tally.add(cards);
+		}
+	});
+}
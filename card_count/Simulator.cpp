@@ -0,0 +1,989 @@
+#include "Simulator.h"
+#include "Checkpoint.h"
+#include "HandRecords.h"
+#include "Hand.h"
+#include "BasicStrategy.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <memory>
+#include <vector>
+
+/*
+ * Add the result of one round to the totals.
+ *
+ * Parameters:
+ *	round_units: Amount won or lost on the round in tenths of a unit.
+ *
+ * Return:
+ *	Nothing
+ */
+void RoundTotals::add(int64_t round_units) {
+	this->rounds++;
+	this->units += round_units;
+	this->squared_units += round_units * round_units;
+}
+
+/*
+ * Combine another set of totals into this one.
+ *
+ * Parameters:
+ *	other: Totals to add in.
+ *
+ * Return:
+ *	Nothing
+ */
+void RoundTotals::merge(const RoundTotals &other) {
+	this->rounds += other.rounds;
+	this->units += other.units;
+	this->squared_units += other.squared_units;
+}
+
+/*
+ * Get the average result per round.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Mean units won per round. Zero if no rounds were played.
+ */
+double RoundTotals::mean() const {
+	if (this->rounds == 0) {
+		return 0.0;
+	}
+	return (double)this->units / SIM_UNIT_SCALE / (double)this->rounds;
+}
+
+/*
+ * Get the variance of the result of a round.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Variance in squared units. Zero if fewer than two rounds were played.
+ */
+double RoundTotals::variance() const {
+	if (this->rounds < 2) {
+		return 0.0;
+	}
+	double n = (double)this->rounds;
+	double mean = (double)this->units / SIM_UNIT_SCALE / n;
+	double mean_square = (double)this->squared_units / (SIM_UNIT_SCALE * SIM_UNIT_SCALE) / n;
+	return (mean_square - mean * mean) * n / (n - 1.0);
+}
+
+/*
+ * Combine the results of another run into this one. Elapsed time is not
+ * combined since runs on different threads overlap.
+ *
+ * Parameters:
+ *	other: Results to add in.
+ *
+ * Return:
+ *	Nothing
+ */
+void SimulationResult::merge(const SimulationResult &other) {
+	this->shoes += other.shoes;
+	this->hands += other.hands;
+	this->totals.merge(other.totals);
+	for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+		this->true_counts[i].merge(other.true_counts[i]);
+	}
+	this->shoe_totals.merge(other.shoe_totals);
+	this->pair_totals.merge(other.pair_totals);
+}
+
+/*
+ * Get the expected value of a round.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Average units won per round, as a fraction of the initial bet.
+ */
+double SimulationResult::ev() const {
+	return this->totals.mean();
+}
+
+/*
+ * Get the variance of a round.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Variance of the units won per round.
+ */
+double SimulationResult::variance() const {
+	return this->totals.variance();
+}
+
+/*
+ * Get how much antithetic pairing cut the variance: the variance of two
+ * independent shoes over the variance of a pair of shoes. One if there are
+ * too few pairs to tell.
+ */
+static double antithetic_variance_reduction(const RoundTotals &shoe_totals, const RoundTotals &pair_totals) {
+	if (pair_totals.rounds < 2 || pair_totals.variance() <= 0.0) {
+		return 1.0;
+	}
+	return 2.0 * shoe_totals.variance() / pair_totals.variance();
+}
+
+/*
+ * Get the standard error of the expected value.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Standard error of the average units won per round, taking the variance
+ *	reduction of antithetic runs into account.
+ */
+double SimulationResult::standard_error() const {
+	if (this->totals.rounds == 0) {
+		return 0.0;
+	}
+	return std::sqrt(this->variance() / (double)this->totals.rounds / this->variance_reduction());
+}
+
+/*
+ * Get how much antithetic pairing cut the variance of the results: the
+ * variance of two independent shoes over the variance of a pair of shoes.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	The factor the variance was cut by. One if the run wasn't antithetic or
+ *	had too few pairs to tell.
+ */
+double SimulationResult::variance_reduction() const {
+	return antithetic_variance_reduction(this->shoe_totals, this->pair_totals);
+}
+
+/*
+ * Get the number of rounds played per second of wall clock time.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Rounds per second. Zero if no time was recorded.
+ */
+double SimulationResult::rounds_per_second() const {
+	if (this->seconds <= 0.0) {
+		return 0.0;
+	}
+	return (double)this->totals.rounds / this->seconds;
+}
+
+/*
+ * Get the index of the true count bucket for a running count.
+ *
+ * Parameters:
+ *	running_count: Running count in units of the system's scale.
+ *	scale: Scale of the counting system.
+ *	cards_remaining: Number of cards left to be dealt.
+ *
+ * Return:
+ *	Index into SimulationResult::true_counts. The true count is rounded down
+ *	and clamped to [TRUE_COUNT_MIN, TRUE_COUNT_MAX].
+ */
+int true_count_bucket(int running_count, int scale, int cards_remaining) {
+	if (cards_remaining < 1) {
+		cards_remaining = 1;
+	}
+	int true_count = (int)std::floor((double)running_count * 52.0 / ((double)scale * cards_remaining));
+
+	if (true_count < TRUE_COUNT_MIN) {
+		true_count = TRUE_COUNT_MIN;
+	}
+	else if (true_count > TRUE_COUNT_MAX) {
+		true_count = TRUE_COUNT_MAX;
+	}
+	return true_count - TRUE_COUNT_MIN;
+}
+
+/*
+ * Plays blackjack rounds from a shoe using basic strategy, either from the
+ * built in charts or from a strategy table. The player is templated on the
+ * counting system so keeping the running count costs a single table lookup
+ * per card, and on a rule policy (see with_rule_policy) so the common rule
+ * sets have no rule checks left in the hand playing loop.
+ */
+template <typename System, typename Rules = RuntimeRules>
+class ShoePlayer
+{
+private:
+	const RuleSet &rules;
+	const StrategyTable *strategy;
+	Shoe shoe;
+	int running_count;
+	int64_t blackjack_units;
+	/* Every card dealt in the current round so they can be discarded together. */
+	Card round_cards[128];
+	size_t round_card_count;
+	/* Buffer to record every hand to, or null, and the shoe column of the current shoe's records. */
+	HandRecordBuffer *records;
+	uint64_t record_shoe;
+
+	Card draw();
+	int64_t play_round(int bucket, SimulationResult &result);
+
+public:
+	ShoePlayer(const RuleSet &rules, const StrategyTable *strategy, uint64_t seed,
+		HandRecordBuffer *records = nullptr);
+	int64_t play_shoe(uint64_t shoe_index, bool antithetic, SimulationResult &result);
+};
+
+/*
+ * Constructor for the ShoePlayer class.
+ *
+ * Parameters:
+ *	rules: House rules to play by.
+ *	strategy: Strategy to play, or null for the built in charts.
+ *	seed: Seed for the shoe shuffles.
+ *	records: Buffer to record every hand played to, or null to not record them.
+ */
+template <typename System, typename Rules>
+ShoePlayer<System, Rules>::ShoePlayer(const RuleSet &rules, const StrategyTable *strategy, uint64_t seed,
+	HandRecordBuffer *records) :
+	rules(rules), strategy(strategy), shoe(rules.deck_count, rules.penetration), running_count(0),
+	blackjack_units((int64_t)std::lround(rules.blackjack_payout * SIM_UNIT_SCALE)),
+	round_card_count(0), records(records), record_shoe(0)
+{
+	this->shoe.seed(seed);
+}
+
+/*
+ * Draw a card for the current round and count it. If the shoe runs out in
+ * the middle of a round the discards are shuffled back in and the count
+ * starts over.
+ */
+template <typename System, typename Rules>
+Card ShoePlayer<System, Rules>::draw() {
+	Card card = this->shoe.draw();
+	if (!card.is_valid()) {
+		this->shoe.shuffle();
+		this->running_count = initial_running_count<System>(this->rules.deck_count);
+		card = this->shoe.draw();
+	}
+
+	this->running_count += count_value<System>(card);
+	this->round_cards[this->round_card_count++] = card;
+	return card;
+}
+
+/*
+ * Play a full shoe, from the shuffle until the cut card comes out.
+ *
+ * Parameters:
+ *	shoe_index: Index of the shuffle to deal.
+ *	antithetic: True to deal the antithetic shoe of the shuffle.
+ *	result: Results to add the rounds of the shoe to.
+ *
+ * Return:
+ *	Units won or lost on the shoe in tenths of a unit.
+ */
+template <typename System, typename Rules>
+int64_t ShoePlayer<System, Rules>::play_shoe(uint64_t shoe_index, bool antithetic, SimulationResult &result) {
+	this->shoe.start_shoe(shoe_index, antithetic);
+	this->running_count = initial_running_count<System>(this->rules.deck_count);
+	this->record_shoe = antithetic ? shoe_index | HAND_RECORD_ANTITHETIC_SHOE : shoe_index;
+	int64_t shoe_units = 0;
+
+	while (!this->shoe.cut_card_reached()) {
+		int bucket = true_count_bucket(this->running_count, System::scale, this->shoe.shuffeled_card_count());
+		int64_t units = this->play_round(bucket, result);
+
+		result.totals.add(units);
+		result.true_counts[bucket].add(units);
+		shoe_units += units;
+	}
+	result.shoes++;
+	result.shoe_totals.add(shoe_units);
+
+	return shoe_units;
+}
+
+/*
+ * Play a single round with a one unit bet.
+ *
+ * Parameters:
+ *	bucket: True count bucket the round starts in, for the hand records.
+ *	result: Results to add the number of hands played to.
+ *
+ * Return:
+ *	Units won or lost on the round in tenths of a unit.
+ */
+template <typename System, typename Rules>
+int64_t ShoePlayer<System, Rules>::play_round(int bucket, SimulationResult &result) {
+	const RuleSet &rules = this->rules;
+	Hand hands[8];
+	int bets[8];
+	bool split_aces[8];
+	bool surrendered[8];
+	uint8_t decisions[8];
+	int hand_count = 1;
+	int64_t units = 0;
+
+	this->round_card_count = 0;
+
+	/* Deal the player two cards and the dealer an upcard and a hole card. */
+	Hand dealer;
+	hands[0].add(this->draw());
+	Card upcard = this->draw();
+	dealer.add(upcard);
+	hands[0].add(this->draw());
+	dealer.add(this->draw());
+	int upcard_value = upcard.get_numeric_value();
+
+	bets[0] = 1;
+	split_aces[0] = false;
+	surrendered[0] = false;
+	decisions[0] = 0;
+
+	HandRecord record;
+	record.shoe = this->record_shoe;
+	record.true_count = (int8_t)(bucket + TRUE_COUNT_MIN);
+
+	/* The dealer peeks for blackjack so a dealer blackjack ends the round right away. */
+	if (dealer.is_blackjack()) {
+		units = hands[0].is_blackjack() ? 0 : -SIM_UNIT_SCALE;
+		if (this->records != nullptr) {
+			record.bet = 1;
+			record.outcome = units == 0 ? HandOutcome::Push : HandOutcome::Loss;
+			record.decisions = 0;
+			record.units = (int16_t)units;
+			this->records->add(record);
+		}
+	}
+	else if (hands[0].is_blackjack()) {
+		units = this->blackjack_units;
+		if (this->records != nullptr) {
+			record.bet = 1;
+			record.outcome = HandOutcome::Blackjack;
+			record.decisions = 0;
+			record.units = (int16_t)units;
+			this->records->add(record);
+		}
+	}
+	else {
+		int max_hands = rules.max_hands < 8 ? rules.max_hands : 8;
+
+		for (int h = 0; h < hand_count; h++) {
+			while (true) {
+				Hand &hand = hands[h];
+				bool has_split = hand_count > 1;
+
+				if (hand.total() >= 21) {
+					break;
+				}
+
+				bool can_split = hand.is_pair() && hand_count < max_hands &&
+					(!split_aces[h] || Rules::resplit_aces(rules));
+				/* Split aces only get one card unless they can be split again. */
+				if (split_aces[h] && !can_split) {
+					break;
+				}
+				bool can_double = hand.size() == 2 && !split_aces[h] &&
+					(!has_split || Rules::double_after_split(rules));
+				bool can_surrender = hand.size() == 2 && !has_split;
+
+				PlayerAction action = this->strategy ?
+					table_strategy<Rules>(*this->strategy, hand, upcard_value, rules, can_double, can_split, can_surrender) :
+					basic_strategy<Rules>(hand, upcard_value, rules, can_double, can_split, can_surrender);
+				if (split_aces[h] && action != PlayerAction::Split) {
+					break;
+				}
+
+				if (action == PlayerAction::Hit) {
+					decisions[h] |= HAND_DECISION_HIT;
+					hand.add(this->draw());
+				}
+				else if (action == PlayerAction::Double) {
+					decisions[h] |= HAND_DECISION_DOUBLE;
+					bets[h] = 2;
+					hand.add(this->draw());
+					break;
+				}
+				else if (action == PlayerAction::Split) {
+					bool aces = hand.pair_value() == 11;
+					Hand &new_hand = hands[hand_count];
+
+					new_hand = Hand();
+					new_hand.add(hand.split());
+					bets[hand_count] = 1;
+					split_aces[h] = aces;
+					split_aces[hand_count] = aces;
+					surrendered[hand_count] = false;
+					decisions[h] |= HAND_DECISION_SPLIT;
+					decisions[hand_count] = decisions[h];
+					hand_count++;
+
+					hand.add(this->draw());
+					new_hand.add(this->draw());
+				}
+				else if (action == PlayerAction::Surrender) {
+					decisions[h] |= HAND_DECISION_SURRENDER;
+					surrendered[h] = true;
+					break;
+				}
+				else {
+					decisions[h] |= HAND_DECISION_STAND;
+					break;
+				}
+			}
+		}
+
+		/* The dealer only needs to play if some hand is still live. */
+		bool dealer_plays = false;
+		for (int h = 0; h < hand_count; h++) {
+			if (!hands[h].is_bust() && !surrendered[h]) {
+				dealer_plays = true;
+			}
+		}
+		if (dealer_plays) {
+			while (dealer.total() < 17 ||
+				(Rules::dealer_hits_soft_17(rules) && dealer.total() == 17 && dealer.is_soft())) {
+				dealer.add(this->draw());
+			}
+		}
+
+		/* Settle every hand. */
+		for (int h = 0; h < hand_count; h++) {
+			int64_t bet = bets[h] * SIM_UNIT_SCALE;
+			int64_t hand_units = 0;
+			HandOutcome outcome = HandOutcome::Push;
+
+			if (surrendered[h]) {
+				hand_units = -SIM_UNIT_SCALE / 2;
+				outcome = HandOutcome::Surrender;
+			}
+			else if (hands[h].is_bust()) {
+				hand_units = -bet;
+				outcome = HandOutcome::Bust;
+			}
+			else if (dealer.is_bust() || hands[h].total() > dealer.total()) {
+				hand_units = bet;
+				outcome = HandOutcome::Win;
+			}
+			else if (hands[h].total() < dealer.total()) {
+				hand_units = -bet;
+				outcome = HandOutcome::Loss;
+			}
+			units += hand_units;
+
+			if (this->records != nullptr) {
+				record.bet = (uint8_t)bets[h];
+				record.outcome = outcome;
+				record.decisions = decisions[h];
+				record.units = (int16_t)hand_units;
+				this->records->add(record);
+			}
+		}
+	}
+
+	result.hands += hand_count;
+	this->shoe.discard_n(std::span<const Card>(this->round_cards, this->round_card_count));
+
+	return units;
+}
+
+/*
+ * Play the shoes of one task of a run: a single shoe, or a shoe and its
+ * antithetic shoe in antithetic runs.
+ *
+ * Parameters:
+ *	player: Player to play the shoes with.
+ *	config: Settings that pick the shoes, which are the first shoe and the
+ *			shuffle mode.
+ *	task: Index of the task in the run.
+ *	result: Results to add the rounds of the shoes to.
+ *
+ * Return:
+ *	Units won or lost on the shoes in tenths of a unit.
+ */
+template <typename Player>
+static int64_t play_task(Player &player, const SimulationConfig &config, uint64_t task, SimulationResult &result) {
+	if (config.shuffle_mode == ShuffleMode::Antithetic) {
+		uint64_t shoe_index = config.first_shoe + 2 * task;
+		int64_t units = player.play_shoe(shoe_index, false, result) + player.play_shoe(shoe_index, true, result);
+		result.pair_totals.add(units);
+		return units;
+	}
+	return player.play_shoe(config.first_shoe + task, false, result);
+}
+
+/*
+ * Get the number of tasks in a run, one per shoe or one per pair of shoes in
+ * antithetic runs.
+ */
+static uint64_t task_count(const SimulationConfig &config) {
+	if (config.shuffle_mode == ShuffleMode::Antithetic) {
+		return (config.shoe_count + 1) / 2;
+	}
+	return config.shoe_count;
+}
+
+/*
+ * Get the settings for one shard of a run split over several processes.
+ * Each shard plays its own range of shoes, and since every shoe is shuffled
+ * from the stream of its index, the shards together play exactly the shoes
+ * of the whole run. Antithetic pairs are never split between shards.
+ *
+ * Parameters:
+ *	config: Settings for the whole run.
+ *	shard: Index of the shard, from 0 to shard_count - 1.
+ *	shard_count: Number of shards the run is split into.
+ *
+ * Return:
+ *	Settings for the shard, which are those of the run with its own range
+ *	of shoes and its place among the shards.
+ */
+SimulationConfig shard_config(const SimulationConfig &config, int shard, int shard_count) {
+	uint64_t shoes_per_task = config.shuffle_mode == ShuffleMode::Antithetic ? 2 : 1;
+	uint64_t tasks = task_count(config);
+	/* Split the tasks as evenly as possible without overflowing on huge runs. */
+	uint64_t base = tasks / shard_count;
+	uint64_t extra = tasks % shard_count;
+	uint64_t first_task = base * shard + std::min((uint64_t)shard, extra);
+	uint64_t shard_tasks = base + ((uint64_t)shard < extra ? 1 : 0);
+
+	SimulationConfig result = config;
+	result.first_shoe = config.first_shoe + first_task * shoes_per_task;
+	result.shoe_count = shard_tasks * shoes_per_task;
+	result.shard = shard;
+	result.shard_count = shard_count;
+	result.run_first_shoe = config.first_shoe;
+	result.run_shoe_count = tasks * shoes_per_task;
+	return result;
+}
+
+/*
+ * Wrap a progress function so it is passed numbers of shoes rather than
+ * numbers of tasks.
+ */
+static TaskScheduler::ProgressFunction shoe_progress(const SimulationConfig &config,
+	const TaskScheduler::ProgressFunction &progress) {
+	if (!progress || config.shuffle_mode != ShuffleMode::Antithetic) {
+		return progress;
+	}
+	return [progress](uint64_t completed, uint64_t total) {
+		progress(2 * completed, 2 * total);
+	};
+}
+
+/*
+ * One set of round totals as published by a worker.
+ */
+struct PublishedRoundTotals {
+	std::atomic<uint64_t> rounds{ 0 };
+	std::atomic<int64_t> units{ 0 };
+	std::atomic<int64_t> squared_units{ 0 };
+
+	void store(const RoundTotals &totals) {
+		this->rounds.store(totals.rounds, std::memory_order_relaxed);
+		this->units.store(totals.units, std::memory_order_relaxed);
+		this->squared_units.store(totals.squared_units, std::memory_order_relaxed);
+	}
+
+	void add_to(RoundTotals &totals) const {
+		totals.rounds += this->rounds.load(std::memory_order_relaxed);
+		totals.units += this->units.load(std::memory_order_relaxed);
+		totals.squared_units += this->squared_units.load(std::memory_order_relaxed);
+	}
+};
+
+/*
+ * Running totals a worker publishes after every task for progress reports.
+ * Only the owning worker writes them, every worker's totals are on their own
+ * cache line and a report doesn't need them to agree with each other, so
+ * relaxed atomics are enough and the workers never wait on anything.
+ */
+struct alignas(64) PublishedTotals {
+	std::atomic<uint64_t> shoes{ 0 };
+	std::atomic<uint64_t> hands{ 0 };
+	PublishedRoundTotals totals;
+	/* Shoe and pair totals, so progress reports take antithetic pairing into account. */
+	PublishedRoundTotals shoe_totals;
+	PublishedRoundTotals pair_totals;
+};
+
+/*
+ * Copy a worker's results into its published totals.
+ */
+static void publish_totals(const SimulationResult &result, PublishedTotals &totals) {
+	totals.shoes.store(result.shoes, std::memory_order_relaxed);
+	totals.hands.store(result.hands, std::memory_order_relaxed);
+	totals.totals.store(result.totals);
+	totals.shoe_totals.store(result.shoe_totals);
+	totals.pair_totals.store(result.pair_totals);
+}
+
+/*
+ * Run a simulation. Every shoe, or pair of shoes in antithetic runs, is a
+ * task on the work stealing scheduler and every worker keeps its own shoe
+ * and results which are merged at the end.
+ * Since every shoe's shuffle only depends on the seed and the shoe index and
+ * the results are summed exactly, the results are the same no matter how
+ * many threads are used or which worker ends up playing which shoe.
+ *
+ * With a target standard error the shoes are played in blocks. After each
+ * block the results are merged and, if the target hasn't been met, the next
+ * block is sized from how many more shoes the standard error says are
+ * needed. Blocks always end on the same shoes for the same results so early
+ * stopping doesn't make the results depend on the number of threads either.
+ *
+ * With a checkpoint file the blocks are further split into pieces of about
+ * checkpoint_seconds each and a checkpoint is handed to a CheckpointWriter
+ * after every piece. Pieces don't change which shoes the standard error is
+ * checked after, so a run that is stopped and resumed from its checkpoint
+ * gives the same results as one that never stopped. The last checkpoint is
+ * written before returning and checkpoint_failed is set in the result if
+ * any checkpoint couldn't be written.
+ *
+ * With a hand record writer every worker buffers the hands it plays and
+ * writes them out a chunk at a time.
+ *
+ * Parameters:
+ *	config: Settings for the run.
+ *	progress: Optional function called periodically from the calling thread
+ *			  with a snapshot of the run so far.
+ *
+ * Return:
+ *	Combined results of every shoe played, including the shoes of the
+ *	checkpoint the run was resumed from.
+ */
+SimulationResult run_simulation(const SimulationConfig &config, const SimulationProgressFunction &progress) {
+	TaskScheduler scheduler(config.thread_count);
+	std::vector<SimulationResult> worker_results(scheduler.worker_count());
+	std::unique_ptr<PublishedTotals[]> published(new PublishedTotals[scheduler.worker_count()]);
+	SimulationResult result;
+
+	auto start = std::chrono::steady_clock::now();
+
+	uint64_t shoes_per_task = config.shuffle_mode == ShuffleMode::Antithetic ? 2 : 1;
+	uint64_t max_tasks = task_count(config);
+	uint64_t min_check_tasks = (SIM_MIN_CHECK_SHOES + shoes_per_task - 1) / shoes_per_task;
+	uint64_t planned_tasks = max_tasks;
+	if (config.target_standard_error > 0.0) {
+		planned_tasks = std::min(max_tasks, min_check_tasks);
+	}
+
+	uint64_t done_tasks = 0;
+	double previous_seconds = 0.0;
+	if (config.resume != nullptr) {
+		/* The shoes of the checkpoint count as if the first worker had played them. */
+		worker_results[0] = config.resume->result;
+		publish_totals(worker_results[0], published[0]);
+		done_tasks = config.resume->done_tasks;
+		planned_tasks = config.resume->planned_tasks;
+		previous_seconds = config.resume->result.seconds;
+		result = config.resume->result;
+	}
+
+	std::unique_ptr<CheckpointWriter> writer;
+	SimulationCheckpoint checkpoint;
+	uint64_t checkpoint_tasks = max_tasks;
+	if (config.checkpoint_path != nullptr) {
+		writer.reset(new CheckpointWriter(config.checkpoint_path));
+		checkpoint.config_hash = checkpoint_config_hash(config);
+		checkpoint.seed = config.seed;
+		checkpoint.first_shoe = config.first_shoe;
+		checkpoint.shoe_count = config.shoe_count;
+		checkpoint.shard = config.shard;
+		checkpoint.shard_count = config.shard_count;
+		checkpoint_run_range(config, checkpoint.run_first_shoe, checkpoint.run_shoe_count);
+		checkpoint_tasks = min_check_tasks;
+	}
+
+	TaskScheduler::ProgressFunction report;
+	if (progress) {
+		report = [&](uint64_t, uint64_t) {
+			SimulationProgress snapshot;
+			for (int w = 0; w < scheduler.worker_count(); w++) {
+				const PublishedTotals &totals = published[w];
+				snapshot.shoes += totals.shoes.load(std::memory_order_relaxed);
+				snapshot.hands += totals.hands.load(std::memory_order_relaxed);
+				totals.totals.add_to(snapshot.totals);
+				totals.shoe_totals.add_to(snapshot.shoe_totals);
+				totals.pair_totals.add_to(snapshot.pair_totals);
+			}
+			snapshot.planned_shoes = planned_tasks * shoes_per_task;
+			snapshot.seconds = previous_seconds +
+				std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+			progress(snapshot);
+		};
+	}
+
+	auto simulate = [&](auto system, auto policy) {
+		typedef ShoePlayer<decltype(system), decltype(policy)> Player;
+
+		std::vector<std::unique_ptr<HandRecordBuffer>> records;
+		std::vector<std::unique_ptr<Player>> players;
+		for (int w = 0; w < scheduler.worker_count(); w++) {
+			HandRecordBuffer *buffer = nullptr;
+			if (config.hand_records != nullptr) {
+				buffer = new HandRecordBuffer(config.hand_records);
+				records.emplace_back(buffer);
+			}
+			players.emplace_back(new Player(config.rules, config.strategy, config.seed, buffer));
+		}
+
+		while (done_tasks < planned_tasks) {
+			uint64_t first_task = done_tasks;
+			uint64_t block_tasks = std::min(planned_tasks - done_tasks, checkpoint_tasks);
+			auto block_start = std::chrono::steady_clock::now();
+			scheduler.run(block_tasks, [&](uint64_t task, int worker) {
+				SimulationResult &worker_result = worker_results[worker];
+				play_task(*players[worker], config, first_task + task, worker_result);
+				publish_totals(worker_result, published[worker]);
+			}, report);
+			done_tasks += block_tasks;
+
+			result = SimulationResult();
+			for (const SimulationResult &worker_result : worker_results) {
+				result.merge(worker_result);
+			}
+
+			if (done_tasks == planned_tasks && config.target_standard_error > 0.0) {
+				double error = result.standard_error();
+				if (error > config.target_standard_error) {
+					/* The standard error shrinks with the square root of the number of shoes. */
+					double ratio = error / config.target_standard_error;
+					uint64_t needed_tasks = (uint64_t)((double)done_tasks * ratio * ratio * SIM_PLAN_MARGIN);
+					planned_tasks = std::min(max_tasks, std::max(needed_tasks, done_tasks + min_check_tasks));
+				}
+			}
+
+			if (writer) {
+				auto now = std::chrono::steady_clock::now();
+				checkpoint.done_tasks = done_tasks;
+				checkpoint.planned_tasks = planned_tasks;
+				checkpoint.result = result;
+				checkpoint.result.seconds = previous_seconds + std::chrono::duration<double>(now - start).count();
+				writer->submit(checkpoint);
+
+				/* Size the next piece from how fast this one went. */
+				double block_seconds = std::chrono::duration<double>(now - block_start).count();
+				if (block_seconds > 0.0) {
+					double tasks = (double)block_tasks / block_seconds * config.checkpoint_seconds;
+					checkpoint_tasks = std::max(min_check_tasks, (uint64_t)std::min(tasks, (double)max_tasks));
+				}
+			}
+		}
+	};
+
+	with_counting_system(config.counting_system, [&](auto system) {
+		if (config.specialize_rules) {
+			with_rule_policy(config.rules, [&](auto policy) { simulate(system, policy); });
+		}
+		else {
+			simulate(system, RuntimeRules());
+		}
+	});
+
+	result.seconds = previous_seconds + std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (writer && !writer->flush()) {
+		result.checkpoint_failed = true;
+	}
+
+	return result;
+}
+
+/*
+ * Get the standard error of the expected value so far.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Standard error of the average units won per round, worked out the same
+ *	way as SimulationResult::standard_error, which the run stops on.
+ */
+double SimulationProgress::standard_error() const {
+	if (this->totals.rounds == 0) {
+		return 0.0;
+	}
+	return std::sqrt(this->totals.variance() / (double)this->totals.rounds /
+		antithetic_variance_reduction(this->shoe_totals, this->pair_totals));
+}
+
+/*
+ * Get the number of player hands played per second so far.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Hands per second. Zero if no time has passed.
+ */
+double SimulationProgress::hands_per_second() const {
+	if (this->seconds <= 0.0) {
+		return 0.0;
+	}
+	return (double)this->hands / this->seconds;
+}
+
+/*
+ * Estimate the time left until the planned shoes have been played.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Seconds left at the rate so far. Zero if no shoes have been played.
+ */
+double SimulationProgress::seconds_left() const {
+	if (this->shoes == 0 || this->planned_shoes <= this->shoes) {
+		return 0.0;
+	}
+	return this->seconds * (double)(this->planned_shoes - this->shoes) / (double)this->shoes;
+}
+
+/*
+ * Get the difference in expected value between the two configurations.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Expected value per round of the first configuration minus the second.
+ */
+double ComparisonResult::difference() const {
+	return this->first.ev() - this->second.ev();
+}
+
+/*
+ * Get the average number of rounds the two configurations played per entry
+ * of the differences, to turn differences per shoe into differences per
+ * round.
+ */
+static double rounds_per_difference(const ComparisonResult &result) {
+	if (result.differences.rounds == 0) {
+		return 1.0;
+	}
+	return (double)(result.first.totals.rounds + result.second.totals.rounds) / (2.0 * (double)result.differences.rounds);
+}
+
+/*
+ * Get the standard error of the difference in expected value, measured from
+ * how much the difference varied from shoe to shoe.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Standard error of the difference per round.
+ */
+double ComparisonResult::standard_error() const {
+	if (this->differences.rounds == 0) {
+		return 0.0;
+	}
+	return std::sqrt(this->differences.variance() / (double)this->differences.rounds) / rounds_per_difference(*this);
+}
+
+/*
+ * Get the standard error the difference would have had if the two
+ * configurations had been run on independent shoes.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Standard error of the difference per round for independent runs.
+ */
+double ComparisonResult::independent_standard_error() const {
+	if (this->differences.rounds == 0) {
+		return 0.0;
+	}
+	double shoes = (double)this->first.shoes / (double)this->differences.rounds;
+	double variance = shoes * (this->first.shoe_totals.variance() + this->second.shoe_totals.variance());
+	return std::sqrt(variance / (double)this->differences.rounds) / rounds_per_difference(*this);
+}
+
+/*
+ * Get how much playing both configurations on the same shuffles, and pairing
+ * shoes in antithetic runs, cut the variance of the difference compared to
+ * independent runs. This is also how many times fewer rounds were needed for
+ * the same precision.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	The factor the variance was cut by. Infinite if the two configurations
+ *	played every shoe the same and one if nothing was played.
+ */
+double ComparisonResult::variance_reduction() const {
+	double error = this->standard_error();
+	double independent_error = this->independent_standard_error();
+	if (error <= 0.0) {
+		return independent_error > 0.0 ? std::numeric_limits<double>::infinity() : 1.0;
+	}
+	return independent_error * independent_error / (error * error);
+}
+
+/*
+ * Play two configurations on the same shuffles. Every task plays its shoes
+ * with both configurations on the same worker so the difference of each shoe
+ * can be recorded. The shoes, seed, thread count and shuffle mode all come
+ * from the first configuration. As with run_simulation the results don't
+ * depend on the number of threads.
+ *
+ * Parameters:
+ *	first, second: The configurations to compare.
+ *	progress: Optional function called periodically from the calling thread
+ *			  with the number of shoes played so far.
+ *
+ * Return:
+ *	Results of both configurations and of the difference between them.
+ */
+ComparisonResult run_comparison(const SimulationConfig &first, const SimulationConfig &second,
+	const TaskScheduler::ProgressFunction &progress) {
+	TaskScheduler scheduler(first.thread_count);
+	std::vector<SimulationResult> first_results(scheduler.worker_count());
+	std::vector<SimulationResult> second_results(scheduler.worker_count());
+	std::vector<RoundTotals> differences(scheduler.worker_count());
+
+	auto start = std::chrono::steady_clock::now();
+
+	with_counting_system(first.counting_system, [&](auto first_system) {
+		with_counting_system(second.counting_system, [&](auto second_system) {
+			typedef ShoePlayer<decltype(first_system)> FirstPlayer;
+			typedef ShoePlayer<decltype(second_system)> SecondPlayer;
+
+			std::vector<std::unique_ptr<FirstPlayer>> first_players;
+			std::vector<std::unique_ptr<SecondPlayer>> second_players;
+			for (int w = 0; w < scheduler.worker_count(); w++) {
+				first_players.emplace_back(new FirstPlayer(first.rules, first.strategy, first.seed));
+				second_players.emplace_back(new SecondPlayer(second.rules, second.strategy, first.seed));
+			}
+
+			scheduler.run(task_count(first), [&](uint64_t task, int worker) {
+				int64_t first_units = play_task(*first_players[worker], first, task, first_results[worker]);
+				int64_t second_units = play_task(*second_players[worker], first, task, second_results[worker]);
+				differences[worker].add(first_units - second_units);
+			}, shoe_progress(first, progress));
+		});
+	});
+
+	ComparisonResult result;
+	for (int w = 0; w < scheduler.worker_count(); w++) {
+		result.first.merge(first_results[w]);
+		result.second.merge(second_results[w]);
+		result.differences.merge(differences[w]);
+	}
+	result.first.seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	result.second.seconds = result.first.seconds;
+
+	return result;
+}
@@ -0,0 +1,198 @@
+#pragma once
+
+#include "Deck.h"
+#include "RuleSet.h"
+#include "CountingSystem.h"
+#include "BasicStrategy.h"
+#include "TaskScheduler.h"
+
+#include <cstdint>
+#include <functional>
+
+/*
+ * Results are accumulated in tenths of a unit bet using integers. Every
+ * payout in the supported rules (3:2, 6:5, surrender) is a whole number of
+ * tenths so the sums are exact and don't depend on the order they are added
+ * in. This keeps results bit identical no matter how many threads are used.
+ */
+#define SIM_UNIT_SCALE 10
+
+/* Range of true counts results are broken down by. Counts outside of it are clamped. */
+#define TRUE_COUNT_MIN -10
+#define TRUE_COUNT_MAX 10
+#define TRUE_COUNT_BUCKETS (TRUE_COUNT_MAX - TRUE_COUNT_MIN + 1)
+
+/*
+ * Fewest shoes a run with a target standard error plays before it first
+ * checks the standard error, and between later checks.
+ */
+#define SIM_MIN_CHECK_SHOES 1000
+/* Runs with a target standard error plan this much past the shoes the estimate says are needed. */
+#define SIM_PLAN_MARGIN 1.05
+
+struct SimulationCheckpoint;
+class HandRecordWriter;
+
+/*
+ * How the shoes of a run are shuffled.
+ *	Independent: Every shoe has its own shuffle.
+ *	Antithetic: Shoes come in pairs. The second shoe of a pair is the first
+ *				one with its low and high cards swapped (see
+ *				Deck::mirror_counts), so a shoe that runs hot is paired with
+ *				one that runs cold.
+ */
+enum class ShuffleMode {
+	Independent,
+	Antithetic
+};
+
+/*
+ * Settings for a simulation run.
+ */
+struct SimulationConfig {
+	RuleSet rules;
+	CountingSystemId counting_system = CountingSystemId::HiLo;
+	/* Seed for the shoe shuffles. Shoe n of a run is always dealt from stream n of this seed. */
+	uint64_t seed = 0;
+	/*
+	 * Index of the first shoe to play and how many shoes to play. Antithetic
+	 * runs round the number of shoes up to an even number.
+	 */
+	uint64_t first_shoe = 0;
+	uint64_t shoe_count = 100000;
+	/*
+	 * Which of the shard_count shares of a split run this is, counting from
+	 * zero, as set by shard_config. A run that isn't split is shard 0 of 1.
+	 */
+	int shard = 0;
+	int shard_count = 1;
+	/*
+	 * Range of shoes of the whole run a shard is part of, as set by
+	 * shard_config. Only used by split runs.
+	 */
+	uint64_t run_first_shoe = 0;
+	uint64_t run_shoe_count = 0;
+	ShuffleMode shuffle_mode = ShuffleMode::Independent;
+	/*
+	 * Standard error of the EV to stop at, for example 0.0001 for 0.01%.
+	 * Once it is met the run stops early and shoe_count is only the most
+	 * shoes to play. Zero plays every shoe.
+	 */
+	double target_standard_error = 0.0;
+	/* Number of worker threads. Zero uses one thread per core. */
+	int thread_count = 0;
+	/* Strategy to play, for example one made by generate_basic_strategy. Null plays the built in charts. */
+	const StrategyTable *strategy = nullptr;
+	/*
+	 * File to write a checkpoint of the run to every checkpoint_seconds
+	 * seconds. Null doesn't write checkpoints.
+	 */
+	const char *checkpoint_path = nullptr;
+	double checkpoint_seconds = 60.0;
+	/*
+	 * Checkpoint of an earlier run with the same settings to carry on from,
+	 * for example one read with load_checkpoint. Null starts from the first shoe.
+	 */
+	const SimulationCheckpoint *resume = nullptr;
+	/*
+	 * Writer to record every player hand to, which must already be open.
+	 * Null doesn't record hands. Hands aren't part of checkpoints.
+	 */
+	HandRecordWriter *hand_records = nullptr;
+	/*
+	 * True to play the common rule sets with a player compiled for them (see
+	 * with_rule_policy). False always reads the rules at runtime, which gives
+	 * the same results more slowly and is only useful to compare speeds.
+	 */
+	bool specialize_rules = true;
+};
+
+/*
+ * Totals for a group of rounds. Units are in tenths of a unit bet.
+ */
+struct RoundTotals {
+	uint64_t rounds = 0;
+	int64_t units = 0;
+	int64_t squared_units = 0;
+
+	void add(int64_t round_units);
+	void merge(const RoundTotals &other);
+	double mean() const;
+	double variance() const;
+};
+
+/*
+ * Results of a simulation run. Every round is played with a one unit
+ * initial bet.
+ */
+class SimulationResult
+{
+public:
+	uint64_t shoes = 0;
+	/* Player hands played, including hands created by splitting. */
+	uint64_t hands = 0;
+	RoundTotals totals;
+	/* Totals broken down by the true count at the start of each round. */
+	RoundTotals true_counts[TRUE_COUNT_BUCKETS];
+	/* Totals of whole shoes and, in antithetic runs, of whole pairs of shoes. */
+	RoundTotals shoe_totals;
+	RoundTotals pair_totals;
+	double seconds = 0.0;
+	/* Set by run_simulation if a checkpoint couldn't be written. Not merged or saved. */
+	bool checkpoint_failed = false;
+
+	void merge(const SimulationResult &other);
+	double ev() const;
+	double variance() const;
+	double standard_error() const;
+	double variance_reduction() const;
+	double rounds_per_second() const;
+};
+
+/*
+ * Snapshot of a simulation that is still running, for progress reports.
+ */
+struct SimulationProgress {
+	uint64_t shoes = 0;
+	/* Shoes the run expects to play. With a target standard error this changes as the run goes. */
+	uint64_t planned_shoes = 0;
+	uint64_t hands = 0;
+	RoundTotals totals;
+	/* Totals of whole shoes and, in antithetic runs, of whole pairs of shoes. */
+	RoundTotals shoe_totals;
+	RoundTotals pair_totals;
+	double seconds = 0.0;
+
+	double standard_error() const;
+	double hands_per_second() const;
+	double seconds_left() const;
+};
+
+typedef std::function<void(const SimulationProgress &progress)> SimulationProgressFunction;
+
+/*
+ * Results of playing two configurations on the same shuffles, which are
+ * common random numbers for the comparison: luck of the cards that helps or
+ * hurts both of them cancels out of the difference.
+ */
+struct ComparisonResult {
+	SimulationResult first, second;
+	/*
+	 * Units won by the first configuration minus the second, one entry per
+	 * shoe, or per pair of shoes in antithetic runs.
+	 */
+	RoundTotals differences;
+
+	double difference() const;
+	double standard_error() const;
+	double independent_standard_error() const;
+	double variance_reduction() const;
+};
+
+int true_count_bucket(int running_count, int scale, int cards_remaining);
+
+SimulationResult run_simulation(const SimulationConfig &config,
+	const SimulationProgressFunction &progress = nullptr);
+ComparisonResult run_comparison(const SimulationConfig &first, const SimulationConfig &second,
+	const TaskScheduler::ProgressFunction &progress = nullptr);
+SimulationConfig shard_config(const SimulationConfig &config, int shard, int shard_count);
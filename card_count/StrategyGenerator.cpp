@@ -0,0 +1,133 @@
+#include "StrategyGenerator.h"
+#include "HandAnalyzer.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <memory>
+#include <vector>
+
+/*
+ * Pick the chart entry for a row from the values of its plays.
+ */
+static char table_entry(const ActionValues &values, const RuleSet &rules) {
+	bool hit = values.hit > values.stand;
+	double best = std::max(values.hit, values.stand);
+
+	if (rules.late_surrender && values.surrender > std::max(best, values.double_down)) {
+		return hit ? 'R' : 'r';
+	}
+	if (values.double_down > best) {
+		return hit ? 'D' : 'd';
+	}
+	return hit ? 'H' : 'S';
+}
+
+/*
+ * Work out the column of the chart for one dealer upcard.
+ *
+ * Every two card hand is analyzed exactly and the hands are then combined
+ * into the rows of the chart, weighted by the chance of being dealt each
+ * one, so a row like hard 16 plays best on average over 10,6 and 9,7.
+ */
+static void generate_column(const RuleSet &rules, DealerEngine &dealer, int upcard, StrategyTable &table) {
+	HandAnalyzer analyzer(rules, dealer, upcard);
+	ActionValues hard_rows[18], soft_rows[9], pairs[10];
+	int column = upcard - 2;
+
+	Composition shoe(rules.deck_count);
+	shoe.remove(upcard);
+
+	/* Every play other than splitting, for every two card hand. */
+	for (int first = 2; first <= 11; first++) {
+		double first_probability = shoe.probability(first);
+		shoe.remove(first);
+
+		for (int second = first; second <= 11; second++) {
+			double weight = first_probability * shoe.probability(second) * (first == second ? 1.0 : 2.0);
+			if (weight == 0.0) {
+				continue;
+			}
+			shoe.remove(second);
+
+			ActionValues values = analyzer.hand_values(shoe, first, second);
+			if (first == second) {
+				pairs[first - 2] = values;
+			}
+			if (second == 11 && first != 11) {
+				soft_rows[first + 11 - 13].add(values, weight);
+			}
+			else if (second != 11) {
+				hard_rows[first + second - 4].add(values, weight);
+			}
+
+			shoe.add(second);
+		}
+
+		shoe.add(first);
+	}
+
+	for (int row = 0; row < 18; row++) {
+		table.hard[row][column] = row + 4 == 21 ? 'S' : table_entry(hard_rows[row], rules);
+	}
+	for (int row = 0; row < 9; row++) {
+		table.soft[row][column] = row + 13 == 21 ? 'S' : table_entry(soft_rows[row], rules);
+	}
+
+	/* Splits are done last since they have to clear the player's cache. */
+	for (int pair = 2; pair <= 11; pair++) {
+		const ActionValues &values = pairs[pair - 2];
+		/* Pairs that aren't split are played by total so this is only for reading the chart. */
+		char entry = values.hit > values.stand ? 'H' : 'S';
+
+		if (rules.max_hands >= 2 && shoe.count(pair) >= 2) {
+			shoe.remove(pair);
+			shoe.remove(pair);
+			if (analyzer.split_value(shoe, pair) > values.best_without_split(rules)) {
+				entry = 'P';
+			}
+			shoe.add(pair);
+			shoe.add(pair);
+		}
+
+		table.pair[pair - 2][column] = entry;
+	}
+}
+
+/*
+ * Generate the exact basic strategy chart for a rule set by combinatorial
+ * analysis of the full shoe. Every dealer upcard is worked out on its own
+ * so the columns are generated in parallel, each worker with its own dealer
+ * engine.
+ *
+ * Parameters:
+ *	rules: House rules to generate the chart for. The deck count must be
+ *		   between 1 and COMPOSITION_MAX_DECKS.
+ *	thread_count: Number of worker threads. Zero uses one thread per core.
+ *	counters: Optional counters to add the dealer cache counters of every
+ *			  worker to.
+ *
+ * Return:
+ *	The strategy chart. Entries are null terminated rows just like the
+ *	built in charts.
+ */
+StrategyTable generate_basic_strategy(const RuleSet &rules, int thread_count, DealerCacheCounters *counters) {
+	StrategyTable table = {};
+	TaskScheduler scheduler(thread_count);
+
+	std::vector<std::unique_ptr<DealerEngine>> dealers;
+	for (int w = 0; w < scheduler.worker_count(); w++) {
+		dealers.emplace_back(new DealerEngine(rules));
+	}
+
+	scheduler.run(10, [&](uint64_t task, int worker) {
+		generate_column(rules, *dealers[worker], (int)task + 2, table);
+	});
+
+	if (counters != nullptr) {
+		for (const std::unique_ptr<DealerEngine> &dealer : dealers) {
+			counters->merge(dealer->counters());
+		}
+	}
+
+	return table;
+}
@@ -0,0 +1,9 @@
+#pragma once
+
+#include "BasicStrategy.h"
+#include "RuleSet.h"
+#include "Composition.h"
+#include "DealerEngine.h"
+
+StrategyTable generate_basic_strategy(const RuleSet &rules, int thread_count = 0,
+	DealerCacheCounters *counters = nullptr);
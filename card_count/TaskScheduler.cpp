@@ -0,0 +1,205 @@
+#include "TaskScheduler.h"
+#include "Random.h"
+
+#include <algorithm>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <vector>
+
+/*
+ * Constructor for the TaskScheduler class.
+ *
+ * Parameters:
+ *	thread_count: Number of worker threads. Zero uses one thread per core.
+ */
+TaskScheduler::TaskScheduler(int thread_count) :
+	thread_count(thread_count), cancelled(false)
+{
+	if (this->thread_count <= 0) {
+		this->thread_count = (int)std::thread::hardware_concurrency();
+		if (this->thread_count <= 0) {
+			this->thread_count = 1;
+		}
+	}
+}
+
+/*
+ * Get the number of worker threads tasks are run on.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Number of workers. Worker indices passed to tasks are below this value.
+ */
+int TaskScheduler::worker_count() const {
+	return this->thread_count;
+}
+
+/*
+ * Ask the workers to stop. Tasks that have already started are allowed to
+ * finish but no new tasks are started. This is safe to call from any thread,
+ * including from inside a task or the progress function. If no run is in
+ * progress the next run stops before starting any task. Every run clears
+ * the cancel when it returns so the scheduler can be used again.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	Nothing
+ */
+void TaskScheduler::cancel() {
+	this->cancelled.store(true, std::memory_order_relaxed);
+}
+
+/*
+ * Check if the scheduler has been cancelled.
+ *
+ * Parameters:
+ *	None
+ *
+ * Return:
+ *	True if cancel has been called since the last run returned and false
+ *	otherwise.
+ */
+bool TaskScheduler::is_cancelled() const {
+	return this->cancelled.load(std::memory_order_relaxed);
+}
+
+/*
+ * Take the next task from the front of a worker's own deque.
+ */
+bool TaskScheduler::pop(WorkerQueue &queue, uint64_t &task) {
+	std::lock_guard<std::mutex> guard(queue.lock);
+
+	if (queue.begin == queue.end) {
+		return false;
+	}
+	task = queue.begin++;
+	return true;
+}
+
+/*
+ * Steal work for a worker whose deque is empty. Victims are visited in a
+ * random order starting point and the back half of the first non-empty
+ * deque is moved into the thief's deque.
+ *
+ * Return:
+ *	True if any work was stolen and false if every deque was empty.
+ */
+bool TaskScheduler::steal(WorkerQueue *queues, int thief, uint64_t &seed) {
+	int start = (int)(splitmix64(seed) % (uint64_t)this->thread_count);
+
+	for (int i = 0; i < this->thread_count; i++) {
+		int victim = (start + i) % this->thread_count;
+		if (victim == thief) {
+			continue;
+		}
+
+		uint64_t begin, end;
+		{
+			std::lock_guard<std::mutex> guard(queues[victim].lock);
+			uint64_t available = queues[victim].end - queues[victim].begin;
+			if (available == 0) {
+				continue;
+			}
+			/* Take the back half, rounded up so a single task can be stolen. */
+			end = queues[victim].end;
+			begin = end - (available + 1) / 2;
+			queues[victim].end = begin;
+		}
+
+		std::lock_guard<std::mutex> guard(queues[thief].lock);
+		queues[thief].begin = begin;
+		queues[thief].end = end;
+		return true;
+	}
+
+	return false;
+}
+
+/*
+ * Run tasks 0 through task_count - 1 across the worker threads and wait for
+ * them to finish. The calling thread only waits and reports progress.
+ *
+ * Parameters:
+ *	task_count: Number of tasks to run.
+ *	task_function: Function called for every task with the task index and
+ *				   the index of the worker running it. Tasks run on the same
+ *				   worker never overlap so per-worker state can be indexed by
+ *				   the worker index without locking.
+ *	progress_function: Optional function called on the calling thread every
+ *					   progress interval and once at the end with the number
+ *					   of tasks completed so far.
+ *	progress_interval_ms: Time between progress calls in milliseconds.
+ *
+ * Return:
+ *	Number of tasks that were run. This is less than task_count if the
+ *	scheduler was cancelled.
+ */
+uint64_t TaskScheduler::run(uint64_t task_count, const TaskFunction &task_function,
+	const ProgressFunction &progress_function, unsigned int progress_interval_ms) {
+	std::unique_ptr<WorkerQueue[]> queues(new WorkerQueue[this->thread_count]);
+	std::atomic<uint64_t> completed(0);
+	std::atomic<int> running_workers(this->thread_count);
+
+	/*
+	 * Give every worker an even contiguous share of the tasks to start with.
+	 * The first task_count % n workers get one extra task. Multiplying
+	 * task_count by the worker index first could overflow for large counts.
+	 */
+	uint64_t n = (uint64_t)this->thread_count;
+	for (uint64_t w = 0; w < n; w++) {
+		queues[w].begin = task_count / n * w + std::min<uint64_t>(w, task_count % n);
+		queues[w].end = task_count / n * (w + 1) + std::min<uint64_t>(w + 1, task_count % n);
+	}
+
+	auto worker = [&](int index) {
+		uint64_t seed = (uint64_t)index;
+		uint64_t task;
+
+		while (!this->is_cancelled()) {
+			if (this->pop(queues[index], task)) {
+				task_function(task, index);
+				completed.fetch_add(1, std::memory_order_relaxed);
+			}
+			else if (!this->steal(queues.get(), index, seed)) {
+				break;
+			}
+		}
+		running_workers.fetch_sub(1, std::memory_order_release);
+	};
+
+	std::vector<std::thread> threads;
+	for (int w = 0; w < this->thread_count; w++) {
+		threads.emplace_back(worker, w);
+	}
+
+	/* Report progress while the workers run. */
+	if (progress_function) {
+		auto interval = std::chrono::milliseconds(progress_interval_ms);
+		auto next_report = std::chrono::steady_clock::now() + interval;
+
+		while (running_workers.load(std::memory_order_acquire) > 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(10));
+			if (std::chrono::steady_clock::now() >= next_report) {
+				progress_function(completed.load(std::memory_order_relaxed), task_count);
+				next_report += interval;
+			}
+		}
+	}
+
+	for (std::thread &thread : threads) {
+		thread.join();
+	}
+
+	if (progress_function) {
+		progress_function(completed.load(), task_count);
+	}
+
+	/* Cleared once the run is over, so a cancel from before the run still stops it. */
+	this->cancelled.store(false, std::memory_order_relaxed);
+	return completed.load();
+}
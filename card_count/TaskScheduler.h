@@ -0,0 +1,44 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+
+/*
+ * Work stealing scheduler for running many independent tasks, such as
+ * simulating shoes, across every core. Each worker owns a deque of task
+ * indices that starts out as an even share of the work. Workers take tasks
+ * from the front of their own deque and when it runs dry they steal the back
+ * half of another worker's deque. Each deque has its own lock so there is no
+ * lock shared by all of the workers.
+ */
+class TaskScheduler
+{
+public:
+	typedef std::function<void(uint64_t task, int worker)> TaskFunction;
+	typedef std::function<void(uint64_t completed, uint64_t total)> ProgressFunction;
+
+private:
+	/* A worker's deque. Tasks [begin, end) have not been started yet. */
+	struct alignas(64) WorkerQueue {
+		std::mutex lock;
+		uint64_t begin = 0;
+		uint64_t end = 0;
+	};
+
+	int thread_count;
+	std::atomic<bool> cancelled;
+
+	bool pop(WorkerQueue &queue, uint64_t &task);
+	bool steal(WorkerQueue *queues, int thief, uint64_t &seed);
+
+public:
+	TaskScheduler(int thread_count = 0);
+
+	int worker_count() const;
+	void cancel();
+	bool is_cancelled() const;
+	uint64_t run(uint64_t task_count, const TaskFunction &task_function,
+		const ProgressFunction &progress_function = nullptr, unsigned int progress_interval_ms = 500);
+};
@@ -1,5 +1,8 @@
 #include <iostream>
+#include <sstream>
 #include <string>
+#include <ctype.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <Windows.h>
 
@@ -7,6 +10,9 @@
 #undef main
 
 #include "Deck.h"
+#include "CountingSystem.h"
+#include "Advisor.h"
+#include "IndexGenerator.h"
 #include "FrontEnd.h"
 #include "AsciiFrontEnd.h"
 #include "SDLFrontEnd.h"
@@ -14,6 +20,9 @@
 /* This macro determines if we use the SDL or ascii frontend. */
 #define FRONTEND_SDL
 
+/* File the index quiz reads its index plays from. It is made by "card_sim --index-plays". */
+#define INDEX_PLAYS_FILE "index_plays.txt"
+
 void event_handler_sleep(unsigned int ms, FrontEnd &frontend) {
 	unsigned int ms_count = 0;
 
@@ -24,36 +33,43 @@ void event_handler_sleep(unsigned int ms, FrontEnd &frontend) {
 	}
 }
 
-int WinMain(
-	HINSTANCE hInstance,
-	HINSTANCE hPrevInstance,
-	LPSTR     lpCmdLine,
-	int       nShowCmd)
-	{
-	srand(time(NULL));
+/*
+ * Run the card counting trainer. The trainer is templated on the counting
+ * system so the count update in the loop is specialized at compile time.
+ *
+ * Parameters:
+ *	deck: Deck to deal cards from.
+ *	frontend: Frontend used for all user facing I/O.
+ *	engine: Random engine used to pick when the user is asked for the count.
+ *
+ * Return:
+ *	Nothing. The trainer runs until the program is closed.
+ */
+template <typename System>
+void run_trainer(Deck &deck, FrontEnd &frontend, Philox4x32 &engine) {
+	std::string prompt = "What is the count? ";
+	if (System::scale != 1) {
+		/* Fractional counts are entered multiplied by the scale so they stay integers. */
+		prompt = "What is the count x" + std::to_string(System::scale) + "? ";
+	}
 
-	Deck deck;
-
-#ifdef FRONTEND_SDL
-	SDLFrontEnd frontend(deck);
-#else
-	AsciiFrontEnd frontend;
-#endif
+	frontend.print_message("Counting system: " + std::string(System::name));
+	event_handler_sleep(1000, frontend);
 
 	deck.shuffle();
 	Card card;
 
-	int ask_card_count = rand() % deck.shuffeled_card_count();
-	int count = 0;
+	int ask_card_count = (int)random_index(engine, deck.shuffeled_card_count());
+	int count = initial_running_count<System>(deck.deck_count());
 	do {
 		card = deck.draw();
 		event_handler_sleep(2000, frontend);
 		if (card.is_valid()) {
-			count += card.get_count_value();
+			count += count_value<System>(card);
 			frontend.draw_card(card);
 			deck.discard(card);
 			if (ask_card_count == deck.shuffeled_card_count()) {
-				frontend.print_message("What is the count? ");
+				frontend.print_message(prompt);
 				int user_count = frontend.get_count_input();
 				if (user_count != count) {
 					frontend.print_message("Incorrect count!\nThe correct count is " + std::to_string(count));
@@ -65,13 +81,223 @@ int WinMain(
 				event_handler_sleep(1000, frontend);
 				frontend.print_message("Starting new deck...");
 				event_handler_sleep(1000, frontend);
-				count = 0;
+				count = initial_running_count<System>(deck.deck_count());
 				deck.shuffle();
 			}
 		}
 
 		frontend.handle_events();
 	} while (1);
+}
+
+/*
+ * Run the strategy advisor. Hands are dealt from the shoe a card at a time
+ * and once the player's cards and the dealer's upcard are out the best play
+ * for the exact cards left in the shoe is shown, along with the basic
+ * strategy play when they differ. The advisor has a hard deadline well
+ * inside the time between cards so it never holds up the deal.
+ *
+ * Parameters:
+ *	shoe: Shoe to deal hands from.
+ *	frontend: Frontend used for all user facing I/O.
+ *
+ * Return:
+ *	Nothing. The advisor runs until the program is closed.
+ */
+void run_advisor(Shoe &shoe, FrontEnd &frontend) {
+	RuleSet rules;
+	rules.deck_count = shoe.deck_count();
+	Advisor advisor(rules);
+
+	frontend.print_message("Strategy advisor: " + std::to_string(rules.deck_count) + " deck shoe");
+	event_handler_sleep(1000, frontend);
+
+	shoe.shuffle();
+
+	do {
+		if (shoe.cut_card_reached()) {
+			frontend.print_message("Shuffling...");
+			event_handler_sleep(1000, frontend);
+			shoe.shuffle();
+		}
+
+		/* Deal the player's first card, the dealer's upcard and then the player's second card. */
+		Card cards[3];
+		for (Card &card : cards) {
+			card = shoe.draw();
+			event_handler_sleep(2000, frontend);
+			frontend.draw_card(card);
+		}
+		Card first = cards[0], upcard = cards[1], second = cards[2];
+
+		Advice advice = advisor.advise(first, second, upcard, shoe.remaining_cards());
+
+		std::string message = "You: " + std::string(first.ascii()) + " " + std::string(second.ascii()) +
+			"  Dealer: " + std::string(upcard.ascii()) + "\n";
+		message += "Best play: " + std::string(player_action_name(advice.action));
+		if (advice.exact) {
+			char ev_text[32];
+			snprintf(ev_text, sizeof(ev_text), " (EV %+.3f)", advice.value(advice.action));
+			message += ev_text;
+		}
+		else if (advice.split_timed_out && advice.action != PlayerAction::Split) {
+			char ev_text[64];
+			snprintf(ev_text, sizeof(ev_text), " (EV %+.3f, best except split, split out of time)",
+				advice.value(advice.action));
+			message += ev_text;
+		}
+		else if (advice.split_timed_out) {
+			message += " (basic strategy, split out of time)";
+		}
+		else {
+			message += " (basic strategy, out of time)";
+		}
+		if (advice.action != advice.basic_action) {
+			message += "\nBasic strategy says " + std::string(player_action_name(advice.basic_action));
+		}
+		frontend.print_message(message);
+
+		event_handler_sleep(2000, frontend);
+		for (Card &card : cards) {
+			shoe.discard(card);
+		}
+
+		frontend.handle_events();
+	} while (1);
+}
+
+/*
+ * Run the index play quiz. A hand that has a deviation from basic strategy
+ * is dealt and the user is asked for the true count at which the deviation
+ * is played.
+ *
+ * Parameters:
+ *	plays: Index plays to quiz on, as made by card_sim.
+ *	frontend: Frontend used for all user facing I/O.
+ *	engine: Random engine used to pick the hands.
+ *
+ * Return:
+ *	Nothing. The quiz runs until the program is closed.
+ */
+void run_index_quiz(const std::vector<IndexPlay> &plays, FrontEnd &frontend, Philox4x32 &engine) {
+	if (plays.empty()) {
+		frontend.print_message("No index plays found in " INDEX_PLAYS_FILE ".\nMake them with card_sim --index-plays " INDEX_PLAYS_FILE);
+		event_handler_sleep(5000, frontend);
+		return;
+	}
+
+	frontend.print_message("Index plays: " + std::to_string(plays.size()));
+	event_handler_sleep(1000, frontend);
+
+	do {
+		const IndexPlay &play = plays[random_index(engine, plays.size())];
+
+		/* Deal the player's first card, the dealer's upcard and then the player's second card. */
+		int values[3] = { play.first, play.upcard, play.second };
+		for (int value : values) {
+			CardRank rank = value == 11 ? CardRank::Ace :
+				value == 10 ? (CardRank)((int)CardRank::Ten + random_index(engine, 4)) : (CardRank)value;
+			Card card(rank, (CardSuit)random_index(engine, (int)CardSuit::CardSuit_END), true);
+			event_handler_sleep(1000, frontend);
+			frontend.draw_card(card);
+		}
+
+		std::string deviation = player_action_name(play.deviation);
+		std::string message = "You: " + index_hand_name(play) + "  Dealer: " +
+			(play.upcard == 11 ? std::string("A") : std::to_string(play.upcard)) + "\n";
+		message += "Basic strategy says " + std::string(player_action_name(play.basic_action)) + ".\n";
+		message += "At what true count " + std::string(play.above ? "and above" : "and below") +
+			" do you " + deviation + "? ";
+		frontend.print_message(message);
+
+		int user_index = frontend.get_count_input();
+		if (user_index != play.index) {
+			frontend.print_message("Incorrect!\n" + deviation + " at a true count of " +
+				std::to_string(play.index) + (play.above ? " and above" : " and below"));
+		}
+		else {
+			frontend.print_message("Correct!");
+		}
+		event_handler_sleep(2000, frontend);
+
+		frontend.handle_events();
+	} while (1);
+}
+
+int WinMain(
+	HINSTANCE hInstance,
+	HINSTANCE hPrevInstance,
+	LPSTR     lpCmdLine,
+	int       nShowCmd)
+	{
+	/*
+	 * Every random choice in the trainer comes from a stream keyed by this
+	 * seed. The deck shuffles with stream 0 and the trainer picks when to ask
+	 * for the count with stream 1.
+	 */
+	uint64_t seed = (uint64_t)time(NULL);
+	Philox4x32 engine(seed, 1);
+
+	/*
+	 * Options are passed on the command line separated by spaces:
+	 *	A counting system name, for example "halves". Hi-Lo is used by default.
+	 *	"advisor" to run the strategy advisor instead of the count trainer.
+	 *	"indices" to quiz on the index plays in INDEX_PLAYS_FILE.
+	 *	A number of decks to deal from. One deck is used by default.
+	 * For example "card_count.exe advisor 8".
+	 */
+	CountingSystemId system_id = CountingSystemId::HiLo;
+	bool advisor = false;
+	bool indices = false;
+	int deck_count = 1;
+
+	std::istringstream options(lpCmdLine != NULL ? lpCmdLine : "");
+	std::string option;
+	while (options >> option) {
+		if (option == "advisor") {
+			advisor = true;
+		}
+		else if (option == "indices") {
+			indices = true;
+		}
+		else if (isdigit((unsigned char)option[0])) {
+			deck_count = atoi(option.c_str());
+			if (deck_count < 1) {
+				deck_count = 1;
+			}
+			else if (deck_count > COMPOSITION_MAX_DECKS) {
+				deck_count = COMPOSITION_MAX_DECKS;
+			}
+		}
+		else {
+			counting_system_from_name(option, system_id);
+		}
+	}
+
+	Shoe deck(deck_count, 0.75f);
+	deck.seed(seed, 0);
+
+#ifdef FRONTEND_SDL
+	SDLFrontEnd frontend(deck);
+#else
+	AsciiFrontEnd frontend;
+#endif
+
+	if (advisor) {
+		run_advisor(deck, frontend);
+	}
+	else if (indices) {
+		std::vector<IndexPlay> plays;
+		if (!load_index_plays(INDEX_PLAYS_FILE, plays)) {
+			plays.clear();
+		}
+		run_index_quiz(plays, frontend, engine);
+	}
+	else {
+		with_counting_system(system_id, [&](auto system) {
+			run_trainer<decltype(system)>(deck, frontend, engine);
+		});
+	}
 
 	return 0;
 }
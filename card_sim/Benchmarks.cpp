@@ -0,0 +1,946 @@
+#include "Benchmarks.h"
+
+#include "Advisor.h"
+#include "Composition.h"
+#include "CountingSystem.h"
+#include "CountKernel.h"
+#include "DealerEngine.h"
+#include "Deck.h"
+#include "Random.h"
+#include "RuleSet.h"
+#include "ShuffleTest.h"
+#include "Simulator.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+
+/* Times each player is timed on each rule set by the rules benchmark, after a warm-up run. */
+#define RULES_BENCHMARK_REPEATS 5
+/* Speedup every run of a rule set has to reach before it is called a gain rather than timing noise. */
+#define RULES_BENCHMARK_GAIN 1.05
+
+/* Results of the benchmarks are added in here so the work can't be optimized away. */
+static volatile uint64_t benchmark_sink;
+
+/*
+ * Keep a result of a benchmark so the work that produced it isn't optimized away.
+ */
+static void keep(uint64_t value) {
+	benchmark_sink = benchmark_sink + value;
+}
+
+/*
+ * Get the number of seconds since a point in time.
+ */
+static double seconds_since(std::chrono::steady_clock::time_point start) {
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+/*
+ * Scale the amount of work a benchmark does by the --bench-scale option.
+ */
+static uint64_t scaled(const BenchmarkOptions &options, double count) {
+	return std::max<uint64_t>(1, (uint64_t)(count * options.scale));
+}
+
+/*
+ * The Card layout from before cards were packed into a byte: every value is
+ * stored in its own field and worked out with if/else chains when the card
+ * is built. Kept here, with LegacyDeck, to compare with.
+ */
+class LegacyCard {
+	CardRank rank;
+	CardSuit suit;
+	char count_value;
+	char numeric_value;
+	bool valid;
+
+public:
+	LegacyCard() :
+		rank(CardRank::CardRank_END), suit(CardSuit::CardSuit_END), count_value(0), numeric_value(0), valid(false)
+	{}
+
+	LegacyCard(CardRank rank, CardSuit suit) :
+		rank(rank), suit(suit), valid(true)
+	{
+		if (rank == CardRank::Ace) {
+			this->numeric_value = 11;
+		}
+		else if (rank == CardRank::Jack || rank == CardRank::Queen || rank == CardRank::King) {
+			this->numeric_value = 10;
+		}
+		else {
+			this->numeric_value = (char)rank;
+		}
+
+		if (rank == CardRank::Ten || rank == CardRank::Jack || rank == CardRank::Queen ||
+			rank == CardRank::King || rank == CardRank::Ace) {
+			this->count_value = -1;
+		}
+		else if (rank == CardRank::Two || rank == CardRank::Three || rank == CardRank::Four ||
+			rank == CardRank::Five || rank == CardRank::Six) {
+			this->count_value = 1;
+		}
+		else {
+			this->count_value = 0;
+		}
+	}
+
+	char get_count_value() const {
+		return this->count_value;
+	}
+
+	char get_numeric_value() const {
+		return this->numeric_value;
+	}
+};
+
+/*
+ * The Deck from before the in-place shuffle, on LegacyCard: the shuffled
+ * cards go back onto the unshuffled ones one at a time, then each card is
+ * picked with rand() % size, erased from the middle of the unshuffled cards
+ * and appended to the shuffled ones. CRand15 stands in for rand() and works
+ * the same as the MSVC one the old shuffle called. Kept here to compare
+ * with.
+ */
+class LegacyDeck {
+	std::vector<LegacyCard> unshuffled, shuffled;
+	CRand15 random;
+
+public:
+	LegacyDeck(int deck_count, uint64_t seed) :
+		random(seed)
+	{
+		for (int deck = 0; deck < deck_count; deck++) {
+			for (int suit = (int)CardSuit::Club; suit < (int)CardSuit::CardSuit_END; suit++) {
+				for (int rank = (int)CardRank::Two; rank < (int)CardRank::CardRank_END; rank++) {
+					this->unshuffled.push_back(LegacyCard((CardRank)rank, (CardSuit)suit));
+				}
+			}
+		}
+	}
+
+	void shuffle() {
+		while (!this->shuffled.empty()) {
+			this->unshuffled.push_back(this->shuffled.back());
+			this->shuffled.pop_back();
+		}
+
+		while (!this->unshuffled.empty()) {
+			int index = this->random() % this->unshuffled.size();
+			this->shuffled.push_back(this->unshuffled.at(index));
+			this->unshuffled.erase(this->unshuffled.begin() + index);
+		}
+	}
+
+	const LegacyCard &top() const {
+		return this->shuffled.back();
+	}
+};
+
+/*
+ * Time Deck::shuffle with an engine.
+ *
+ * Return:
+ *	Shuffles per second.
+ */
+template <typename Engine>
+static double deck_shuffle_rate(int deck_count, uint64_t shuffles, uint64_t seed) {
+	Deck deck(deck_count);
+	Engine engine(seed);
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < shuffles; i++) {
+		deck.shuffle(engine);
+	}
+	double seconds = seconds_since(start);
+
+	keep(deck.remaining_cards()[0].get_code());
+	return (double)shuffles / seconds;
+}
+
+/*
+ * Compare the in-place Fisher-Yates shuffle over each engine with the old
+ * Deck and its rand() % size shuffle at 1, 6 and 8 decks. The old Deck is
+ * the baseline as it was, 12 byte cards and all, so the speedups are before
+ * and after and not just the change of algorithm.
+ */
+static void shuffle_benchmark(const BenchmarkOptions &options) {
+	printf("Decks  Shuffle                  Shuffles/s   ns/card  Speedup\n");
+	for (int deck_count : { 1, 6, 8 }) {
+		int cards = deck_count * 52;
+		uint64_t shuffles = scaled(options, 2000000.0 / deck_count);
+
+		LegacyDeck legacy(deck_count, options.seed);
+		uint64_t legacy_shuffles = std::max<uint64_t>(1, shuffles / 10);
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t i = 0; i < legacy_shuffles; i++) {
+			legacy.shuffle();
+		}
+		double legacy_rate = (double)legacy_shuffles / seconds_since(start);
+		keep(legacy.top().get_numeric_value());
+
+		struct {
+			const char *name;
+			double rate;
+		} rows[] = {
+			{ "Old Deck, 12 byte Card", legacy_rate },
+			{ "Fisher-Yates, Philox", deck_shuffle_rate<Philox4x32>(deck_count, shuffles, options.seed) },
+			{ "Fisher-Yates, xoshiro", deck_shuffle_rate<Xoshiro256StarStar>(deck_count, shuffles, options.seed) },
+			{ "Fisher-Yates, PCG64", deck_shuffle_rate<Pcg64>(deck_count, shuffles, options.seed) },
+			{ "Fisher-Yates, mt19937_64", deck_shuffle_rate<std::mt19937_64>(deck_count, shuffles, options.seed) },
+		};
+		for (const auto &row : rows) {
+			printf("%5d  %-24s %10.0f %9.2f %7.1fx\n", deck_count, row.name, row.rate, 1e9 / (row.rate * cards),
+				row.rate / legacy_rate);
+		}
+	}
+}
+
+/*
+ * Time raw 64 bit values and random_index from an engine.
+ */
+template <typename Engine>
+static void print_engine_rate(const char *name, uint64_t count, uint64_t seed) {
+	Engine engine(seed);
+	uint64_t sum = 0;
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < count; i++) {
+		sum += random_u64(engine);
+	}
+	double values = (double)count / seconds_since(start);
+
+	start = std::chrono::steady_clock::now();
+	for (uint64_t i = 0; i < count; i++) {
+		sum += random_index(engine, 416);
+	}
+	double indices = (double)count / seconds_since(start);
+	keep(sum);
+
+	printf("%-11s %14.0f %8.2f %14.0f %8.2f\n", name, values, 1e9 / values, indices, 1e9 / indices);
+}
+
+/*
+ * Compare the throughput of the random engines, and time starting shoes
+ * from their own Philox stream, which is what makes any shoe of a run
+ * reproducible on its own.
+ */
+static void rng_benchmark(const BenchmarkOptions &options) {
+	uint64_t count = scaled(options, 100000000.0);
+	printf("Engine           Values/s  ns/value      Indices/s ns/index\n");
+	print_engine_rate<Philox4x32>("Philox", count, options.seed);
+	print_engine_rate<Xoshiro256StarStar>("xoshiro", count, options.seed);
+	print_engine_rate<Pcg64>("PCG64", count, options.seed);
+	print_engine_rate<std::mt19937_64>("mt19937_64", count, options.seed);
+	print_engine_rate<std::mt19937>("mt19937", count, options.seed);
+
+	uint64_t shoes = scaled(options, 1000000.0);
+	Deck deck(8);
+	deck.seed(options.seed);
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t shoe = 0; shoe < shoes; shoe++) {
+		deck.start_shoe(shoe);
+	}
+	double rate = (double)shoes / seconds_since(start);
+	keep(deck.remaining_cards()[0].get_code());
+	printf("\nDeck::start_shoe, 8 decks: %.0f shoes/s, %.0f ns/shoe\n", rate, 1e9 / rate);
+}
+
+/*
+ * Measure how the work stealing scheduler scales, shuffling and dealing
+ * shoes at 1, 2, 4 and so on up to the number of threads. Each task is a
+ * shoe, started from its own stream and dealt in rounds to a cut card that
+ * changes from shoe to shoe, so the tasks take uneven time like shoes of a
+ * simulation do.
+ */
+static void scheduler_benchmark(const BenchmarkOptions &options) {
+	const int deck_count = 8;
+	const size_t round = 6;
+	uint64_t shoes = scaled(options, 500000.0);
+	int max_threads = TaskScheduler(options.thread_count).worker_count();
+	std::vector<int> thread_counts;
+	for (int threads = 1; threads < max_threads; threads *= 2) {
+		thread_counts.push_back(threads);
+	}
+	thread_counts.push_back(max_threads);
+
+	printf("%d decks, %llu shoes\n\n", deck_count, (unsigned long long)shoes);
+	printf("Threads      Shoes/s  Speedup  Efficiency\n");
+	double single_rate = 0.0;
+	for (int threads : thread_counts) {
+		TaskScheduler scheduler(threads);
+		std::vector<Deck> decks(threads, Deck(deck_count));
+		std::vector<std::vector<Card>> rounds(threads, std::vector<Card>(round));
+		std::vector<uint64_t> dealt(threads, 0);
+		for (Deck &deck : decks) {
+			deck.seed(options.seed);
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		scheduler.run(shoes, [&](uint64_t shoe, int worker) {
+			Deck &deck = decks[worker];
+			std::vector<Card> &cards = rounds[worker];
+			/* Cut between half and nine tenths of the shoe. */
+			size_t cut = deck_count * 52 * (5 + shoe % 5) / 10;
+			size_t count = 0;
+
+			deck.start_shoe(shoe);
+			while (count < cut) {
+				size_t drawn = deck.draw_n(cards);
+				deck.discard_n(std::span<const Card>(cards.data(), drawn));
+				count += drawn;
+			}
+			dealt[worker] += count;
+		});
+		double rate = (double)shoes / seconds_since(start);
+		for (uint64_t count : dealt) {
+			keep(count);
+		}
+
+		if (threads == 1) {
+			single_rate = rate;
+		}
+		double speedup = rate / single_rate;
+		printf("%7d %12.0f %7.2fx %10.0f%%\n", threads, rate, speedup, 100.0 * speedup / threads);
+	}
+}
+
+/*
+ * Time the dealer outcome cache. Compositions are taken every few cards
+ * through a shuffled shoe and looked up with every upcard: once on an empty
+ * cache, where each lookup deals out the dealer's hands and fills the cache
+ * with them, and then over and over on the warm cache. The draw out without
+ * the cache is timed on the same compositions for comparison.
+ */
+static void dealer_benchmark(const BenchmarkOptions &options) {
+	RuleSet rules;
+	DealerEngine engine(rules);
+	Deck deck(rules.deck_count);
+	Xoshiro256StarStar random(options.seed);
+	deck.shuffle(random);
+
+	std::vector<Composition> shoes;
+	Composition shoe(deck);
+	for (Card card : deck.remaining_cards()) {
+		if (shoes.size() == 40) {
+			break;
+		}
+		shoe.remove(card);
+		if (shoe.size() % 5 == 0) {
+			shoes.push_back(shoe);
+		}
+	}
+
+	/* Look up every composition with every upcard it still has. */
+	auto look_up_all = [&](std::vector<Composition> &compositions) {
+		uint64_t lookups = 0;
+		double sum = 0.0;
+		for (Composition &composition : compositions) {
+			for (int upcard = 2; upcard <= 11; upcard++) {
+				if (composition.count(upcard) == 0) {
+					continue;
+				}
+				composition.remove(upcard);
+				sum += engine.outcomes(composition, upcard).probability[DEALER_BUST];
+				composition.add(upcard);
+				lookups++;
+			}
+		}
+		keep((uint64_t)sum);
+		return lookups;
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	uint64_t cold_lookups = look_up_all(shoes);
+	double cold_seconds = seconds_since(start);
+	DealerCacheCounters cold = engine.counters();
+
+	uint64_t passes = scaled(options, 20000.0);
+	uint64_t warm_lookups = 0;
+	start = std::chrono::steady_clock::now();
+	for (uint64_t pass = 0; pass < passes; pass++) {
+		warm_lookups += look_up_all(shoes);
+	}
+	double warm_seconds = seconds_since(start);
+	DealerCacheCounters warm = engine.counters();
+
+	uint64_t computed = 0;
+	double sum = 0.0;
+	start = std::chrono::steady_clock::now();
+	for (Composition &composition : shoes) {
+		for (int upcard = 2; upcard <= 11; upcard++) {
+			if (composition.count(upcard) != 0) {
+				composition.remove(upcard);
+				sum += engine.compute(composition, upcard).probability[DEALER_BUST];
+				composition.add(upcard);
+				computed++;
+			}
+		}
+	}
+	double compute_seconds = seconds_since(start);
+	keep((uint64_t)sum);
+
+	/* The warm counters only count the lookups made after the cold pass. */
+	uint64_t warm_probes = warm.lookups - cold.lookups;
+	uint64_t warm_hits = warm.hits - cold.hits;
+	printf("%d decks, %d compositions, %llu lookups per pass\n\n", rules.deck_count, (int)shoes.size(),
+		(unsigned long long)cold_lookups);
+	printf("Lookup                     ns/lookup  Hit rate  Cache probes\n");
+	printf("No cache, full draw out %12.0f         -  %12s\n", compute_seconds * 1e9 / computed, "-");
+	printf("Cold cache              %12.0f %8.1f%% %13llu\n", cold_seconds * 1e9 / cold_lookups,
+		100.0 * cold.hit_rate(), (unsigned long long)cold.lookups);
+	printf("Warm cache              %12.1f %8.1f%% %13llu\n", warm_seconds * 1e9 / warm_lookups,
+		warm_probes == 0 ? 0.0 : 100.0 * warm_hits / warm_probes, (unsigned long long)warm_probes);
+	printf("\nEvictions: %llu\n", (unsigned long long)warm.evictions);
+}
+
+/*
+ * Get a percentile of a set of timings.
+ */
+static double percentile(std::vector<double> values, double fraction) {
+	std::sort(values.begin(), values.end());
+	size_t index = (size_t)(fraction * (double)values.size());
+	return values[std::min(index, values.size() - 1)];
+}
+
+/*
+ * Time the strategy advisor the way the trainer uses it: starting hands are
+ * dealt through eight deck shoes down to the cut card and the advisor works
+ * out each one against the cards left, with its usual 1 ms budget. Every
+ * hand is timed, from the first on a cold dealer cache on, and the spread of
+ * the times is printed along with how many hands were worked out exactly.
+ */
+static void advisor_benchmark(const BenchmarkOptions &options) {
+	RuleSet rules;
+	rules.deck_count = 8;
+	Advisor advisor(rules);
+	Shoe shoe(rules.deck_count, rules.penetration);
+	shoe.seed(options.seed, 0);
+
+	uint64_t hands = scaled(options, 5000.0);
+	uint64_t shoes = 0;
+	uint64_t exact = 0, split_timed_out = 0, over_budget = 0;
+	std::vector<double> microseconds;
+	microseconds.reserve(hands);
+
+	shoe.start_shoe(shoes++);
+	for (uint64_t i = 0; i < hands; i++) {
+		if (shoe.cut_card_reached()) {
+			shoe.start_shoe(shoes++);
+		}
+		Card first = shoe.draw(), upcard = shoe.draw(), second = shoe.draw();
+
+		Advice advice = advisor.advise(first, second, upcard, shoe.remaining_cards());
+		microseconds.push_back(advice.microseconds);
+		exact += advice.exact ? 1 : 0;
+		split_timed_out += advice.split_timed_out ? 1 : 0;
+		over_budget += advice.microseconds > ADVISOR_DEFAULT_BUDGET_US ? 1 : 0;
+		keep((uint64_t)advice.action);
+
+		shoe.discard(first);
+		shoe.discard(upcard);
+		shoe.discard(second);
+	}
+
+	printf("%d decks, %llu hands from %llu shoes, %d us budget\n\n", rules.deck_count, (unsigned long long)hands,
+		(unsigned long long)shoes, ADVISOR_DEFAULT_BUDGET_US);
+	printf("Time per hand       p50 %8.1f us  p90 %8.1f us  p99 %8.1f us  max %8.1f us\n",
+		percentile(microseconds, 0.50), percentile(microseconds, 0.90), percentile(microseconds, 0.99),
+		percentile(microseconds, 1.0));
+	printf("Worked out exactly  %.1f%% of hands\n", 100.0 * exact / hands);
+	printf("Split out of time   %.1f%% of hands\n", 100.0 * split_timed_out / hands);
+	printf("Over the budget     %.2f%% of hands\n", 100.0 * over_budget / hands);
+	const DealerCacheCounters &counters = advisor.counters();
+	printf("Dealer cache        %.1f%% hit rate over %llu lookups\n", 100.0 * counters.hit_rate(),
+		(unsigned long long)counters.lookups);
+}
+
+/*
+ * Get the median of a set of timings.
+ */
+static double median(std::vector<double> values) {
+	std::sort(values.begin(), values.end());
+	size_t middle = values.size() / 2;
+	return values.size() % 2 == 1 ? values[middle] : (values[middle - 1] + values[middle]) / 2.0;
+}
+
+/*
+ * Compare the player compiled for each common rule set with the one that
+ * checks the rules at runtime, on the same shoes. Both play exactly the same
+ * hands, which is checked, so only the speed differs.
+ *
+ * Every rule set gets a warm-up run of each player first. Then the two are
+ * timed RULES_BENCHMARK_REPEATS times each, taking turns on which goes
+ * first so neither always gets the warmer caches, and the medians are
+ * compared. The spread of the speedups over the repeats says how much of a
+ * difference is noise: a speedup is only called a gain if every repeat
+ * found the compiled player at least RULES_BENCHMARK_GAIN times faster.
+ */
+static void rules_benchmark(const BenchmarkOptions &options) {
+	struct RuleRow {
+		bool h17, das, rsa, ls;
+	};
+	const RuleRow rule_sets[] = {
+#define RULE_ROW(H17, DAS, RSA, LS) { H17, DAS, RSA, LS },
+		FIXED_RULE_SETS(RULE_ROW)
+#undef RULE_ROW
+	};
+
+	SimulationConfig config;
+	config.seed = options.seed;
+	config.shoe_count = scaled(options, 50000.0);
+	config.thread_count = options.thread_count;
+
+	printf("%d decks, %llu shoes, median of %d runs of each player\n\n", config.rules.deck_count,
+		(unsigned long long)config.shoe_count, RULES_BENCHMARK_REPEATS);
+	printf("Rules               Runtime rounds/s  Fixed rounds/s  Speedup  Spread\n");
+	std::vector<double> all_speedups;
+	int gains = 0;
+	for (const RuleRow &row : rule_sets) {
+		config.rules.dealer_hits_soft_17 = row.h17;
+		config.rules.double_after_split = row.das;
+		config.rules.resplit_aces = row.rsa;
+		config.rules.late_surrender = row.ls;
+
+		SimulationConfig warm_up = config;
+		warm_up.shoe_count = std::max<uint64_t>(1, config.shoe_count / 10);
+		for (bool specialize : { false, true }) {
+			warm_up.specialize_rules = specialize;
+			keep(run_simulation(warm_up).hands);
+		}
+
+		std::vector<double> runtime_rates, fixed_rates, speedups;
+		bool same = true;
+		for (int repeat = 0; repeat < RULES_BENCHMARK_REPEATS; repeat++) {
+			SimulationResult results[2];
+			for (int turn = 0; turn < 2; turn++) {
+				bool specialize = (turn + repeat) % 2 == 1;
+				config.specialize_rules = specialize;
+				results[specialize] = run_simulation(config);
+			}
+			const SimulationResult &runtime = results[0], &fixed = results[1];
+			same = same && runtime.totals.units == fixed.totals.units && runtime.hands == fixed.hands;
+			runtime_rates.push_back(runtime.rounds_per_second());
+			fixed_rates.push_back(fixed.rounds_per_second());
+			speedups.push_back(fixed.rounds_per_second() / runtime.rounds_per_second());
+		}
+
+		double speedup = median(fixed_rates) / median(runtime_rates);
+		double slowest = *std::min_element(speedups.begin(), speedups.end());
+		double fastest = *std::max_element(speedups.begin(), speedups.end());
+		all_speedups.push_back(speedup);
+		gains += slowest >= RULES_BENCHMARK_GAIN;
+
+		char name[32];
+		snprintf(name, sizeof(name), "%s%s%s%s", row.h17 ? "H17" : "S17", row.das ? " DAS" : "",
+			row.rsa ? " RSA" : "", row.ls ? " LS" : "");
+		printf("%-19s %16.0f %15.0f %7.2fx  %.2f-%.2fx%s\n", name, median(runtime_rates), median(fixed_rates),
+			speedup, slowest, fastest, same ? "" : "  results differ");
+	}
+
+	printf("\nMedian speedup over the rule sets: %.2fx. ", median(all_speedups));
+	if (gains == 0) {
+		printf("No rule set was %.0f%% faster compiled in every run, so there is no measurable gain here.\n",
+			(RULES_BENCHMARK_GAIN - 1.0) * 100.0);
+	}
+	else {
+		printf("%d of %d rule sets were at least %.0f%% faster compiled in every run.\n", gains,
+			(int)all_speedups.size(), (RULES_BENCHMARK_GAIN - 1.0) * 100.0);
+	}
+}
+
+/*
+ * Compare the footprint of the packed one byte Card with the old layout,
+ * and how fast cards are built and their count values read. The values are
+ * read from an array of cards too big for the cache in the old layout, the
+ * way a simulator streams through recorded shoes.
+ */
+static void card_benchmark(const BenchmarkOptions &options) {
+	const int shoe_cards = 8 * 52;
+	printf("Layout           Bytes/card  416 card shoe  Cache lines\n");
+	printf("Separate fields  %10d %8d bytes %12d\n", (int)sizeof(LegacyCard), (int)(shoe_cards * sizeof(LegacyCard)),
+		(int)((shoe_cards * sizeof(LegacyCard) + 63) / 64));
+	printf("Packed byte      %10d %8d bytes %12d\n", (int)sizeof(Card), (int)(shoe_cards * sizeof(Card)),
+		(int)((shoe_cards * sizeof(Card) + 63) / 64));
+
+	size_t count = 4 * 1024 * 1024;
+	uint64_t passes = scaled(options, 50.0);
+	std::vector<LegacyCard> legacy(count);
+	std::vector<Card> packed(count);
+	std::mt19937_64 random(options.seed);
+	int64_t sum;
+
+	printf("\nOperation                              Cards/s   ns/card\n");
+	auto print_rate = [](const char *name, double cards, double seconds) {
+		printf("%-34s %12.0f %9.3f\n", name, cards / seconds, seconds * 1e9 / cards);
+	};
+
+	/* Random ranks so the branches of the old constructor can't be predicted. */
+	std::vector<uint8_t> ranks(count);
+	for (uint8_t &rank : ranks) {
+		rank = (uint8_t)(2 + random() % 13);
+	}
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t pass = 0; pass < passes; pass++) {
+		for (size_t i = 0; i < count; i++) {
+			legacy[i] = LegacyCard((CardRank)ranks[i], (CardSuit)(i & 3));
+		}
+	}
+	print_rate("Build cards, separate fields", (double)count * passes, seconds_since(start));
+
+	start = std::chrono::steady_clock::now();
+	for (uint64_t pass = 0; pass < passes; pass++) {
+		for (size_t i = 0; i < count; i++) {
+			packed[i] = Card((CardRank)ranks[i], (CardSuit)(i & 3), true);
+		}
+	}
+	print_rate("Build cards, packed byte", (double)count * passes, seconds_since(start));
+
+	sum = 0;
+	start = std::chrono::steady_clock::now();
+	for (uint64_t pass = 0; pass < passes; pass++) {
+		for (const LegacyCard &card : legacy) {
+			sum += card.get_count_value();
+		}
+	}
+	print_rate("Sum count values, separate fields", (double)count * passes, seconds_since(start));
+	keep((uint64_t)sum);
+
+	sum = 0;
+	start = std::chrono::steady_clock::now();
+	for (uint64_t pass = 0; pass < passes; pass++) {
+		for (const Card &card : packed) {
+			sum += card.get_count_value();
+		}
+	}
+	print_rate("Sum count values, packed byte", (double)count * passes, seconds_since(start));
+	keep((uint64_t)sum);
+
+	/* Reading the table straight from the code, as templated code does once the accessor is inlined. */
+	sum = 0;
+	const uint8_t *codes = (const uint8_t *)packed.data();
+	start = std::chrono::steady_clock::now();
+	for (uint64_t pass = 0; pass < passes; pass++) {
+		for (size_t i = 0; i < count; i++) {
+			sum += card_value_table.count_value[codes[i]];
+		}
+	}
+	print_rate("Sum count values, table on codes", (double)count * passes, seconds_since(start));
+	keep((uint64_t)sum);
+}
+
+/*
+ * Time one way of dealing through shoes. The shoe is shuffled between passes
+ * outside the timed part, and the cost of reading the clock is taken off.
+ *
+ * Parameters:
+ *	shoes: Number of shoes to deal.
+ *	deck_count: Number of decks in the shoe.
+ *	seed: Seed of the engine the shoes are shuffled with.
+ *	deal: Called with the deck and a buffer as big as the shoe. Deals the
+ *		  whole shoe and returns the number of cards it moved.
+ *
+ * Return:
+ *	Cards per second.
+ */
+template <typename Deal>
+static double deal_rate(uint64_t shoes, int deck_count, uint64_t seed, Deal &&deal) {
+	Deck deck(deck_count);
+	Xoshiro256StarStar engine(seed);
+	std::vector<Card> cards(deck.remaining_cards().size());
+	std::chrono::steady_clock::duration clock_cost {}, spent {};
+	uint64_t moved = 0;
+
+	for (uint64_t i = 0; i < shoes; i++) {
+		auto start = std::chrono::steady_clock::now();
+		clock_cost += std::chrono::steady_clock::now() - start;
+	}
+
+	for (uint64_t i = 0; i < shoes; i++) {
+		/* Whatever the last pass left in play goes back in the shoe. */
+		deck.discard_n(cards);
+		deck.shuffle(engine);
+
+		auto start = std::chrono::steady_clock::now();
+		moved += deal(deck, cards);
+		spent += std::chrono::steady_clock::now() - start;
+	}
+
+	keep(cards[0].get_code());
+	double seconds = std::chrono::duration<double>(std::max(spent - clock_cost, clock_cost / 100)).count();
+	return (double)moved / seconds;
+}
+
+/*
+ * Compare drawing cards one at a time with moving them in batches with
+ * draw_n and discard_n, in rounds the size of a heads up round and a whole
+ * shoe at a time.
+ */
+static void draw_benchmark(const BenchmarkOptions &options) {
+	const int deck_count = 8;
+	const size_t round = 6;
+	uint64_t shoes = scaled(options, 200000.0);
+
+	struct {
+		const char *name;
+		double rate;
+	} rows[] = {
+		{ "draw, one card at a time", deal_rate(shoes, deck_count, options.seed, [](Deck &deck, std::vector<Card> &cards) {
+			size_t count = 0;
+			for (Card card = deck.draw(); card.is_valid(); card = deck.draw()) {
+				cards[count++] = card;
+			}
+			return (uint64_t)count;
+		}) },
+		{ "draw_n, rounds of 6 cards", deal_rate(shoes, deck_count, options.seed, [&](Deck &deck, std::vector<Card> &cards) {
+			size_t count = 0, drawn;
+			do {
+				drawn = deck.draw_n(std::span<Card>(cards.data() + count, std::min(round, cards.size() - count)));
+				count += drawn;
+			} while (drawn != 0);
+			return (uint64_t)count;
+		}) },
+		{ "draw_n, whole shoe", deal_rate(shoes, deck_count, options.seed, [](Deck &deck, std::vector<Card> &cards) {
+			return (uint64_t)deck.draw_n(cards);
+		}) },
+		{ "draw_n and discard_n, rounds of 6", deal_rate(shoes, deck_count, options.seed, [&](Deck &deck, std::vector<Card> &cards) {
+			/* Each round is drawn and then discarded, the way the simulator deals. */
+			size_t count = 0, drawn;
+			do {
+				drawn = deck.draw_n(std::span<Card>(cards.data(), round));
+				deck.discard_n(std::span<const Card>(cards.data(), drawn));
+				count += drawn;
+			} while (drawn != 0);
+			return (uint64_t)count;
+		}) },
+	};
+
+	printf("%d decks, %llu shoes\n\n", deck_count, (unsigned long long)shoes);
+	printf("Operation                            Cards/s   ns/card\n");
+	for (const auto &row : rows) {
+		printf("%-32s %12.0f %9.3f\n", row.name, row.rate, 1e9 / row.rate);
+	}
+}
+
+/*
+ * Card::ascii from before the names were put in a table: the name is built
+ * up in a std::string from a switch on the rank and one on the suit. Kept
+ * here to compare with.
+ */
+static std::string legacy_ascii(Card card) {
+	std::string str;
+
+	switch (card.get_card_rank()) {
+	case CardRank::Two: str += "2"; break;
+	case CardRank::Three: str += "3"; break;
+	case CardRank::Four: str += "4"; break;
+	case CardRank::Five: str += "5"; break;
+	case CardRank::Six: str += "6"; break;
+	case CardRank::Seven: str += "7"; break;
+	case CardRank::Eight: str += "8"; break;
+	case CardRank::Nine: str += "9"; break;
+	case CardRank::Ten: str += "10"; break;
+	case CardRank::Jack: str += "J"; break;
+	case CardRank::Queen: str += "Q"; break;
+	case CardRank::King: str += "K"; break;
+	case CardRank::Ace: str += "A"; break;
+	default: str += "ERROR";
+	}
+
+	switch (card.get_card_suit()) {
+	case CardSuit::Club: str += "C"; break;
+	case CardSuit::Diamond: str += "D"; break;
+	case CardSuit::Heart: str += "H"; break;
+	case CardSuit::Spade: str += "S"; break;
+	default: str += "ERROR";
+	}
+
+	return str;
+}
+
+/*
+ * Write the names of cards into a text buffer, each followed by a space,
+ * the way a hand history is written out.
+ *
+ * Return:
+ *	Number of characters written.
+ */
+template <typename Name>
+static size_t write_names(const std::vector<Card> &cards, std::vector<char> &text, Name &&name) {
+	size_t length = 0;
+	for (Card card : cards) {
+		auto card_name = name(card);
+		memcpy(text.data() + length, card_name.data(), card_name.size());
+		length += card_name.size();
+		text[length++] = ' ';
+	}
+	return length;
+}
+
+/*
+ * Serialize a hundred million cards with the string_view table behind
+ * Card::ascii and with the old std::string version, and parse the text back
+ * with Card::from_ascii.
+ */
+static void ascii_benchmark(const BenchmarkOptions &options) {
+	/* Shuffled shoes end to end, so the names aren't predictable. */
+	const size_t batch = 1 << 20;
+	std::vector<Card> cards;
+	cards.reserve(batch);
+	Deck deck(8);
+	Xoshiro256StarStar engine(options.seed);
+	while (cards.size() < batch) {
+		deck.shuffle(engine);
+		for (Card card : deck.remaining_cards()) {
+			if (cards.size() < batch) {
+				cards.push_back(card);
+			}
+		}
+	}
+
+	uint64_t passes = scaled(options, 100.0);
+	double total = (double)batch * passes;
+	/* Every name is at most 3 characters and a space. */
+	std::vector<char> text(batch * 4);
+	size_t length = 0;
+	printf("%.0f cards\n\n", total);
+	printf("Operation                            Cards/s   ns/card  Seconds\n");
+	auto print_rate = [&](const char *name, double seconds) {
+		printf("%-32s %12.0f %9.3f %8.2f\n", name, total / seconds, seconds * 1e9 / total, seconds);
+	};
+
+	auto start = std::chrono::steady_clock::now();
+	for (uint64_t pass = 0; pass < passes; pass++) {
+		length = write_names(cards, text, [](Card card) { return legacy_ascii(card); });
+	}
+	print_rate("ascii into a std::string (old)", seconds_since(start));
+	keep(length + (uint8_t)text[length / 2]);
+
+	start = std::chrono::steady_clock::now();
+	for (uint64_t pass = 0; pass < passes; pass++) {
+		length = write_names(cards, text, [](Card card) { return card.ascii(); });
+	}
+	print_rate("ascii from the string_view table", seconds_since(start));
+	keep(length + (uint8_t)text[length / 2]);
+
+	size_t mismatches = 0;
+	start = std::chrono::steady_clock::now();
+	for (uint64_t pass = 0; pass < passes; pass++) {
+		size_t i = 0;
+		const char *next = text.data();
+		const char *end = text.data() + length;
+		while (next < end) {
+			const char *space = (const char *)memchr(next, ' ', end - next);
+			Card card = Card::from_ascii(std::string_view(next, space - next));
+			mismatches += card.get_code() != cards[i++].get_code();
+			next = space + 1;
+		}
+	}
+	print_rate("from_ascii back to cards", seconds_since(start));
+	if (mismatches != 0) {
+		printf("%llu cards didn't parse back to the card they were written from\n", (unsigned long long)mismatches);
+	}
+}
+
+/*
+ * Time the running count kernel at every level the CPU supports over
+ * shuffled shoes end to end, the way recorded shoes are scored.
+ */
+static void kernel_benchmark(const BenchmarkOptions &options) {
+	const size_t length = 1 << 20;
+	std::vector<uint8_t> codes;
+	codes.reserve(length);
+	Deck deck(8);
+	Xoshiro256StarStar engine(options.seed);
+	while (codes.size() < length) {
+		deck.shuffle(engine);
+		std::span<const uint8_t> shoe = card_codes(deck.remaining_cards());
+		codes.insert(codes.end(), shoe.begin(), shoe.begin() + std::min(shoe.size(), length - codes.size()));
+	}
+	std::vector<int> running_count(length);
+	uint64_t passes = scaled(options, 200.0);
+	double total = (double)length * passes;
+
+	const struct {
+		CountKernelLevel level;
+		const char *name;
+	} levels[] = {
+		{ CountKernelLevel::Scalar, "Scalar" },
+		{ CountKernelLevel::SSSE3, "SSSE3" },
+		{ CountKernelLevel::AVX2, "AVX2" },
+	};
+	CountKernelLevel supported = detect_count_kernel_level();
+	double scalar_rate = 0.0;
+
+	printf("Hi-Lo, %.0f cards\n\n", total);
+	printf("Level       Cards/s   ns/card  Speedup\n");
+	for (const auto &level : levels) {
+		if ((int)level.level > (int)supported) {
+			printf("%-6s  not supported by the CPU\n", level.name);
+			continue;
+		}
+
+		auto start = std::chrono::steady_clock::now();
+		for (uint64_t pass = 0; pass < passes; pass++) {
+			keep((uint64_t)count_stream(codes, HiLo::tags, 0, running_count, level.level));
+		}
+		double rate = total / seconds_since(start);
+		if (level.level == CountKernelLevel::Scalar) {
+			scalar_rate = rate;
+		}
+		printf("%-6s %12.0f %9.3f %7.1fx\n", level.name, rate, 1e9 / rate, rate / scalar_rate);
+	}
+}
+
+/*
+ * A benchmark card_sim --bench can run.
+ */
+struct Benchmark {
+	const char *name;
+	const char *description;
+	void (*run)(const BenchmarkOptions &options);
+};
+
+static const Benchmark benchmarks[] = {
+	{ "shuffle", "Deck::shuffle against the old rand() % size shuffle", shuffle_benchmark },
+	{ "rng", "Random engine throughput and starting shoes from their own Philox stream", rng_benchmark },
+	{ "card", "Footprint and speed of the packed one byte Card against the old layout", card_benchmark },
+	{ "draw", "Cards per second drawn one at a time and in batches with draw_n and discard_n", draw_benchmark },
+	{ "ascii", "Serializing cards with Card::ascii and parsing them back with Card::from_ascii", ascii_benchmark },
+	{ "kernel", "Cards per second through the running count kernel at each level", kernel_benchmark },
+	{ "scheduler", "Scaling of the task scheduler shuffling and dealing shoes on more and more threads", scheduler_benchmark },
+	{ "dealer", "Dealer outcome lookups on a cold and a warm cache, and the cache hit rate", dealer_benchmark },
+	{ "advisor", "Time the strategy advisor takes per hand on an eight deck shoe, and how often it is exact", advisor_benchmark },
+	{ "rules", "Players compiled for the common rule sets against checking the rules at runtime", rules_benchmark },
+};
+
+/*
+ * Run a benchmark and print its results.
+ *
+ * Parameters:
+ *	name: Name of the benchmark, or "all" to run every benchmark.
+ *	options: Settings for the benchmarks.
+ *
+ * Return:
+ *	True if the name matched a benchmark and false otherwise.
+ */
+bool run_benchmark(const char *name, const BenchmarkOptions &options) {
+	bool all = strcmp(name, "all") == 0;
+	bool found = false;
+
+	for (const Benchmark &benchmark : benchmarks) {
+		if (all || strcmp(name, benchmark.name) == 0) {
+			printf("%s%s: %s\n\n", found ? "\n" : "", benchmark.name, benchmark.description);
+			benchmark.run(options);
+			found = true;
+		}
+	}
+	return found;
+}
@@ -0,0 +1,16 @@
+#pragma once
+
+#include <cstdint>
+
+/*
+ * Settings shared by the benchmarks run with card_sim --bench.
+ */
+struct BenchmarkOptions {
+	/* Most worker threads for the benchmarks that use threads. Zero uses one thread per core. */
+	int thread_count = 0;
+	uint64_t seed = 0;
+	/* Multiplies the amount of work every benchmark does, lower it for a quick run. */
+	double scale = 1.0;
+};
+
+bool run_benchmark(const char *name, const BenchmarkOptions &options);
@@ -0,0 +1,1027 @@
+#include "Checks.h"
+
+#include "BetRamp.h"
+#include "Checkpoint.h"
+#include "CompositionTracker.h"
+#include "CountDistribution.h"
+#include "CountingSystem.h"
+#include "CountKernel.h"
+#include "Deck.h"
+#include "HandRecords.h"
+#include "Random.h"
+#include "ShuffleTest.h"
+#include "StrategyGenerator.h"
+#include "TaskScheduler.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <random>
+#include <vector>
+
+/*
+ * A statistical check fails when its p-value is below this. The checks are
+ * there to catch broken code, which fails them by far, so this is strict
+ * enough that a working build never fails one by chance.
+ */
+#define CHECK_ALPHA 1e-6
+
+/* Longest stream the count kernel is checked on, enough for several blocks of every kernel level and their tails. */
+#define CHECK_COUNT_KERNEL_LENGTH 300
+
+/*
+ * Check one level of the count kernel against the scalar version on every
+ * stream length from 0 up to CHECK_COUNT_KERNEL_LENGTH, so every split
+ * between whole blocks and the scalar tail is covered.
+ *
+ * Parameters:
+ *	level: Kernel level to check.
+ *	codes: Card codes to count, at least CHECK_COUNT_KERNEL_LENGTH of them.
+ *	tags: Count tags to use.
+ *	initial_count: Running count before the first card.
+ *
+ * Return:
+ *	Number of lengths where the level gave a different result.
+ */
+static int check_count_kernel_level(CountKernelLevel level, const std::vector<uint8_t> &codes,
+	const signed char tags[16], int initial_count) {
+	std::vector<int> expected(CHECK_COUNT_KERNEL_LENGTH), actual(CHECK_COUNT_KERNEL_LENGTH);
+	int failures = 0;
+
+	for (size_t length = 0; length < CHECK_COUNT_KERNEL_LENGTH; length++) {
+		std::span<const uint8_t> stream(codes.data(), length);
+		/* Counts past the length are poisoned to catch a kernel writing more counts than cards. */
+		expected.assign(CHECK_COUNT_KERNEL_LENGTH, -12345);
+		actual.assign(CHECK_COUNT_KERNEL_LENGTH, -12345);
+		int expected_final = count_stream(stream, tags, initial_count, std::span<int>(expected.data(), length),
+			CountKernelLevel::Scalar);
+		int actual_final = count_stream(stream, tags, initial_count, std::span<int>(actual.data(), length), level);
+		if (actual_final != expected_final || actual != expected) {
+			failures++;
+		}
+	}
+	return failures;
+}
+
+/*
+ * Check every count kernel level the CPU supports gives the same running
+ * counts as the scalar version, with the tags of every counting system and
+ * with random tags covering the whole supported range. The streams are
+ * shuffled shoes and random bytes, which also have the invalid and suit
+ * bits set.
+ *
+ * Parameters:
+ *	seed: Seed for the shoes and random bytes.
+ *
+ * Return:
+ *	True if every level matched.
+ */
+static bool check_count_kernel(uint64_t seed) {
+	Xoshiro256StarStar engine(seed);
+	Deck deck(8);
+	deck.shuffle(engine);
+	std::span<const uint8_t> shoe = card_codes(deck.remaining_cards());
+
+	std::vector<std::vector<uint8_t>> streams;
+	streams.emplace_back(shoe.begin(), shoe.begin() + CHECK_COUNT_KERNEL_LENGTH);
+	streams.emplace_back(CHECK_COUNT_KERNEL_LENGTH);
+	for (uint8_t &code : streams.back()) {
+		code = (uint8_t)engine();
+	}
+
+	std::vector<std::vector<signed char>> tag_tables;
+	for (int id = 0; id < (int)CountingSystemId::CountingSystemId_END; id++) {
+		with_counting_system((CountingSystemId)id, [&](auto system) {
+			tag_tables.emplace_back(decltype(system)::tags, decltype(system)::tags + 16);
+		});
+	}
+	/* All +7 and all -7 push the int8 block sums of the vector kernels to their limits. */
+	tag_tables.emplace_back(16, (signed char)7);
+	tag_tables.emplace_back(16, (signed char)-7);
+	tag_tables.emplace_back(16);
+	for (signed char &tag : tag_tables.back()) {
+		tag = (signed char)(random_index(engine, 15) - 7);
+	}
+
+	const struct {
+		CountKernelLevel level;
+		const char *name;
+	} levels[] = {
+		{ CountKernelLevel::SSSE3, "SSSE3" },
+		{ CountKernelLevel::AVX2, "AVX2" },
+	};
+	CountKernelLevel supported = detect_count_kernel_level();
+	bool passed = true;
+
+	for (const auto &level : levels) {
+		if ((int)level.level > (int)supported) {
+			printf("Count kernel, %-6s against scalar    skipped, the CPU doesn't support it\n", level.name);
+			continue;
+		}
+
+		int failures = 0, runs = 0;
+		for (const std::vector<uint8_t> &codes : streams) {
+			for (const std::vector<signed char> &tags : tag_tables) {
+				for (int initial_count : { 0, -20, 1000 }) {
+					failures += check_count_kernel_level(level.level, codes, tags.data(), initial_count);
+					runs += CHECK_COUNT_KERNEL_LENGTH;
+				}
+			}
+		}
+		printf("Count kernel, %-6s against scalar    %s, %d of %d streams differ\n", level.name,
+			failures == 0 ? "ok" : "FAILED", failures, runs);
+		passed = passed && failures == 0;
+	}
+	return passed;
+}
+
+/*
+ * Count the cards left in a deck under a counting system.
+ */
+template <typename System>
+static int count_remaining(Deck &deck) {
+	int count = 0;
+	for (Card card : deck.remaining_cards()) {
+		count += count_value<System>(card);
+	}
+	return count;
+}
+
+/*
+ * Check a composition tracker against a rescan of the cards left in its
+ * deck.
+ *
+ * Parameters:
+ *	tracker: Tracker to check.
+ *	deck: Deck the tracker draws from.
+ *	shuffled_count: The cards left counted right after the last shuffle. The
+ *					running count is this less what the cards left count to
+ *					now, on top of the initial count.
+ *
+ * Return:
+ *	True if the ranks, the total, the running count and the composition
+ *	all match the rescan. Decks too large for a Composition must have none.
+ */
+template <typename System>
+static bool tracker_matches_rescan(const CompositionTracker<System> &tracker, Deck &deck, int shuffled_count) {
+	std::span<const Card> cards = deck.remaining_cards();
+	int ranks[13] = {};
+	for (Card card : cards) {
+		ranks[(int)card.get_card_rank() - 2]++;
+	}
+	int running = initial_running_count<System>(deck.deck_count()) + shuffled_count - count_remaining<System>(deck);
+
+	for (int rank = (int)CardRank::Two; rank <= (int)CardRank::Ace; rank++) {
+		if (tracker.rank_remaining((CardRank)rank) != ranks[rank - 2]) {
+			return false;
+		}
+	}
+	return tracker.total_remaining() == (int)cards.size() && tracker.running_count() == running &&
+		tracker.has_composition() == (deck.deck_count() <= COMPOSITION_MAX_DECKS) &&
+		(!tracker.has_composition() || tracker.composition() == Composition(cards)) &&
+		tracker.ace_side_count() == 4 * deck.deck_count() - ranks[(int)CardRank::Ace - 2];
+}
+
+/*
+ * Deal shoes through a composition tracker with a mix of single draws and
+ * batches of random sizes, discarding some rounds and keeping others in
+ * play across a shuffle, and compare the tracker with a rescan of the deck
+ * after every step. Every shoe is dealt past its last card so drawing from
+ * an empty deck is covered too.
+ */
+template <typename System>
+static int check_tracker_for(uint64_t seed, int deck_count) {
+	Xoshiro256StarStar engine(seed);
+	Deck deck(deck_count);
+	CompositionTracker<System> tracker(deck);
+	std::vector<Card> round(20);
+	int shuffled_count = count_remaining<System>(deck);
+	int failures = !tracker_matches_rescan(tracker, deck, shuffled_count);
+
+	for (int shoe = 0; shoe < 20; shoe++) {
+		tracker.shuffle();
+		shuffled_count = count_remaining<System>(deck);
+		failures += !tracker_matches_rescan(tracker, deck, shuffled_count);
+
+		size_t drawn;
+		do {
+			if (random_index(engine, 2) == 0) {
+				Card card = tracker.draw();
+				drawn = card.is_valid() ? 1 : 0;
+				round[0] = card;
+			}
+			else {
+				drawn = tracker.draw_n(std::span<Card>(round.data(), 1 + random_index(engine, round.size())));
+			}
+			failures += !tracker_matches_rescan(tracker, deck, shuffled_count);
+
+			/* Most rounds are discarded straight away, the rest stay in play through the next shuffle. */
+			if (random_index(engine, 4) != 0) {
+				tracker.discard_n(std::span<const Card>(round.data(), drawn));
+			}
+		} while (drawn != 0);
+	}
+	return failures;
+}
+
+/*
+ * Check CompositionTracker keeps its ranks, running count and composition
+ * in sync with the deck through draw, draw_n and shuffle for every counting
+ * system, on a six deck shoe and on one too large for a Composition.
+ *
+ * Parameters:
+ *	seed: Seed for the sizes of the draws.
+ *
+ * Return:
+ *	True if the tracker always matched a rescan of the deck.
+ */
+static bool check_composition_tracker(uint64_t seed) {
+	int failures = 0;
+	for (int id = 0; id < (int)CountingSystemId::CountingSystemId_END; id++) {
+		for (int deck_count : { 6, COMPOSITION_MAX_DECKS + 5 }) {
+			failures += with_counting_system((CountingSystemId)id, [&](auto system) {
+				return check_tracker_for<decltype(system)>(seed + id, deck_count);
+			});
+		}
+	}
+	printf("Composition tracker against rescans  %s, %d steps differ\n", failures == 0 ? "ok" : "FAILED", failures);
+	return failures == 0;
+}
+
+/*
+ * Check that a composition has the given count of every value, and that its
+ * size, key and hash are those of a composition built from those counts.
+ */
+static bool composition_has_counts(const Composition &composition, const int (&counts)[COMPOSITION_VALUES]) {
+	Composition expected;
+	for (int value = 2; value <= 11; value++) {
+		for (int n = 0; n < counts[value - 2]; n++) {
+			expected.add(value);
+		}
+	}
+	for (int value = 2; value <= 11; value++) {
+		if (composition.count(value) != counts[value - 2]) {
+			return false;
+		}
+	}
+	return composition.size() == expected.size() && composition.key() == expected.key() &&
+		composition.hash() == expected.hash();
+}
+
+/*
+ * Check the whole composition operations of Composition, which use vector
+ * instructions where the target has them, against adding up the counts one
+ * value at a time: add and remove of a whole composition, contains and ==.
+ * The compositions are random subsets of a COMPOSITION_MAX_DECKS deck shoe
+ * so the counts reach the largest ones a Composition can hold.
+ *
+ * Parameters:
+ *	seed: Seed for the compositions.
+ *
+ * Return:
+ *	True if every operation matched.
+ */
+static bool check_composition(uint64_t seed) {
+	Xoshiro256StarStar engine(seed);
+	const int trials = 20000;
+	int failures = 0;
+
+	for (int trial = 0; trial < trials; trial++) {
+		int a[COMPOSITION_VALUES], b[COMPOSITION_VALUES];
+		Composition first, second;
+		for (int value = 2; value <= 11; value++) {
+			int most = COMPOSITION_MAX_DECKS * (value == 10 ? 16 : 4);
+			/* Keep b inside a most of the time so remove and contains see both cases. */
+			a[value - 2] = (int)random_index(engine, most + 1);
+			b[value - 2] = trial % 4 == 0 ? (int)random_index(engine, most + 1) :
+				(int)random_index(engine, a[value - 2] + 1);
+			for (int n = 0; n < a[value - 2]; n++) {
+				first.add(value);
+			}
+			for (int n = 0; n < b[value - 2]; n++) {
+				second.add(value);
+			}
+		}
+
+		bool contained = true;
+		for (int i = 0; i < COMPOSITION_VALUES; i++) {
+			contained = contained && b[i] <= a[i];
+		}
+		bool ok = first.contains(second) == contained && first.contains(Composition()) && first.contains(first) &&
+			(first == second) == std::equal(a, a + COMPOSITION_VALUES, b) && first == first;
+
+		if (contained) {
+			int difference[COMPOSITION_VALUES];
+			for (int i = 0; i < COMPOSITION_VALUES; i++) {
+				difference[i] = a[i] - b[i];
+			}
+			Composition taken = first;
+			taken.remove(second);
+			ok = ok && composition_has_counts(taken, difference);
+
+			/* Putting the cards back has to give the starting composition exactly, key and hash included. */
+			taken.add(second);
+			ok = ok && composition_has_counts(taken, a) && taken == first;
+		}
+		failures += !ok;
+	}
+
+	printf("Composition against scalar counts    %s, %d of %d trials differ\n", failures == 0 ? "ok" : "FAILED",
+		failures, trials);
+	return failures == 0;
+}
+
+/*
+ * Check two runs of cards are the same cards in the same order.
+ */
+static bool same_cards(std::span<const Card> a, std::span<const Card> b) {
+	return std::equal(a.begin(), a.end(), b.begin(), b.end(), [](Card x, Card y) {
+		return x.get_code() == y.get_code();
+	});
+}
+
+/*
+ * Print the result of a statistical check of the Philox streams.
+ *
+ * Return:
+ *	True if the p-value is above CHECK_ALPHA.
+ */
+static bool report_random_test(const char *name, double statistic, double degrees_of_freedom, double p_value) {
+	bool passed = p_value >= CHECK_ALPHA;
+	printf("Philox, %-28s %s, chi-square %.1f on %.0f degrees of freedom, p = %.4g\n", name,
+		passed ? "ok" : "FAILED", statistic, degrees_of_freedom, p_value);
+	return passed;
+}
+
+/*
+ * Check the Philox engine behind Deck::start_shoe:
+ *
+ *	Known answer: block 0 of stream 0 under key 0 has to match the
+ *	Philox4x32-10 test vector of Salmon et al, so the cipher is the
+ *	published one and not just something that looks random.
+ *
+ *	Reproducibility: a shoe only depends on the seed and its index, so
+ *	shoes started in a shuffled order, on any number of threads, and an
+ *	engine jumped straight to a position all have to match shoes and values
+ *	made in order on one thread.
+ *
+ *	Bit and byte frequency: every bit of the 64 bit values should be set
+ *	half the time and every byte value equally often.
+ *
+ *	Neighbouring streams: shoes are keyed by consecutive stream numbers, so
+ *	the values of stream s and stream s + 1 at the same position should be
+ *	independent. The bits of their exclusive or should be set half the time
+ *	and the correlation of the values should be zero.
+ *
+ * Parameters:
+ *	seed: Key of the streams.
+ *
+ * Return:
+ *	True if every check passed.
+ */
+static bool check_philox(uint64_t seed) {
+	bool passed = true;
+
+	Philox4x32 known(0, 0);
+	uint64_t first = known(), second = known();
+	bool known_ok = first == 0xE169C58D6627E8D5ULL && second == 0x9B00DBD8BC57AC4CULL;
+	printf("Philox, known answer                 %s\n", known_ok ? "ok" : "FAILED");
+	passed = passed && known_ok;
+
+	const int shoe_count = 64;
+	std::vector<std::vector<Card>> in_order(shoe_count);
+	Deck deck(6);
+	deck.seed(seed);
+	for (int shoe = 0; shoe < shoe_count; shoe++) {
+		deck.start_shoe(shoe);
+		std::span<const Card> cards = deck.remaining_cards();
+		in_order[shoe].assign(cards.begin(), cards.end());
+	}
+
+	int mismatches = 0, compared = 0;
+	for (int shoe = shoe_count - 1; shoe >= 0; shoe -= 3) {
+		deck.start_shoe(shoe);
+		mismatches += !same_cards(deck.remaining_cards(), in_order[shoe]);
+		compared++;
+	}
+
+	std::vector<std::vector<Card>> threaded(shoe_count);
+	TaskScheduler scheduler(4);
+	scheduler.run(shoe_count, [&](uint64_t shoe, int) {
+		Deck worker_deck(6);
+		worker_deck.seed(seed);
+		worker_deck.start_shoe(shoe);
+		std::span<const Card> cards = worker_deck.remaining_cards();
+		threaded[shoe].assign(cards.begin(), cards.end());
+	});
+	for (int shoe = 0; shoe < shoe_count; shoe++) {
+		mismatches += !same_cards(threaded[shoe], in_order[shoe]);
+		compared++;
+	}
+
+	Philox4x32 stepped(seed, 7), jumped(seed, 7);
+	std::vector<uint64_t> values(1000);
+	for (uint64_t &value : values) {
+		value = stepped();
+	}
+	for (uint64_t position : { 0, 1, 2, 3, 500, 999 }) {
+		jumped.set_position(position);
+		mismatches += jumped() != values[position];
+		compared++;
+	}
+	printf("Philox, shoes reproduce              %s, %d of %d shoes and jumps differ\n",
+		mismatches == 0 ? "ok" : "FAILED", mismatches, compared);
+	passed = passed && mismatches == 0;
+
+	/* Values from many streams so the check isn't only of stream 0. */
+	const int streams = 256;
+	const int per_stream = 16384;
+	uint64_t bits[64] = {}, bytes[256] = {};
+	for (int stream = 0; stream < streams; stream++) {
+		Philox4x32 engine(seed, stream);
+		for (int i = 0; i < per_stream; i++) {
+			uint64_t value = engine();
+			for (int bit = 0; bit < 64; bit++) {
+				bits[bit] += (value >> bit) & 1;
+			}
+			for (int byte = 0; byte < 8; byte++) {
+				bytes[(value >> (8 * byte)) & 0xFF]++;
+			}
+		}
+	}
+	double n = (double)streams * per_stream;
+	double chi_square = 0.0;
+	for (uint64_t ones : bits) {
+		double z = ((double)ones - n / 2.0) / std::sqrt(n / 4.0);
+		chi_square += z * z;
+	}
+	passed = report_random_test("bit frequency", chi_square, 64.0, chi_square_p_value(chi_square, 64.0)) && passed;
+
+	chi_square = 0.0;
+	double expected = n * 8.0 / 256.0;
+	for (uint64_t count : bytes) {
+		chi_square += ((double)count - expected) * ((double)count - expected) / expected;
+	}
+	passed = report_random_test("byte frequency", chi_square, 255.0, chi_square_p_value(chi_square, 255.0)) && passed;
+
+	/*
+	 * The correlation of each pair of neighbouring streams times the square
+	 * root of the sample size is close to a standard normal, so the sum of
+	 * their squares is chi-square with one degree of freedom per pair.
+	 */
+	uint64_t xor_bits[64] = {};
+	double correlation_chi_square = 0.0;
+	for (int stream = 0; stream < streams; stream++) {
+		Philox4x32 a(seed, stream), b(seed, stream + 1);
+		double sum_ab = 0.0, sum_a = 0.0, sum_b = 0.0, sum_aa = 0.0, sum_bb = 0.0;
+		for (int i = 0; i < per_stream; i++) {
+			uint64_t x = a(), y = b();
+			uint64_t both = x ^ y;
+			for (int bit = 0; bit < 64; bit++) {
+				xor_bits[bit] += (both >> bit) & 1;
+			}
+			double u = (double)(x >> 11) * 0x1.0p-53, v = (double)(y >> 11) * 0x1.0p-53;
+			sum_a += u;
+			sum_b += v;
+			sum_ab += u * v;
+			sum_aa += u * u;
+			sum_bb += v * v;
+		}
+		double m = (double)per_stream;
+		double covariance = sum_ab / m - (sum_a / m) * (sum_b / m);
+		double correlation = covariance / std::sqrt((sum_aa / m - (sum_a / m) * (sum_a / m)) *
+			(sum_bb / m - (sum_b / m) * (sum_b / m)));
+		correlation_chi_square += correlation * correlation * m;
+	}
+
+	chi_square = 0.0;
+	for (uint64_t ones : xor_bits) {
+		double z = ((double)ones - n / 2.0) / std::sqrt(n / 4.0);
+		chi_square += z * z;
+	}
+	passed = report_random_test("neighbouring streams xor", chi_square, 64.0,
+		chi_square_p_value(chi_square, 64.0)) && passed;
+	passed = report_random_test("neighbouring correlation", correlation_chi_square, (double)streams,
+		chi_square_p_value(correlation_chi_square, (double)streams)) && passed;
+
+	return passed;
+}
+
+/*
+ * Check random_index on one engine: every index below 52 has to come up
+ * equally often, and a one deck shuffle has to move cards.
+ *
+ * Parameters:
+ *	name: Name of the engine to print.
+ *	seed: Seed of the engine.
+ *
+ * Return:
+ *	True if the check passed.
+ */
+template <typename Engine>
+static bool check_random_index_for(const char *name, uint64_t seed) {
+	const int bound = 52;
+	const int draws = bound * 20000;
+	Engine engine((typename Engine::result_type)seed);
+
+	uint64_t counts[bound] = {};
+	for (int i = 0; i < draws; i++) {
+		counts[random_index(engine, bound)]++;
+	}
+
+	double expected = (double)draws / bound;
+	double statistic = 0;
+	for (uint64_t count : counts) {
+		statistic += (count - expected) * (count - expected) / expected;
+	}
+	double p_value = chi_square_p_value(statistic, bound - 1);
+
+	Deck deck(1);
+	std::vector<Card> before(deck.remaining_cards().begin(), deck.remaining_cards().end());
+	deck.shuffle(engine);
+	bool moved = !same_cards(before, deck.remaining_cards());
+
+	bool passed = p_value >= CHECK_ALPHA && moved;
+	printf("random_index on %-20s %s, chi-square %.1f on %d degrees of freedom, p = %.4g%s\n", name,
+		passed ? "ok" : "FAILED", statistic, bound - 1, p_value, moved ? "" : ", shuffle moved no card");
+	return passed;
+}
+
+/*
+ * Check that random_index stays uniform on engines that give fewer than 64
+ * bits per call, including ones whose range is not a power of two.
+ *
+ * Parameters:
+ *	seed: Seed of the engines.
+ *
+ * Return:
+ *	True if every engine passed.
+ */
+static bool check_random_index(uint64_t seed) {
+	bool passed = check_random_index_for<std::minstd_rand>("std::minstd_rand", seed | 1);
+	passed = check_random_index_for<std::ranlux24>("std::ranlux24", seed) && passed;
+	passed = check_random_index_for<std::mt19937>("std::mt19937", seed) && passed;
+	passed = check_random_index_for<Philox4x32>("Philox4x32", seed) && passed;
+	return passed;
+}
+
+/*
+ * Get a card with a blackjack value, 2 through 11 for an ace.
+ */
+static Card card_with_value(int value) {
+	return Card(value == 11 ? CardRank::Ace : (CardRank)value, CardSuit::Spade, true);
+}
+
+/*
+ * Get the play for a hand of two cards from the built in chart and from a
+ * strategy table, and report it if they differ.
+ *
+ * Return:
+ *	True if the two agree.
+ */
+static bool same_play(const StrategyTable &table, const RuleSet &rules, const char *row, int first, int second,
+	int upcard, bool can_split) {
+	Hand hand;
+	hand.add(card_with_value(first));
+	hand.add(card_with_value(second));
+	PlayerAction expected = basic_strategy(hand, upcard, rules, true, can_split, true);
+	PlayerAction actual = table_strategy(table, hand, upcard, rules, true, can_split, true);
+	if (can_split) {
+		/* Pairs that aren't split are played by total, which the hard and soft rows check. */
+		expected = expected == PlayerAction::Split ? expected : PlayerAction::Hit;
+		actual = actual == PlayerAction::Split ? actual : PlayerAction::Hit;
+	}
+	if (expected != actual) {
+		printf("  %s against %d: chart %s, generated %s\n", row, upcard, player_action_name(expected),
+			player_action_name(actual));
+		return false;
+	}
+	return true;
+}
+
+/*
+ * Check the exact strategy generator, and with it HandAnalyzer and the
+ * dealer outcome cache, against the built in chart for six decks, S17 and
+ * DAS, the rules the chart is for, where the two agree on every cell. Every
+ * hard total, soft total and pair is checked against every upcard.
+ *
+ * Parameters:
+ *	seed: Unused, the strategy doesn't depend on it.
+ *
+ * Return:
+ *	True if the generated chart matched the built in chart on every cell.
+ */
+static bool check_exact_strategy(uint64_t) {
+	RuleSet rules;
+	rules.deck_count = 6;
+	rules.dealer_hits_soft_17 = false;
+	rules.double_after_split = true;
+	StrategyTable table = generate_basic_strategy(rules);
+
+	int cells = 0, differences = 0;
+	char row[16];
+	for (int upcard = 2; upcard <= 11; upcard++) {
+		/* Hard totals from two different cards, or a pair that isn't split for 4 and 20. */
+		for (int total = 4; total <= 20; total++) {
+			int first = total <= 11 ? 2 : 10;
+			snprintf(row, sizeof(row), "hard %d", total);
+			differences += same_play(table, rules, row, first, total - first, upcard, false) ? 0 : 1;
+			cells++;
+		}
+		for (int other = 2; other <= 9; other++) {
+			snprintf(row, sizeof(row), "soft %d", 11 + other);
+			differences += same_play(table, rules, row, 11, other, upcard, false) ? 0 : 1;
+			cells++;
+		}
+		for (int pair = 2; pair <= 11; pair++) {
+			snprintf(row, sizeof(row), "pair of %d", pair);
+			differences += same_play(table, rules, row, pair, pair, upcard, true) ? 0 : 1;
+			cells++;
+		}
+	}
+
+	bool passed = differences == 0;
+	printf("Exact strategy against the chart     %s, %d of %d cells differ\n", passed ? "ok" : "FAILED",
+		differences, cells);
+	return passed;
+}
+
+/*
+ * Check that the best ramps for a few spreads and the Kelly ramp never bet
+ * less at a higher true count, on a run short enough that the edges of
+ * neighbouring counts often come out of order.
+ *
+ * Parameters:
+ *	seed: Seed of the run.
+ *
+ * Return:
+ *	True if every ramp was non-decreasing.
+ */
+static bool check_bet_ramps(uint64_t seed) {
+	static const double spreads[] = { 4.0, 8.0, 16.0 };
+	SimulationConfig config;
+	config.seed = seed;
+	config.shoe_count = 2000;
+	SimulationResult result = run_simulation(config, nullptr);
+
+	std::vector<BetRamp> ramps;
+	for (double spread : spreads) {
+		ramps.push_back(optimal_ramp(result, spread));
+	}
+	ramps.push_back(kelly_ramp(result, 1000.0, 16.0));
+
+	int decreasing = 0;
+	for (const BetRamp &ramp : ramps) {
+		for (int i = 1; i < TRUE_COUNT_BUCKETS; i++) {
+			if (ramp.bets[i] < ramp.bets[i - 1]) {
+				decreasing++;
+				break;
+			}
+		}
+	}
+
+	bool passed = decreasing == 0;
+	printf("Bet ramps never bet less going up    %s, %d of %zu ramps bet less at a higher count\n",
+		passed ? "ok" : "FAILED", decreasing, ramps.size());
+	return passed;
+}
+
+/*
+ * Check that a run whose checkpoints can't be written says so, by pointing
+ * the checkpoint into a directory that doesn't exist, that a checkpoint
+ * whose temporary file can't replace the checkpoint, because a directory of
+ * that name is in the way, leaves no temporary file behind, and that a run
+ * with a writable checkpoint file saves one that loads back with its
+ * results.
+ *
+ * Parameters:
+ *	seed: Seed of the runs.
+ *
+ * Return:
+ *	True if every run reported its checkpoints correctly.
+ */
+static bool check_checkpoint_writer(uint64_t seed) {
+	SimulationConfig config;
+	config.seed = seed;
+	config.shoe_count = 200;
+	config.thread_count = 2;
+
+	std::filesystem::path missing = std::filesystem::temp_directory_path() / "card_sim no such directory" /
+		"checkpoint";
+	std::string missing_path = missing.string();
+	config.checkpoint_path = missing_path.c_str();
+	bool bad_reported = run_simulation(config, nullptr).checkpoint_failed;
+
+	std::filesystem::path blocked = std::filesystem::temp_directory_path() /
+		("card_sim_self_test_" + std::to_string(seed) + ".blocked");
+	std::error_code error;
+	std::filesystem::create_directories(blocked / "in the way", error);
+	std::string blocked_path = blocked.string();
+	config.checkpoint_path = blocked_path.c_str();
+	bool blocked_cleaned = run_simulation(config, nullptr).checkpoint_failed &&
+		!std::filesystem::exists(blocked_path + ".tmp");
+	std::filesystem::remove_all(blocked, error);
+	std::filesystem::remove(blocked_path + ".tmp", error);
+
+	std::filesystem::path good = std::filesystem::temp_directory_path() /
+		("card_sim_self_test_" + std::to_string(seed) + ".checkpoint");
+	std::string good_path = good.string();
+	config.checkpoint_path = good_path.c_str();
+	SimulationResult result = run_simulation(config, nullptr);
+	SimulationCheckpoint saved;
+	bool good_written = !result.checkpoint_failed && load_checkpoint(good_path, saved) &&
+		saved.result.shoes == result.shoes && saved.result.totals.units == result.totals.units;
+	std::filesystem::remove(good, error);
+
+	bool passed = bad_reported && blocked_cleaned && good_written;
+	printf("Checkpoint write failures reported   %s%s%s%s\n", passed ? "ok" : "FAILED",
+		bad_reported ? "" : ", a checkpoint in a missing directory counted as written",
+		blocked_cleaned ? "" : ", a checkpoint that couldn't be renamed left its temporary file",
+		good_written ? "" : ", a writable checkpoint wasn't saved");
+	return passed;
+}
+
+/*
+ * Run one shard of a run with a checkpoint and load the checkpoint back.
+ */
+static bool run_shard_checkpoint(const SimulationConfig &config, int shard, int shard_count,
+	const std::string &path, SimulationCheckpoint &checkpoint) {
+	SimulationConfig shard_settings = shard_config(config, shard, shard_count);
+	shard_settings.checkpoint_path = path.c_str();
+	SimulationResult result = run_simulation(shard_settings, nullptr);
+	bool loaded = !result.checkpoint_failed && load_checkpoint(path, checkpoint);
+	std::error_code error;
+	std::filesystem::remove(path, error);
+	return loaded;
+}
+
+/*
+ * Check that merge_checkpoints combines the two shards of a run into every
+ * shoe of the run, and that it turns down the first shard of a run of
+ * 2 * shoes shoes merged with the second shard of a run of 4 * shoes shoes,
+ * which don't overlap but leave shoes out.
+ *
+ * Parameters:
+ *	seed: Seed of the runs.
+ *
+ * Return:
+ *	True if the matching shards merged and the mismatched ones didn't.
+ */
+static bool check_checkpoint_merge(uint64_t seed) {
+	const uint64_t shoes = 100;
+	SimulationConfig config;
+	config.seed = seed;
+	config.thread_count = 2;
+	std::string base = (std::filesystem::temp_directory_path() /
+		("card_sim_self_test_" + std::to_string(seed) + ".shard")).string();
+
+	SimulationConfig short_run = config;
+	short_run.shoe_count = 2 * shoes;
+	SimulationConfig long_run = config;
+	long_run.shoe_count = 4 * shoes;
+	std::vector<SimulationCheckpoint> matching(2), mismatched(2);
+	bool ran = run_shard_checkpoint(short_run, 0, 2, base + ".1", matching[0]) &&
+		run_shard_checkpoint(short_run, 1, 2, base + ".2", matching[1]) &&
+		run_shard_checkpoint(long_run, 1, 2, base + ".3", mismatched[1]);
+	mismatched[0] = matching[0];
+
+	SimulationResult merged;
+	std::string error;
+	bool matching_merged = ran && merge_checkpoints(matching, merged, error) && merged.shoes == 2 * shoes;
+	bool mismatched_refused = ran && !merge_checkpoints(mismatched, merged, error);
+
+	bool passed = matching_merged && mismatched_refused;
+	printf("Shards of different runs refused     %s%s%s\n", passed ? "ok" : "FAILED",
+		matching_merged ? "" : ", the shards of one run didn't merge",
+		mismatched_refused ? "" : ", shards of runs with different shoe counts merged");
+	return passed;
+}
+
+/*
+ * Check that HandRecordFile::open turns down damaged files instead of
+ * hanging or reading past the end: a chunk header that was cleared with a
+ * size of zero, one with a size too small to hold the header and a file cut
+ * off in the middle of a chunk.
+ *
+ * Parameters:
+ *	seed: Seed of the run that records the hands.
+ *
+ * Return:
+ *	True if the whole file opened and every damaged copy was turned down.
+ */
+static bool check_hand_record_file(uint64_t seed) {
+	std::filesystem::path path = std::filesystem::temp_directory_path() /
+		("card_sim_self_test_" + std::to_string(seed) + ".hands");
+	std::string path_string = path.string();
+
+	HandRecordWriter writer;
+	bool written = writer.open(path_string);
+	if (written) {
+		SimulationConfig config;
+		config.seed = seed;
+		config.shoe_count = 50;
+		config.thread_count = 1;
+		config.hand_records = &writer;
+		run_simulation(config, nullptr);
+		written = writer.close();
+	}
+
+	std::vector<unsigned char> whole;
+	FILE *file = written ? fopen(path_string.c_str(), "rb") : NULL;
+	if (file != NULL) {
+		unsigned char buffer[4096];
+		size_t read;
+		while ((read = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+			whole.insert(whole.end(), buffer, buffer + read);
+		}
+		fclose(file);
+	}
+
+	HandRecordFile records;
+	bool whole_ok = whole.size() > sizeof(HandFileHeader) + sizeof(HandChunkHeader) && records.open(path_string) &&
+		records.chunk_count() > 0;
+	records.close();
+
+	int accepted = 0;
+	if (whole_ok) {
+		uint64_t bad_sizes[] = { 0, HAND_RECORD_ALIGNMENT };
+		for (uint64_t bad_size : bad_sizes) {
+			/* Keep the magic but clear the rest of the header, like a chunk that was never finished. */
+			std::vector<unsigned char> damaged = whole;
+			HandChunkHeader *chunk = (HandChunkHeader *)&damaged[sizeof(HandFileHeader)];
+			uint32_t magic = chunk->magic;
+			memset(chunk, 0, sizeof(HandChunkHeader));
+			chunk->magic = magic;
+			chunk->size = bad_size;
+			file = fopen(path_string.c_str(), "wb");
+			fwrite(damaged.data(), 1, damaged.size(), file);
+			fclose(file);
+			accepted += records.open(path_string);
+			records.close();
+		}
+
+		file = fopen(path_string.c_str(), "wb");
+		fwrite(whole.data(), 1, whole.size() - HAND_RECORD_ALIGNMENT, file);
+		fclose(file);
+		accepted += records.open(path_string);
+		records.close();
+	}
+	std::error_code error;
+	std::filesystem::remove(path, error);
+
+	bool passed = whole_ok && accepted == 0;
+	printf("Hand record files checked on open    %s, %d of 3 damaged files opened%s\n", passed ? "ok" : "FAILED",
+		accepted, whole_ok ? "" : ", the whole file didn't open");
+	return passed;
+}
+
+/*
+ * Check the task scheduler runs every task exactly once for task counts
+ * that do and don't split evenly between the workers, including fewer
+ * tasks than workers, and that a cancel made before a run stops that run
+ * without stopping the next one.
+ *
+ * Parameters:
+ *	seed: Not used.
+ *
+ * Return:
+ *	True if every run ran the right tasks.
+ */
+static bool check_task_scheduler(uint64_t) {
+	int failures = 0, runs = 0;
+
+	for (int threads : { 1, 2, 3, 8 }) {
+		TaskScheduler scheduler(threads);
+		for (uint64_t task_count : { 0, 1, 2, 7, 64, 1001 }) {
+			std::vector<std::atomic<int>> counts(task_count);
+			uint64_t completed = scheduler.run(task_count, [&](uint64_t task, int) {
+				counts[task].fetch_add(1, std::memory_order_relaxed);
+			});
+			bool once = completed == task_count;
+			for (std::atomic<int> &count : counts) {
+				once = once && count.load() == 1;
+			}
+			failures += !once;
+			runs++;
+		}
+
+		std::atomic<uint64_t> started(0);
+		scheduler.cancel();
+		failures += scheduler.run(100, [&](uint64_t, int) { started++; }) != 0 || started.load() != 0;
+		failures += scheduler.run(100, [&](uint64_t, int) { started++; }) != 100 || started.load() != 100;
+		runs += 2;
+	}
+
+	printf("Task scheduler runs every task once  %s, %d of %d runs wrong\n", failures == 0 ? "ok" : "FAILED",
+		failures, runs);
+	return failures == 0;
+}
+
+/*
+ * Check that a row of a count distribution is a point mass at a running count.
+ */
+static bool is_point_mass(const CountDistribution &distribution, int cards_dealt, int running) {
+	for (int count = distribution.min_running; count <= distribution.max_running; count++) {
+		double expected = count == running ? 1.0 : 0.0;
+		if (std::fabs(distribution.running_probability(cards_dealt, count) - expected) > 1e-12) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*
+ * Check count_distribution against chances that can be worked out by hand.
+ * For one deck of Hi-Lo every row sums to one, nothing has been seen before
+ * the first card or is left after the last so the first and last rows are
+ * point masses at zero, and the first card is one of the 20 low cards, 12
+ * neutral cards or 20 high cards. Two decks of KO, which isn't balanced,
+ * start at 4 - 4 * 2 and end 8 higher, since each deck has four more low
+ * cards than high ones.
+ *
+ * Parameters:
+ *	seed: Unused, the distribution doesn't depend on it.
+ *
+ * Return:
+ *	True if every chance matched.
+ */
+static bool check_count_distribution(uint64_t) {
+	const double tolerance = 1e-12;
+	CountDistribution hi_lo = count_distribution(CountingSystemId::HiLo, 1);
+	int bad_row = -1;
+	for (int n = 0; n <= hi_lo.card_count(); n++) {
+		double sum = 0.0;
+		for (int count = hi_lo.min_running; count <= hi_lo.max_running; count++) {
+			sum += hi_lo.running_probability(n, count);
+		}
+		if (std::fabs(sum - 1.0) > tolerance && bad_row < 0) {
+			bad_row = n;
+		}
+	}
+	bool rows_sum = bad_row < 0;
+	bool hi_lo_ends = is_point_mass(hi_lo, 0, 0) && is_point_mass(hi_lo, hi_lo.card_count(), 0);
+	bool first_card = std::fabs(hi_lo.running_probability(1, 1) - 20.0 / 52.0) < tolerance &&
+		std::fabs(hi_lo.running_probability(1, 0) - 12.0 / 52.0) < tolerance &&
+		std::fabs(hi_lo.running_probability(1, -1) - 20.0 / 52.0) < tolerance;
+	/* Two cards are both low in 20 * 19 / 2 of the 52 * 51 / 2 pairs. */
+	bool two_cards = std::fabs(hi_lo.running_probability(2, 2) - 190.0 / 1326.0) < tolerance;
+
+	CountDistribution ko = count_distribution(CountingSystemId::KnockOut, 2);
+	bool ko_ends = is_point_mass(ko, 0, -4) && is_point_mass(ko, ko.card_count(), 4);
+
+	bool passed = rows_sum && hi_lo_ends && first_card && two_cards && ko_ends;
+	printf("Count distribution by hand           %s%s%s%s%s%s\n", passed ? "ok" : "FAILED",
+		rows_sum ? "" : ", a Hi-Lo row doesn't sum to one",
+		hi_lo_ends ? "" : ", Hi-Lo doesn't start and end at zero",
+		first_card ? "" : ", the first card's Hi-Lo count is wrong",
+		two_cards ? "" : ", the chance of two low cards is wrong",
+		ko_ends ? "" : ", two deck KO doesn't start at -4 and end at +4");
+	return passed;
+}
+
+/*
+ * A check card_sim --self-test runs.
+ */
+struct Check {
+	const char *name;
+	bool (*run)(uint64_t seed);
+};
+
+static const Check checks[] = {
+	{ "count kernel", check_count_kernel },
+	{ "composition", check_composition },
+	{ "composition tracker", check_composition_tracker },
+	{ "Philox", check_philox },
+	{ "random_index", check_random_index },
+	{ "task scheduler", check_task_scheduler },
+	{ "exact strategy", check_exact_strategy },
+	{ "bet ramps", check_bet_ramps },
+	{ "checkpoint writer", check_checkpoint_writer },
+	{ "checkpoint merge", check_checkpoint_merge },
+	{ "hand record file", check_hand_record_file },
+	{ "count distribution", check_count_distribution },
+};
+
+/*
+ * Run every check of the back-end that is too slow or too specific to run
+ * on every start, and print the result of each.
+ *
+ * Parameters:
+ *	seed: Seed for the random inputs of the checks.
+ *
+ * Return:
+ *	True if every check passed.
+ */
+bool run_self_test(uint64_t seed) {
+	bool passed = true;
+	for (const Check &check : checks) {
+		if (!check.run(seed)) {
+			printf("The %s check FAILED\n", check.name);
+			passed = false;
+		}
+	}
+	return passed;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#include <cstdint>
+
+bool run_self_test(uint64_t seed);
@@ -0,0 +1,953 @@
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Simulator.h"
+#include "CountingSystem.h"
+#include "StrategyGenerator.h"
+#include "BetRamp.h"
+#include "IndexGenerator.h"
+#include "Checkpoint.h"
+#include "HandRecords.h"
+#include "CountDistribution.h"
+#include "ShuffleTest.h"
+#include "Benchmarks.h"
+#include "Checks.h"
+
+/*
+ * Print the command line options.
+ */
+void print_usage() {
+	printf(
+		"Usage: card_sim [options]\n"
+		"  --decks N          Number of decks in the shoe (default 6)\n"
+		"  --penetration F    Fraction of the shoe dealt before shuffling (default 0.75)\n"
+		"  --h17              Dealer hits soft 17\n"
+		"  --no-das           No doubling after splitting\n"
+		"  --rsa              Aces can be split again\n"
+		"  --surrender        Late surrender is allowed\n"
+		"  --max-hands N      Maximum number of hands after splitting (default 4)\n"
+		"  --blackjack F      Blackjack payout, 1.5 for 3:2 and 1.2 for 6:5 (default 1.5)\n"
+		"  --system NAME      Counting system: hilo, ko, hiopt2, omega2, zen or halves\n"
+		"  --shoes N          Number of shoes to play (default 100000)\n"
+		"  --target-se F      Stop once the standard error of the EV is below F percent, for example\n"
+		"                     0.01. --shoes is then the most shoes to play (default no limit). Not\n"
+		"                     for --vs or --index-plays\n"
+		"  --first-shoe N     Index of the first shoe to play (default 0)\n"
+		"  --threads N        Number of worker threads, 0 for one per core (default 0)\n"
+		"  --seed N           Seed for the shuffles (default is the current time)\n"
+		"  --antithetic       Play shoes in pairs, the second with the low and high cards swapped\n"
+		"  --vs OPTIONS...    Compare with a second configuration played on the same shoes. Options\n"
+		"                     after --vs change the second configuration, for example --vs --h17\n"
+		"  --exact-strategy   Work out the exact basic strategy for the rules, print it and play it\n"
+		"  --bet-ramp         Find the best bet ramps for the count and print how they do on as many\n"
+		"                     other shoes, played after the run\n"
+		"  --bankroll N       Bankroll in minimum bets for the Kelly ramp and risk of ruin (default 1000)\n"
+		"  --max-spread N     Largest bet in minimum bets for the Kelly ramp (default 16)\n"
+		"  --index-plays FILE Find the true count index of every deviation, print them and save them\n"
+		"                     to FILE for the trainer to quiz on\n"
+		"  --index-rounds N   Most rounds to simulate at a true count for an index (default 200000)\n"
+		"  --checkpoint FILE  Save the progress of the run to FILE and carry on from FILE if it exists.\n"
+		"                     The same options, apart from --threads, must be passed to carry on\n"
+		"  --checkpoint-seconds N\n"
+		"                     Seconds between checkpoints (default 60)\n"
+		"  --shard I/K        Play only the Ith of K equal shares of the shoes. Combine the checkpoints\n"
+		"                     of the K shards with --merge\n"
+		"  --processes K      Run the shards as K processes with checkpoints FILE.1 to FILE.K, where\n"
+		"                     FILE is given with --checkpoint, and merge them\n"
+		"  --merge FILES...   Combine the checkpoints of finished shards and print the results. Every\n"
+		"                     shard of the run has to be given once\n"
+		"  --hand-records FILE\n"
+		"                     Record every hand played to FILE in a columnar format\n"
+		"  --scan-hands FILE  Print a summary of the hands recorded in FILE\n"
+		"  --runtime-rules    Check the rules at runtime even for rule sets with a player compiled\n"
+		"                     for them, to compare speeds\n"
+		"  --count-distribution FILE\n"
+		"                     Work out the exact chance of every running count at every depth of the\n"
+		"                     shoe, print a summary and save the distribution to FILE\n"
+		"  --shuffle-test     Shuffle a deck of --decks decks over and over and test the shuffles for\n"
+		"                     bias. Exits with 1 if the shuffle is biased\n"
+		"  --shuffles N       Number of shuffles for --shuffle-test (default 100000000)\n"
+		"  --engine NAME      Random engine for --shuffle-test: philox, xoshiro, pcg, mt19937,\n"
+		"                     mt19937_64, rand, the 15 bit rand() the old shuffle used, or legacy,\n"
+		"                     the old rand() %% size shuffle (default philox)\n"
+		"  --self-test        Run the checks of the back-end and exit with 1 if any of them fail\n"
+		"  --bench NAME       Run a benchmark and print the results, or every benchmark for all.\n"
+		"                     Benchmarks: shuffle, rng, card, draw, ascii, kernel, scheduler,\n"
+		"                     dealer, advisor, rules\n"
+		"  --bench-scale F    Multiply the work every benchmark does by F (default 1)\n"
+	);
+}
+
+/*
+ * Print the results of a simulation run.
+ */
+void print_result(const SimulationResult &result) {
+	printf("Shoes:            %llu\n", (unsigned long long)result.shoes);
+	printf("Rounds:           %llu\n", (unsigned long long)result.totals.rounds);
+	printf("Hands:            %llu\n", (unsigned long long)result.hands);
+	printf("EV:               %+.4f%% +/- %.4f%%\n", result.ev() * 100.0, result.standard_error() * 100.0);
+	printf("Variance:         %.4f\n", result.variance());
+	printf("Time:             %.2f s\n", result.seconds);
+	printf("Rounds/second:    %.0f\n", result.rounds_per_second());
+	if (result.pair_totals.rounds > 0) {
+		printf("Variance reduced: %.2fx by antithetic shoes\n", result.variance_reduction());
+	}
+
+	printf("\n  TC      Rounds    Freq        EV\n");
+	for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+		const RoundTotals &bucket = result.true_counts[i];
+		if (bucket.rounds == 0) {
+			continue;
+		}
+		printf("%4d %11llu %6.2f%% %+8.3f%%\n", i + TRUE_COUNT_MIN, (unsigned long long)bucket.rounds,
+			100.0 * bucket.rounds / result.totals.rounds, bucket.mean() * 100.0);
+	}
+}
+
+/*
+ * Print a strategy chart in the same layout as the built in charts.
+ */
+void print_strategy(const StrategyTable &table) {
+	static const char *pair_names[10] = {
+		"2,2", "3,3", "4,4", "5,5", "6,6", "7,7", "8,8", "9,9", "10,10", "A,A"
+	};
+
+	printf("Hard        2345678910A\n");
+	for (int row = 0; row < 18; row++) {
+		printf("  %-8d  %s\n", row + 4, table.hard[row]);
+	}
+	printf("Soft\n");
+	for (int row = 0; row < 9; row++) {
+		printf("  %-8d  %s\n", row + 13, table.soft[row]);
+	}
+	printf("Pairs\n");
+	for (int row = 0; row < 10; row++) {
+		printf("  %-8s  %s\n", pair_names[row], table.pair[row]);
+	}
+	printf("\n");
+}
+
+/*
+ * Print the best ramp for a range of spreads along with the Kelly ramp and
+ * how each of them does. The ramps are fit to the rounds of result and
+ * evaluated on the rounds of test, which should be other shoes so the
+ * numbers aren't flattered by fitting to the noise of the same rounds. Every
+ * ramp is evaluated on the same rounds. Without test the ramps are evaluated
+ * on the rounds they were fit to and the output says so.
+ */
+void print_ramps(const SimulationResult &result, const SimulationResult *test, double bankroll, double max_spread) {
+	static const double spreads[] = { 1.0, 4.0, 8.0, 12.0, 16.0 };
+	const int spread_count = sizeof(spreads) / sizeof(spreads[0]);
+
+	BetRamp ramps[spread_count + 1];
+	char names[spread_count + 1][16];
+	for (int i = 0; i < spread_count; i++) {
+		ramps[i] = optimal_ramp(result, spreads[i]);
+		snprintf(names[i], sizeof(names[i]), "1-%g", spreads[i]);
+	}
+	ramps[spread_count] = kelly_ramp(result, bankroll, max_spread);
+	snprintf(names[spread_count], sizeof(names[spread_count]), "Kelly");
+
+	printf("\nBet ramps in minimum bets\n  TC    Freq        EV");
+	for (int i = 0; i <= spread_count; i++) {
+		printf(" %7s", names[i]);
+	}
+	printf("\n");
+	for (int t = 0; t < TRUE_COUNT_BUCKETS; t++) {
+		const RoundTotals &bucket = result.true_counts[t];
+		if (bucket.rounds == 0) {
+			continue;
+		}
+		printf("%4d %6.2f%% %+8.3f%%", t + TRUE_COUNT_MIN, 100.0 * bucket.rounds / result.totals.rounds,
+			bucket.mean() * 100.0);
+		for (int i = 0; i <= spread_count; i++) {
+			printf(" %7.2f", ramps[i].bets[t]);
+		}
+		printf("\n");
+	}
+
+	if (test != nullptr) {
+		printf("\nOn %llu other shoes\n", (unsigned long long)test->shoes);
+	}
+	else {
+		printf("\nOn the shoes the ramps were fit to, so the numbers are optimistic\n");
+	}
+	printf("Ramp     Avg bet   EV/round  SD/round    SCORE            N0   RoR (%.0f units)\n", bankroll);
+	for (int i = 0; i <= spread_count; i++) {
+		RampStatistics stats = evaluate_ramp(test != nullptr ? *test : result, ramps[i], bankroll);
+		printf("%-7s %8.3f %+10.5f %9.4f %8.3f %13.0f %8.4f%%\n", names[i], stats.average_bet, stats.ev,
+			sqrt(stats.variance), stats.score, stats.n0, stats.risk_of_ruin * 100.0);
+	}
+}
+
+/*
+ * Print index plays as a table.
+ */
+void print_index_plays(const std::vector<IndexPlay> &plays) {
+	printf("Hand    Up  Basic      Deviation  Index      Rounds\n");
+	for (const IndexPlay &play : plays) {
+		std::string upcard = play.upcard == 11 ? std::string("A") : std::to_string(play.upcard);
+		printf("%-7s %-3s %-10s %-10s %s %+3d %11llu\n", index_hand_name(play).c_str(), upcard.c_str(),
+			player_action_name(play.basic_action), player_action_name(play.deviation), play.above ? ">=" : "<=",
+			play.index, (unsigned long long)play.rounds);
+	}
+}
+
+/*
+ * Print how a comparison of two configurations came out.
+ */
+void print_comparison(const ComparisonResult &comparison) {
+	printf("\nDifference:       %+.4f%% +/- %.4f%%\n", comparison.difference() * 100.0,
+		comparison.standard_error() * 100.0);
+	printf("Independent runs: +/- %.4f%%\n", comparison.independent_standard_error() * 100.0);
+	printf("Variance reduced: %.2fx\n", comparison.variance_reduction());
+}
+
+/*
+ * Work out the exact basic strategy for a configuration, print it and set
+ * the configuration to play it.
+ *
+ * Return:
+ *	False if there are too many decks for the exact strategy.
+ */
+bool use_exact_strategy(SimulationConfig &config, StrategyTable &strategy) {
+	if (config.rules.deck_count > COMPOSITION_MAX_DECKS) {
+		fprintf(stderr, "The exact strategy supports at most %d decks\n", COMPOSITION_MAX_DECKS);
+		return false;
+	}
+	DealerCacheCounters counters;
+	strategy = generate_basic_strategy(config.rules, config.thread_count, &counters);
+	print_strategy(strategy);
+	printf("Dealer cache:     %.2f%% hits of %llu lookups, %llu evictions\n\n", counters.hit_rate() * 100.0,
+		(unsigned long long)counters.lookups, (unsigned long long)counters.evictions);
+	config.strategy = &strategy;
+	return true;
+}
+
+/*
+ * Print a progress line for a simulation: shoes played, hands per second,
+ * the 95% confidence interval of the EV so far and the time left.
+ */
+void print_simulation_progress(const SimulationProgress &progress) {
+	double ev = progress.totals.mean() * 100.0;
+	double margin = 1.96 * progress.standard_error() * 100.0;
+	fprintf(stderr, "\r%llu / %llu shoes  %.0f hands/s  EV %+.4f%% [%+.4f%%, %+.4f%%]  ETA %.0f s   ",
+		(unsigned long long)progress.shoes, (unsigned long long)progress.planned_shoes, progress.hands_per_second(),
+		ev, ev - margin, ev + margin, progress.seconds_left());
+	if (progress.shoes >= progress.planned_shoes) {
+		fprintf(stderr, "\n");
+	}
+}
+
+/*
+ * Print the number of shoes played so far.
+ */
+void print_progress(uint64_t completed, uint64_t total) {
+	fprintf(stderr, "\r%llu / %llu shoes", (unsigned long long)completed, (unsigned long long)total);
+	if (completed == total) {
+		fprintf(stderr, "\n");
+	}
+}
+
+/*
+ * Get the settings of a run that plays as many shoes as a finished run, on
+ * the shoes right after the ones the run could have played, to test the bet
+ * ramps fit to the finished run.
+ *
+ * Parameters:
+ *	config: Settings of the finished run.
+ *	shoes: Number of shoes the finished run played.
+ *
+ * Return:
+ *	Settings of the test run.
+ */
+SimulationConfig ramp_test_config(const SimulationConfig &config, uint64_t shoes) {
+	SimulationConfig test = config;
+	uint64_t run_shoes = config.shoe_count;
+	if (config.shuffle_mode == ShuffleMode::Antithetic) {
+		run_shoes += run_shoes % 2;
+	}
+	test.first_shoe = config.first_shoe + run_shoes;
+	test.shoe_count = shoes;
+	test.shard = 0;
+	test.shard_count = 1;
+	test.target_standard_error = 0.0;
+	test.checkpoint_path = nullptr;
+	test.resume = nullptr;
+	test.hand_records = nullptr;
+	return test;
+}
+
+/*
+ * Play the shoes to test the bet ramps of a finished run on.
+ */
+SimulationResult run_ramp_test(const SimulationConfig &config, const SimulationResult &result) {
+	fprintf(stderr, "Playing %llu other shoes to test the bet ramps\n", (unsigned long long)result.shoes);
+	return run_simulation(ramp_test_config(config, result.shoes), print_simulation_progress);
+}
+
+/*
+ * Quote a command line argument for std::system. On POSIX the argument is
+ * single quoted, with every ' written as '\'', so sh passes it on as it is
+ * without expanding $, ` or anything else in it.
+ */
+std::string quote_argument(const std::string &argument) {
+#ifdef _WIN32
+	return "\"" + argument + "\"";
+#else
+	std::string quoted = "'";
+	for (char c : argument) {
+		if (c == '\'') {
+			quoted += "'\\''";
+		}
+		else {
+			quoted += c;
+		}
+	}
+	return quoted + "'";
+#endif
+}
+
+/*
+ * Load the checkpoints of finished shards and combine their results.
+ */
+bool merge_shard_files(const std::vector<std::string> &paths, SimulationResult &merged, uint64_t &seed) {
+	std::vector<SimulationCheckpoint> shards(paths.size());
+	for (size_t i = 0; i < paths.size(); i++) {
+		if (!load_checkpoint(paths[i], shards[i])) {
+			fprintf(stderr, "%s is not a checkpoint or is damaged\n", paths[i].c_str());
+			return false;
+		}
+	}
+
+	std::string error;
+	if (!merge_checkpoints(shards, merged, error)) {
+		fprintf(stderr, "Could not merge the shards: %s\n", error.c_str());
+		return false;
+	}
+	seed = shards[0].seed;
+	return true;
+}
+
+/*
+ * Run every shard of a simulation as a process of its own and merge their
+ * results. Each process is this program run with the same options along
+ * with --shard and a checkpoint of its own, which is also how it hands its
+ * results back, so running the same command again carries on with any
+ * shards that didn't finish. The output of shard I goes to FILE.I.log.
+ */
+bool run_shard_processes(int argc, char **argv, const SimulationConfig &config, int process_count,
+	SimulationResult &merged, uint64_t &seed) {
+	/* Leave out the options every process gets its own value of. */
+	std::string options;
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--processes") == 0 || strcmp(argv[i], "--checkpoint") == 0 ||
+			strcmp(argv[i], "--seed") == 0 || strcmp(argv[i], "--threads") == 0) {
+			i++;
+			continue;
+		}
+		options += " " + quote_argument(argv[i]);
+	}
+
+	int thread_count = config.thread_count;
+	if (thread_count <= 0) {
+		thread_count = std::max(1, (int)std::thread::hardware_concurrency() / process_count);
+	}
+
+	std::vector<std::string> paths(process_count);
+	std::vector<int> statuses(process_count);
+	std::vector<std::thread> processes;
+	for (int i = 0; i < process_count; i++) {
+		paths[i] = std::string(config.checkpoint_path) + "." + std::to_string(i + 1);
+		std::string command = quote_argument(argv[0]) + options +
+			" --seed " + std::to_string(config.seed) +
+			" --threads " + std::to_string(thread_count) +
+			" --shard " + std::to_string(i + 1) + "/" + std::to_string(process_count) +
+			" --checkpoint " + quote_argument(paths[i]) +
+			" > " + quote_argument(paths[i] + ".log") + " 2>&1";
+		processes.emplace_back([command, &statuses, i] {
+			statuses[i] = std::system(command.c_str());
+		});
+	}
+	fprintf(stderr, "Running %d shards\n", process_count);
+
+	bool ok = true;
+	for (int i = 0; i < process_count; i++) {
+		processes[i].join();
+		if (statuses[i] != 0) {
+			fprintf(stderr, "Shard %d failed, see %s.log\n", i + 1, paths[i].c_str());
+			ok = false;
+		}
+	}
+
+	return ok && merge_shard_files(paths, merged, seed);
+}
+
+/*
+ * Scan the hands recorded in a file and print how they went at each true
+ * count and how often each outcome came up.
+ */
+bool print_hand_scan(const char *path) {
+	HandRecordFile file;
+	if (!file.open(path)) {
+		fprintf(stderr, "%s is not a hand record file or is damaged\n", path);
+		return false;
+	}
+
+	uint64_t hands[TRUE_COUNT_BUCKETS] = {};
+	int64_t units[TRUE_COUNT_BUCKETS] = {};
+	uint64_t outcomes[(int)HandOutcome::Surrender + 1] = {};
+	for (size_t c = 0; c < file.chunk_count(); c++) {
+		std::span<const int8_t> true_counts = file.true_counts(c);
+		std::span<const int16_t> hand_units = file.units(c);
+		std::span<const HandOutcome> hand_outcomes = file.outcomes(c);
+		for (size_t i = 0; i < true_counts.size(); i++) {
+			int bucket = true_counts[i] - TRUE_COUNT_MIN;
+			if (bucket < 0 || bucket >= TRUE_COUNT_BUCKETS || hand_outcomes[i] > HandOutcome::Surrender) {
+				fprintf(stderr, "%s has a hand with a true count or outcome out of range\n", path);
+				return false;
+			}
+			hands[bucket]++;
+			units[bucket] += hand_units[i];
+			outcomes[(int)hand_outcomes[i]]++;
+		}
+	}
+
+	uint64_t total = file.row_count();
+	printf("Hands:            %llu in %llu chunks\n", (unsigned long long)total,
+		(unsigned long long)file.chunk_count());
+	if (total == 0) {
+		return true;
+	}
+	printf("\n  TC       Hands    Freq  EV/hand\n");
+	for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+		if (hands[i] == 0) {
+			continue;
+		}
+		printf("%4d %11llu %6.2f%% %+7.3f%%\n", i + TRUE_COUNT_MIN, (unsigned long long)hands[i],
+			100.0 * hands[i] / total, 100.0 * units[i] / SIM_UNIT_SCALE / hands[i]);
+	}
+	printf("\nOutcome        Hands    Freq\n");
+	for (int i = 0; i <= (int)HandOutcome::Surrender; i++) {
+		printf("%-10s %11llu %6.2f%%\n", hand_outcome_name((HandOutcome)i), (unsigned long long)outcomes[i],
+			100.0 * outcomes[i] / total);
+	}
+	return true;
+}
+
+/*
+ * Print how likely a favourable true count is as the shoe is dealt and how
+ * often each true count comes up before the cut card.
+ */
+void print_count_distribution(const CountDistribution &distribution, float penetration) {
+	std::string_view name = with_counting_system(distribution.counting_system, [](auto system) {
+		return decltype(system)::name;
+	});
+	printf("%.*s, %d decks, worked out in %.3f s\n", (int)name.size(), name.data(), distribution.deck_count,
+		distribution.seconds);
+
+	int cut = std::clamp((int)(penetration * distribution.card_count()), 1, distribution.card_count());
+	printf("\nDecks dealt  TC>=+1  TC>=+2  TC>=+3  TC>=+4\n");
+	for (int n = 0; n < cut; n += 26) {
+		printf("%11.1f", n / 52.0);
+		for (int t = 1; t <= 4; t++) {
+			printf(" %6.2f%%", 100.0 * distribution.favourable(n, t));
+		}
+		printf("\n");
+	}
+
+	double frequency[TRUE_COUNT_BUCKETS] = {};
+	for (int n = 0; n < cut; n++) {
+		double depth[TRUE_COUNT_BUCKETS];
+		distribution.true_counts(n, depth);
+		for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+			frequency[i] += depth[i] / cut;
+		}
+	}
+	printf("\n  TC    Freq\n");
+	for (int i = 0; i < TRUE_COUNT_BUCKETS; i++) {
+		if (frequency[i] >= 0.00005) {
+			printf("%4d %6.2f%%\n", i + TRUE_COUNT_MIN, 100.0 * frequency[i]);
+		}
+	}
+	printf("\nTrue count +1 or more before the cut card: %.2f%% of cards dealt\n",
+		100.0 * distribution.favourable_frequency(penetration, 1));
+}
+
+/*
+ * Print the outcome of every shuffle test.
+ */
+void print_shuffle_test(const ShuffleTestResult &result, int deck_count) {
+	printf("Shuffles:         %llu\n", (unsigned long long)result.shuffles);
+	printf("Time:             %.2f s\n", result.seconds);
+	printf("Shuffles/second:  %.0f\n", result.shuffles / result.seconds);
+	printf("\nTest                       Statistic      df     p-value  Result\n");
+	for (const ShuffleTestOutcome &test : result.tests) {
+		if (test.skipped) {
+			printf("%-24s skipped, %s\n", test.name.c_str(), deck_count != 1 ? "needs --decks 1" : "too few shuffles");
+			continue;
+		}
+		printf("%-24s %12.3f", test.name.c_str(), test.statistic);
+		if (test.degrees_of_freedom > 0.0) {
+			printf(" %7.0f", test.degrees_of_freedom);
+		}
+		else {
+			printf("        ");
+		}
+		printf(" %11.3g  %s\n", test.p_value, test.biased ? "BIASED" : "pass");
+	}
+	if (!result.tests.empty()) {
+		printf("\nA test flags a bias below p = %.3g, %g spread over the tests run\n", result.test_alpha,
+			SHUFFLE_TEST_ALPHA);
+	}
+	printf("\n%s\n", result.biased() ? "The shuffle is biased" : "No bias found");
+}
+
+int main(int argc, char **argv) {
+	SimulationConfig config;
+	config.seed = (uint64_t)time(NULL);
+	bool exact_strategy = false;
+	/* Options for the rules and the strategy change the second configuration once --vs is passed. */
+	SimulationConfig second;
+	bool second_exact_strategy = false;
+	bool compare = false;
+	SimulationConfig *target = &config;
+	bool *target_exact_strategy = &exact_strategy;
+	bool shoes_given = false;
+	bool bet_ramp = false;
+	double bankroll = 1000.0;
+	double max_spread = 16.0;
+	const char *index_file = NULL;
+	uint64_t index_rounds = 200000;
+	bool seed_given = false;
+	SimulationCheckpoint checkpoint;
+	int shard = 0;
+	int shard_count = 0;
+	int process_count = 0;
+	std::vector<std::string> merge_paths;
+	const char *hand_record_file = NULL;
+	const char *scan_file = NULL;
+	const char *distribution_file = NULL;
+	bool shuffle_test = false;
+	bool self_test = false;
+	const char *benchmark = NULL;
+	BenchmarkOptions benchmark_options;
+	ShuffleTestConfig shuffle_config;
+	ShuffleEngineId shuffle_engine = ShuffleEngineId::Philox;
+	const char *shuffle_engine_name = "philox";
+	StrategyTable strategy, second_strategy;
+
+	for (int i = 1; i < argc; i++) {
+		const char *arg = argv[i];
+		const char *value = (i + 1 < argc) ? argv[i + 1] : NULL;
+
+		if (strcmp(arg, "--h17") == 0) {
+			target->rules.dealer_hits_soft_17 = true;
+		}
+		else if (strcmp(arg, "--no-das") == 0) {
+			target->rules.double_after_split = false;
+		}
+		else if (strcmp(arg, "--rsa") == 0) {
+			target->rules.resplit_aces = true;
+		}
+		else if (strcmp(arg, "--surrender") == 0) {
+			target->rules.late_surrender = true;
+		}
+		else if (strcmp(arg, "--exact-strategy") == 0) {
+			*target_exact_strategy = true;
+		}
+		else if (strcmp(arg, "--antithetic") == 0) {
+			config.shuffle_mode = ShuffleMode::Antithetic;
+		}
+		else if (strcmp(arg, "--vs") == 0 && !compare) {
+			second = config;
+			second_exact_strategy = exact_strategy;
+			compare = true;
+			target = &second;
+			target_exact_strategy = &second_exact_strategy;
+		}
+		else if (strcmp(arg, "--bet-ramp") == 0) {
+			bet_ramp = true;
+		}
+		else if (strcmp(arg, "--shuffle-test") == 0) {
+			shuffle_test = true;
+		}
+		else if (strcmp(arg, "--self-test") == 0) {
+			self_test = true;
+		}
+		else if (strcmp(arg, "--runtime-rules") == 0) {
+			config.specialize_rules = false;
+		}
+		else if (strcmp(arg, "--merge") == 0) {
+			merge_paths.assign(argv + i + 1, argv + argc);
+			if (merge_paths.empty()) {
+				print_usage();
+				return 1;
+			}
+			break;
+		}
+		else if (value == NULL) {
+			print_usage();
+			return 1;
+		}
+		else if (strcmp(arg, "--decks") == 0) {
+			target->rules.deck_count = atoi(value);
+			i++;
+		}
+		else if (strcmp(arg, "--penetration") == 0) {
+			target->rules.penetration = (float)atof(value);
+			i++;
+		}
+		else if (strcmp(arg, "--max-hands") == 0) {
+			target->rules.max_hands = atoi(value);
+			i++;
+		}
+		else if (strcmp(arg, "--blackjack") == 0) {
+			target->rules.blackjack_payout = (float)atof(value);
+			i++;
+		}
+		else if (strcmp(arg, "--system") == 0) {
+			if (!counting_system_from_name(value, target->counting_system)) {
+				print_usage();
+				return 1;
+			}
+			i++;
+		}
+		else if (strcmp(arg, "--engine") == 0) {
+			if (!shuffle_engine_from_name(value, shuffle_engine)) {
+				print_usage();
+				return 1;
+			}
+			shuffle_engine_name = value;
+			i++;
+		}
+		else if (strcmp(arg, "--bench") == 0) {
+			benchmark = value;
+			i++;
+		}
+		else if (strcmp(arg, "--bench-scale") == 0) {
+			benchmark_options.scale = atof(value);
+			i++;
+		}
+		else if (strcmp(arg, "--shuffles") == 0) {
+			shuffle_config.shuffles = strtoull(value, NULL, 10);
+			i++;
+		}
+		else if (strcmp(arg, "--shoes") == 0) {
+			config.shoe_count = strtoull(value, NULL, 10);
+			shoes_given = true;
+			i++;
+		}
+		else if (strcmp(arg, "--target-se") == 0) {
+			config.target_standard_error = atof(value) / 100.0;
+			i++;
+		}
+		else if (strcmp(arg, "--first-shoe") == 0) {
+			config.first_shoe = strtoull(value, NULL, 10);
+			i++;
+		}
+		else if (strcmp(arg, "--threads") == 0) {
+			config.thread_count = atoi(value);
+			i++;
+		}
+		else if (strcmp(arg, "--bankroll") == 0) {
+			bankroll = atof(value);
+			i++;
+		}
+		else if (strcmp(arg, "--max-spread") == 0) {
+			max_spread = atof(value);
+			i++;
+		}
+		else if (strcmp(arg, "--index-plays") == 0) {
+			index_file = value;
+			i++;
+		}
+		else if (strcmp(arg, "--hand-records") == 0) {
+			hand_record_file = value;
+			i++;
+		}
+		else if (strcmp(arg, "--scan-hands") == 0) {
+			scan_file = value;
+			i++;
+		}
+		else if (strcmp(arg, "--count-distribution") == 0) {
+			distribution_file = value;
+			i++;
+		}
+		else if (strcmp(arg, "--index-rounds") == 0) {
+			index_rounds = strtoull(value, NULL, 10);
+			i++;
+		}
+		else if (strcmp(arg, "--checkpoint") == 0) {
+			config.checkpoint_path = value;
+			i++;
+		}
+		else if (strcmp(arg, "--checkpoint-seconds") == 0) {
+			config.checkpoint_seconds = atof(value);
+			i++;
+		}
+		else if (strcmp(arg, "--shard") == 0) {
+			if (sscanf(value, "%d/%d", &shard, &shard_count) != 2 || shard < 1 || shard > shard_count) {
+				print_usage();
+				return 1;
+			}
+			i++;
+		}
+		else if (strcmp(arg, "--processes") == 0) {
+			process_count = atoi(value);
+			i++;
+		}
+		else if (strcmp(arg, "--seed") == 0) {
+			config.seed = strtoull(value, NULL, 10);
+			seed_given = true;
+			i++;
+		}
+		else {
+			print_usage();
+			return 1;
+		}
+	}
+
+	if (config.rules.deck_count < 1 || config.rules.max_hands < 1 || bankroll <= 0.0 || max_spread < 1.0 ||
+		second.rules.deck_count < 1 || second.rules.max_hands < 1) {
+		print_usage();
+		return 1;
+	}
+
+	if (config.target_standard_error > 0.0 && !shoes_given) {
+		/* No limit, but far enough below the largest index that shoe indices can't wrap around. */
+		config.shoe_count = UINT64_MAX / 4;
+	}
+
+	if (scan_file != NULL) {
+		return print_hand_scan(scan_file) ? 0 : 1;
+	}
+
+	if (self_test) {
+		return run_self_test(config.seed) ? 0 : 1;
+	}
+
+	if (benchmark != NULL) {
+		benchmark_options.thread_count = config.thread_count;
+		benchmark_options.seed = config.seed;
+		if (benchmark_options.scale <= 0.0 || !run_benchmark(benchmark, benchmark_options)) {
+			print_usage();
+			return 1;
+		}
+		return 0;
+	}
+
+	if (shuffle_test) {
+		shuffle_config.deck_count = config.rules.deck_count;
+		shuffle_config.seed = config.seed;
+		shuffle_config.thread_count = config.thread_count;
+		printf("Seed:             %llu\n", (unsigned long long)config.seed);
+		printf("Engine:           %s, %d decks\n", shuffle_engine_name, shuffle_config.deck_count);
+
+		auto show_progress = [](uint64_t completed, uint64_t total) {
+			fprintf(stderr, "\r%llu / %llu shuffles", (unsigned long long)completed, (unsigned long long)total);
+			if (completed == total) {
+				fprintf(stderr, "\n");
+			}
+		};
+		ShuffleTestResult result;
+		if (shuffle_engine == ShuffleEngineId::Legacy) {
+			result = run_legacy_shuffle_test(shuffle_config, show_progress);
+		}
+		else {
+			result = with_shuffle_engine(shuffle_engine, [&](auto engine) {
+				return run_shuffle_test<decltype(engine)>(shuffle_config, show_progress);
+			});
+		}
+		print_shuffle_test(result, shuffle_config.deck_count);
+		return result.biased() ? 1 : 0;
+	}
+
+	if (distribution_file != NULL) {
+		if (config.rules.deck_count > COUNT_DISTRIBUTION_MAX_DECKS) {
+			fprintf(stderr, "The count distribution supports at most %d decks\n", COUNT_DISTRIBUTION_MAX_DECKS);
+			return 1;
+		}
+		CountDistribution distribution = count_distribution(config.counting_system, config.rules.deck_count,
+			config.thread_count);
+		print_count_distribution(distribution, config.rules.penetration);
+		if (!save_count_distribution(distribution_file, distribution)) {
+			fprintf(stderr, "Could not write %s\n", distribution_file);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (hand_record_file != NULL && (compare || index_file != NULL || config.checkpoint_path != NULL ||
+		!merge_paths.empty() || process_count != 0 || shard_count != 0)) {
+		fprintf(stderr, "--hand-records only works for a single simulation without checkpoints\n");
+		return 1;
+	}
+
+	if (!merge_paths.empty() || process_count != 0) {
+		SimulationResult result;
+		uint64_t seed = 0;
+		if (process_count != 0) {
+			if (process_count < 1 || config.checkpoint_path == NULL || shard_count != 0) {
+				print_usage();
+				return 1;
+			}
+			if (compare || index_file != NULL || config.target_standard_error > 0.0) {
+				fprintf(stderr, "--processes only works for a single simulation without --target-se\n");
+				return 1;
+			}
+			/* Carry on with the seed of the shards if they were started without one. */
+			if (!seed_given && load_checkpoint(std::string(config.checkpoint_path) + ".1", checkpoint)) {
+				config.seed = checkpoint.seed;
+			}
+			if (!run_shard_processes(argc, argv, config, process_count, result, seed)) {
+				return 1;
+			}
+		}
+		else if (!merge_shard_files(merge_paths, result, seed)) {
+			return 1;
+		}
+
+		printf("Seed:             %llu\n", (unsigned long long)seed);
+		print_result(result);
+		if (bet_ramp && process_count != 0) {
+			SimulationResult test = run_ramp_test(config, result);
+			print_ramps(result, &test, bankroll, max_spread);
+		}
+		else if (bet_ramp) {
+			/* The settings of merged shards aren't known, so there are no other shoes to test on. */
+			print_ramps(result, nullptr, bankroll, max_spread);
+		}
+		return 0;
+	}
+
+	if (shard_count != 0) {
+		if (compare || index_file != NULL || config.target_standard_error > 0.0) {
+			fprintf(stderr, "--shard only works for a single simulation without --target-se\n");
+			return 1;
+		}
+		config = shard_config(config, shard - 1, shard_count);
+	}
+
+	if (config.target_standard_error > 0.0 && (compare || index_file != NULL)) {
+		fprintf(stderr, "--target-se only works for a single simulation\n");
+		return 1;
+	}
+
+	if (exact_strategy && !use_exact_strategy(config, strategy)) {
+		return 1;
+	}
+	if (compare && second_exact_strategy && !use_exact_strategy(second, second_strategy)) {
+		return 1;
+	}
+
+	if (config.checkpoint_path != NULL && (compare || index_file != NULL)) {
+		fprintf(stderr, "--checkpoint only works for a single simulation\n");
+		return 1;
+	}
+	FILE *existing = config.checkpoint_path != NULL ? fopen(config.checkpoint_path, "rb") : NULL;
+	if (existing != NULL) {
+		fclose(existing);
+		if (!load_checkpoint(config.checkpoint_path, checkpoint)) {
+			fprintf(stderr, "%s is not a checkpoint or is damaged\n", config.checkpoint_path);
+			return 1;
+		}
+		if (!seed_given) {
+			config.seed = checkpoint.seed;
+		}
+		if (!checkpoint_matches(checkpoint, config)) {
+			fprintf(stderr, "%s was saved by a run with different options\n", config.checkpoint_path);
+			return 1;
+		}
+		config.resume = &checkpoint;
+		fprintf(stderr, "Carrying on from %s\n", config.checkpoint_path);
+	}
+
+	printf("Seed:             %llu\n", (unsigned long long)config.seed);
+
+	if (index_file != NULL) {
+		IndexConfig index_config;
+		index_config.rules = config.rules;
+		index_config.counting_system = config.counting_system;
+		index_config.seed = config.seed;
+		index_config.max_rounds = index_rounds;
+		index_config.thread_count = config.thread_count;
+		index_config.strategy = config.strategy;
+
+		std::vector<IndexPlay> plays = generate_index_plays(index_config, [](uint64_t completed, uint64_t total) {
+			fprintf(stderr, "\r%llu / %llu comparisons", (unsigned long long)completed, (unsigned long long)total);
+			if (completed == total) {
+				fprintf(stderr, "\n");
+			}
+		});
+		print_index_plays(plays);
+		if (!save_index_plays(index_file, plays)) {
+			fprintf(stderr, "Could not write %s\n", index_file);
+			return 1;
+		}
+		return 0;
+	}
+
+	if (compare) {
+		ComparisonResult comparison = run_comparison(config, second, print_progress);
+		ComparisonResult test;
+		if (bet_ramp) {
+			fprintf(stderr, "Playing %llu other shoes to test the bet ramps\n",
+				(unsigned long long)comparison.first.shoes);
+			test = run_comparison(ramp_test_config(config, comparison.first.shoes),
+				ramp_test_config(second, comparison.first.shoes), print_progress);
+		}
+		printf("First configuration\n");
+		print_result(comparison.first);
+		if (bet_ramp) {
+			print_ramps(comparison.first, &test.first, bankroll, max_spread);
+		}
+		printf("\nSecond configuration\n");
+		print_result(comparison.second);
+		if (bet_ramp) {
+			print_ramps(comparison.second, &test.second, bankroll, max_spread);
+		}
+		print_comparison(comparison);
+		return 0;
+	}
+
+	HandRecordWriter hand_records;
+	if (hand_record_file != NULL) {
+		if (!hand_records.open(hand_record_file)) {
+			fprintf(stderr, "Could not write %s\n", hand_record_file);
+			return 1;
+		}
+		config.hand_records = &hand_records;
+	}
+
+	SimulationResult result = run_simulation(config, print_simulation_progress);
+	print_result(result);
+	if (bet_ramp) {
+		SimulationResult test = run_ramp_test(config, result);
+		print_ramps(result, &test, bankroll, max_spread);
+	}
+
+	if (result.checkpoint_failed) {
+		fprintf(stderr, "Could not write %s\n", config.checkpoint_path);
+		return 1;
+	}
+
+	if (hand_record_file != NULL) {
+		uint64_t rows = hand_records.row_count();
+		if (!hand_records.close()) {
+			fprintf(stderr, "Could not write %s\n", hand_record_file);
+			return 1;
+		}
+		printf("\nRecorded %llu hands to %s\n", (unsigned long long)rows, hand_record_file);
+	}
+
+	return 0;
+}